@@ -0,0 +1,132 @@
+//[TIF] The replacement global operator new and operator delete counted by
+//      alloc_counter.h.
+//
+//  Every form is replaced: single object and array, throwing and nothrow, the C++14
+//  sized deletes and the C++17 aligned forms.  Each new goes through counted_malloc()
+//  or counted_aligned_malloc() and each delete through the matching free, so whichever
+//  pair the compiler picks allocates and frees the same way and is counted once.
+
+#include "alloc_counter.h"
+#include <cstdlib>
+#include <new>
+
+#if __cplusplus >= 201103L
+#define TIF_THROW_BAD_ALLOC
+#define TIF_NO_THROW noexcept
+#else
+#define TIF_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define TIF_NO_THROW throw()
+#endif
+
+// ----------------------------------------------------------------------------------------
+
+namespace alloc_counter_impl
+{
+    counters& global_counters (
+    )
+    {
+        // zero initialized before any dynamic initialization, so operator new can be
+        // called before main().
+        static counters c;
+        return c;
+    }
+
+    static void* counted_malloc (
+        std::size_t size
+    )
+    {
+        counters& c = global_counters();
+        add(c.allocations, 1);
+        add(c.bytes, size);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+
+    static void counted_free (
+        void* ptr
+    )
+    {
+        if (ptr == 0)
+            return;
+        add(global_counters().deallocations, 1);
+        std::free(ptr);
+    }
+
+    static void* throw_if_null (
+        void* ptr
+    )
+    {
+        if (ptr == 0)
+            throw std::bad_alloc();
+        return ptr;
+    }
+
+#ifdef __cpp_aligned_new
+    // The block is over allocated with malloc() and the pointer malloc() returned is
+    // kept just before the aligned address, where counted_aligned_free() finds it.
+    static void* counted_aligned_malloc (
+        std::size_t size,
+        std::align_val_t alignment
+    )
+    {
+        counters& c = global_counters();
+        add(c.allocations, 1);
+        add(c.bytes, size);
+        const std::size_t align = static_cast<std::size_t>(alignment);
+        void* raw = std::malloc(size + align + sizeof(void*));
+        if (raw == 0)
+            return 0;
+        const std::size_t start = reinterpret_cast<std::size_t>(raw) + sizeof(void*);
+        void** ptr = reinterpret_cast<void**>((start + align - 1)/align*align);
+        ptr[-1] = raw;
+        return ptr;
+    }
+
+    static void counted_aligned_free (
+        void* ptr
+    )
+    {
+        if (ptr == 0)
+            return;
+        add(global_counters().deallocations, 1);
+        std::free(static_cast<void**>(ptr)[-1]);
+    }
+#endif
+}
+
+using namespace alloc_counter_impl;
+
+// ----------------------------------------------------------------------------------------
+
+void* operator new (std::size_t size) TIF_THROW_BAD_ALLOC { return throw_if_null(counted_malloc(size)); }
+void* operator new[] (std::size_t size) TIF_THROW_BAD_ALLOC { return throw_if_null(counted_malloc(size)); }
+void* operator new (std::size_t size, const std::nothrow_t&) TIF_NO_THROW { return counted_malloc(size); }
+void* operator new[] (std::size_t size, const std::nothrow_t&) TIF_NO_THROW { return counted_malloc(size); }
+
+void operator delete (void* ptr) TIF_NO_THROW { counted_free(ptr); }
+void operator delete[] (void* ptr) TIF_NO_THROW { counted_free(ptr); }
+void operator delete (void* ptr, const std::nothrow_t&) TIF_NO_THROW { counted_free(ptr); }
+void operator delete[] (void* ptr, const std::nothrow_t&) TIF_NO_THROW { counted_free(ptr); }
+
+#if __cplusplus >= 201402L
+// C++14 compilers call these when they know the size of the object.
+void operator delete (void* ptr, std::size_t) TIF_NO_THROW { counted_free(ptr); }
+void operator delete[] (void* ptr, std::size_t) TIF_NO_THROW { counted_free(ptr); }
+#endif
+
+#ifdef __cpp_aligned_new
+// C++17 compilers call these for types aligned beyond what malloc() guarantees.
+void* operator new (std::size_t size, std::align_val_t al) { return throw_if_null(counted_aligned_malloc(size, al)); }
+void* operator new[] (std::size_t size, std::align_val_t al) { return throw_if_null(counted_aligned_malloc(size, al)); }
+void* operator new (std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return counted_aligned_malloc(size, al); }
+void* operator new[] (std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return counted_aligned_malloc(size, al); }
+
+void operator delete (void* ptr, std::align_val_t) noexcept { counted_aligned_free(ptr); }
+void operator delete[] (void* ptr, std::align_val_t) noexcept { counted_aligned_free(ptr); }
+void operator delete (void* ptr, std::size_t, std::align_val_t) noexcept { counted_aligned_free(ptr); }
+void operator delete[] (void* ptr, std::size_t, std::align_val_t) noexcept { counted_aligned_free(ptr); }
+void operator delete (void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { counted_aligned_free(ptr); }
+void operator delete[] (void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { counted_aligned_free(ptr); }
+#endif
+
+// ----------------------------------------------------------------------------------------
+
@@ -0,0 +1,97 @@
+//[TIF] Counting of the heap allocations made by the TIF benchmark tools.
+//
+//  alloc_counter.cpp replaces the global operator new and operator delete, in all their
+//  forms, with ones that count the calls.  Link it into the program and include this
+//  header where the counts are read.  The counters are atomic, so no allocation is lost
+//  when several threads allocate at once, but they are global: count_allocations() also
+//  counts what other threads allocate while f() runs.
+
+#ifndef TIF_ALLOC_COUNTER_H_
+#define TIF_ALLOC_COUNTER_H_
+
+#if __cplusplus >= 201103L
+#include <atomic>
+#endif
+
+// ----------------------------------------------------------------------------------------
+
+struct alloc_counts
+{
+    alloc_counts() : allocations(0), bytes(0), deallocations(0) {}
+
+    unsigned long long allocations;
+    unsigned long long bytes;
+    unsigned long long deallocations;
+
+    alloc_counts operator- (
+        const alloc_counts& rhs
+    ) const
+    {
+        alloc_counts diff;
+        diff.allocations = allocations - rhs.allocations;
+        diff.bytes = bytes - rhs.bytes;
+        diff.deallocations = deallocations - rhs.deallocations;
+        return diff;
+    }
+};
+
+namespace alloc_counter_impl
+{
+#if __cplusplus >= 201103L
+    typedef std::atomic<unsigned long long> counter;
+
+    inline void add (counter& c, unsigned long long n) { c.fetch_add(n, std::memory_order_relaxed); }
+    inline unsigned long long get (const counter& c) { return c.load(std::memory_order_relaxed); }
+#else
+    typedef unsigned long long counter;
+
+    inline void add (counter& c, unsigned long long n) { __sync_fetch_and_add(&c, n); }
+    inline unsigned long long get (counter& c) { return __sync_fetch_and_add(&c, 0ULL); }
+#endif
+
+    struct counters
+    {
+        counter allocations;
+        counter bytes;
+        counter deallocations;
+    };
+
+    // defined in alloc_counter.cpp
+    counters& global_counters (
+    );
+}
+
+inline alloc_counts global_alloc_counts (
+)
+/*!
+    ensures
+        - returns the number of calls to operator new, the bytes they asked for, and
+          the number of calls to operator delete since the program started.
+!*/
+{
+    alloc_counter_impl::counters& c = alloc_counter_impl::global_counters();
+    alloc_counts counts;
+    counts.allocations = alloc_counter_impl::get(c.allocations);
+    counts.bytes = alloc_counter_impl::get(c.bytes);
+    counts.deallocations = alloc_counter_impl::get(c.deallocations);
+    return counts;
+}
+
+template <typename function_type>
+alloc_counts count_allocations (
+    function_type& f
+)
+/*!
+    ensures
+        - calls f() and returns the allocations and deallocations it made.
+!*/
+{
+    const alloc_counts before = global_alloc_counts();
+    f();
+    return global_alloc_counts() - before;
+}
+
+// ----------------------------------------------------------------------------------------
+
+#endif // TIF_ALLOC_COUNTER_H_
+
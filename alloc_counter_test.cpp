@@ -0,0 +1,204 @@
+//[TIF] Test of alloc_counter.h and alloc_counter.cpp.
+//
+//  Checks that count_allocations() gives the known number of allocations, bytes and
+//  deallocations of some simple calls, including the nothrow, sized and aligned forms of
+//  operator new and delete, and that no allocation is lost when several threads
+//  allocate at once.  Prints the failed checks and exits with 1 if there are any.
+
+#include <dlib/threads.h>
+#include <iostream>
+#include <vector>
+#include "alloc_counter.h"
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+// the allocations go through here so the compiler can't leave out a new and delete pair.
+void* volatile sink = 0;
+
+struct new_int
+{
+    void operator() ()
+    {
+        int* ptr = new int(3);
+        sink = ptr;
+        delete ptr;
+    }
+};
+
+struct new_int_array
+{
+    void operator() ()
+    {
+        int* ptr = new int[10];
+        sink = ptr;
+        delete [] ptr;
+    }
+};
+
+struct sized_delete
+{
+    void operator() ()
+    {
+        void* ptr = ::operator new(24);
+        sink = ptr;
+#if __cplusplus >= 201402L
+        ::operator delete(ptr, 24);
+#else
+        ::operator delete(ptr);
+#endif
+    }
+};
+
+struct nothrow_new
+{
+    void operator() ()
+    {
+        double* ptr = new (std::nothrow) double[4];
+        sink = ptr;
+        delete [] ptr;
+    }
+};
+
+#ifdef __cpp_aligned_new
+struct alignas(64) cache_line
+{
+    char bytes[64];
+};
+
+struct aligned_new
+{
+    void operator() ()
+    {
+        cache_line* ptr = new cache_line;
+        sink = ptr;
+        if (reinterpret_cast<std::size_t>(ptr)%64 != 0)
+            misaligned = true;
+        delete ptr;
+        cache_line* arr = new cache_line[3];
+        sink = arr;
+        if (reinterpret_cast<std::size_t>(arr)%64 != 0)
+            misaligned = true;
+        delete [] arr;
+    }
+
+    aligned_new() : misaligned(false) {}
+    bool misaligned;
+};
+#endif
+
+struct reserve_vector
+{
+    void operator() ()
+    {
+        std::vector<double> v;
+        v.reserve(100);
+        std::vector<double> w(v);
+    }
+};
+
+struct nothing
+{
+    void operator() () {}
+};
+
+struct allocate_in_threads
+{
+    allocate_in_threads (
+        thread_pool& tp_,
+        long num_tasks_,
+        long allocations_per_task_
+    ) : tp(tp_), num_tasks(num_tasks_), allocations_per_task(allocations_per_task_) {}
+
+    void operator() ()
+    {
+        parallel_for(tp, 0, num_tasks, *this);
+    }
+
+    void operator() (long) const
+    {
+        for (long i = 0; i < allocations_per_task; ++i)
+        {
+            char* ptr = new char;
+            sink = ptr;
+            delete ptr;
+        }
+    }
+
+    thread_pool& tp;
+    long num_tasks;
+    long allocations_per_task;
+};
+
+// ----------------------------------------------------------------------------------------
+
+unsigned long failures = 0;
+
+void check (
+    const char* name,
+    const alloc_counts& used,
+    unsigned long long allocations,
+    unsigned long long bytes,
+    unsigned long long deallocations
+)
+{
+    if (used.allocations == allocations && used.bytes == bytes && used.deallocations == deallocations)
+        return;
+    cout << "FAIL: " << name << " made " << used.allocations << " allocations of " << used.bytes << " bytes and "
+         << used.deallocations << " deallocations, expected " << allocations << ", " << bytes << " and "
+         << deallocations << endl;
+    ++failures;
+}
+
+// ----------------------------------------------------------------------------------------
+
+int main()
+{
+    nothing none;
+    check("nothing", count_allocations(none), 0, 0, 0);
+    new_int one;
+    check("new int", count_allocations(one), 1, sizeof(int), 1);
+    new_int_array array;
+    check("new int[10]", count_allocations(array), 1, 10*sizeof(int), 1);
+    sized_delete sized;
+    check("sized delete", count_allocations(sized), 1, 24, 1);
+    nothrow_new nothrow;
+    check("new (std::nothrow) double[4]", count_allocations(nothrow), 1, 4*sizeof(double), 1);
+#ifdef __cpp_aligned_new
+    aligned_new aligned;
+    check("aligned new", count_allocations(aligned), 2, 4*sizeof(cache_line), 2);
+    if (aligned.misaligned)
+    {
+        cout << "FAIL: aligned new returned a pointer that isn't 64 byte aligned" << endl;
+        ++failures;
+    }
+#endif
+    reserve_vector vec;
+    check("std::vector", count_allocations(vec), 1, 100*sizeof(double), 1);
+
+    // parallel_for allocates a little itself, but every one of the tasks' allocations
+    // must be counted, which isn't the case when increments of the counters are lost.
+    thread_pool tp(4);
+    const long num_tasks = 8;
+    const long allocations_per_task = 100000;
+    allocate_in_threads threaded(tp, num_tasks, allocations_per_task);
+    const alloc_counts used = count_allocations(threaded);
+    const unsigned long long expected = num_tasks*allocations_per_task;
+    if (used.allocations < expected || used.allocations > expected + 1000 ||
+        used.deallocations < expected || used.deallocations > expected + 1000)
+    {
+        cout << "FAIL: " << num_tasks << " threads making " << allocations_per_task << " allocations each were counted as "
+             << used.allocations << " allocations and " << used.deallocations << " deallocations" << endl;
+        ++failures;
+    }
+
+    if (failures != 0)
+        return 1;
+    cout << "All alloc_counter checks passed" << endl;
+    return 0;
+}
+
+// ----------------------------------------------------------------------------------------
+
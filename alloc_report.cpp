@@ -0,0 +1,270 @@
+//[TIF] Heap allocations of the detect and align hot path.
+//
+//  Counts the calls to operator new, the bytes they ask for and the calls to operator
+//  delete made by each call of frontal_face_detector::operator() and
+//  shape_predictor::operator() on a set of images, both on the first, cold, pass and
+//  on the passes after --warmup.  The detector is called with a reused
+//  std::vector<rect_detection>, so only its own allocations are counted.  It is counted
+//  a second time through the const interface with a reused detection_workspace, the
+//  way worker threads that share one detector call it.  The faces are
+//  the boxes of an imagelist.txt, or the detections for a directory of images.
+//
+//  --max-detector-allocations and --max-shape-predictor-allocations make it fail,
+//  with exit status 1, if any call after the warm up allocates more than that, e.g.
+//  --max-shape-predictor-allocations 0 asserts that alignment doesn't touch the heap
+//  once warm.  The detector limit holds for both ways of calling the detector.
+
+#include <dlib/image_processing.h>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/cmd_line_parser.h>
+#include <iostream>
+#include <iomanip>
+#include "latency_stats.h"
+#include "pipeline.h"
+#include "alloc_counter.h"
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+struct call_detector
+{
+    call_detector (
+        frontal_face_detector& detector_,
+        const array2d<unsigned char>& img_,
+        std::vector<rect_detection>& dets_
+    ) : detector(detector_), img(img_), dets(dets_) {}
+
+    void operator() () { detector(img, dets); }
+
+    frontal_face_detector& detector;
+    const array2d<unsigned char>& img;
+    std::vector<rect_detection>& dets;
+};
+
+struct call_detector_with_workspace
+{
+    call_detector_with_workspace (
+        const frontal_face_detector& detector_,
+        frontal_face_detector::workspace_type& workspace_,
+        const array2d<unsigned char>& img_,
+        std::vector<rect_detection>& dets_
+    ) : detector(detector_), workspace(workspace_), img(img_), dets(dets_) {}
+
+    void operator() () { detector(img, workspace, dets); }
+
+    const frontal_face_detector& detector;
+    frontal_face_detector::workspace_type& workspace;
+    const array2d<unsigned char>& img;
+    std::vector<rect_detection>& dets;
+};
+
+struct call_shape_predictor
+{
+    call_shape_predictor (
+        const shape_predictor& sp_,
+        const array2d<unsigned char>& img_,
+        const rectangle& rect_,
+        full_object_detection& shape_
+    ) : sp(sp_), img(img_), rect(rect_), shape(shape_) {}
+
+    void operator() () { shape = sp(img, rect); }
+
+    const shape_predictor& sp;
+    const array2d<unsigned char>& img;
+    const rectangle& rect;
+    full_object_detection& shape;
+};
+
+struct call_stats
+{
+    call_stats() : cold_allocations(0), cold_bytes(0), max_warm_allocations(0) {}
+
+    unsigned long long cold_allocations;
+    unsigned long long cold_bytes;
+    std::vector<double> warm_allocations;
+    std::vector<double> warm_bytes;
+    std::vector<double> warm_net;   // allocations that were not freed by the call
+    unsigned long long max_warm_allocations;
+
+    void add (
+        const alloc_counts& used,
+        bool warm
+    )
+    {
+        if (!warm)
+        {
+            cold_allocations += used.allocations;
+            cold_bytes += used.bytes;
+            return;
+        }
+        warm_allocations.push_back(used.allocations);
+        warm_bytes.push_back(used.bytes);
+        warm_net.push_back((double)used.allocations - (double)used.deallocations);
+        max_warm_allocations = std::max(max_warm_allocations, used.allocations);
+    }
+
+    void print (
+        const std::string& name,
+        unsigned long cold_calls
+    ) const
+    {
+        cout << left << setw(24) << name << right << setw(8) << warm_allocations.size();
+        if (cold_calls != 0)
+            cout << setw(14) << (double)cold_allocations/cold_calls << setw(14) << (double)cold_bytes/cold_calls;
+        else
+            cout << setw(14) << "-" << setw(14) << "-";
+        if (warm_allocations.size() != 0)
+        {
+            cout << setw(12) << impl::percentile(warm_allocations, 0.5) << setw(12) << max_warm_allocations
+                 << setw(14) << impl::percentile(warm_bytes, 0.5)
+                 << setw(12) << *std::max_element(warm_net.begin(), warm_net.end());
+        }
+        cout << endl;
+    }
+};
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        command_line_parser parser;
+        parser.add_option("model", "Also count the allocations of this shape_predictor.", 1);
+        parser.add_option("warmup", "Passes over the images before the warm calls (default 1).", 1);
+        parser.add_option("iterations", "Passes over the images that are counted as warm (default 1).", 1);
+        parser.add_option("per-call", "Print the allocations of every warm call.");
+        parser.add_option("max-detector-allocations", "Fail if a warm detector call, with or without a workspace, allocates more than this.", 1);
+        parser.add_option("max-shape-predictor-allocations", "Fail if a warm shape_predictor call allocates more than this.", 1);
+        parser.add_option("h", "Display this help message.");
+        parser.parse(argc, argv);
+
+        if (parser.option("h") || parser.number_of_arguments() != 1)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_alloc_report images/|imagelist.txt [options]" << endl;
+            parser.print_options();
+            return 0;
+        }
+
+        const unsigned long warmup = get_option(parser, "warmup", 1);
+        const unsigned long iterations = get_option(parser, "iterations", 1);
+
+        shape_predictor sp;
+        if (parser.option("model"))
+            deserialize(parser.option("model").argument()) >> sp;
+
+        std::vector<std::string> names;
+        std::vector<std::vector<full_object_detection> > objects;
+        dlib::array<array2d<rgb_pixel> > frames;
+        std::vector<double> video_decode_us;
+        load_pipeline_input(parser[0], 300, names, objects, frames, video_decode_us);
+        dlib::array<array2d<unsigned char> > images;
+        if (frames.size() != 0)
+        {
+            images.resize(frames.size());
+            for (unsigned long i = 0; i < frames.size(); ++i)
+                assign_image(images[i], frames[i]);
+        }
+        else
+        {
+            load_imagelist_images(names, images);
+        }
+
+        frontal_face_detector detector = get_frontal_face_detector();
+        frontal_face_detector::workspace_type workspace;
+        std::vector<rect_detection> dets, workspace_dets;
+        full_object_detection shape;
+        call_stats detector_stats, workspace_stats, sp_stats;
+        unsigned long cold_sp_calls = 0;
+        for (unsigned long pass = 0; pass < 1 + warmup + iterations; ++pass)
+        {
+            // pass 0 is cold, the next warmup passes aren't counted and the rest are warm.
+            const bool counted = pass == 0 || pass > warmup;
+            const bool warm = pass > warmup;
+            for (unsigned long i = 0; i < images.size(); ++i)
+            {
+                call_detector detect(detector, images[i], dets);
+                const alloc_counts used = count_allocations(detect);
+                if (counted)
+                    detector_stats.add(used, warm);
+                if (warm && parser.option("per-call"))
+                    cout << "frontal_face_detector " << i << ": " << used.allocations << " allocations, "
+                         << used.bytes << " bytes, " << used.deallocations << " deallocations" << endl;
+
+                call_detector_with_workspace detect_ws(detector, workspace, images[i], workspace_dets);
+                const alloc_counts used_ws = count_allocations(detect_ws);
+                if (counted)
+                    workspace_stats.add(used_ws, warm);
+                if (warm && parser.option("per-call"))
+                    cout << "detector_workspace " << i << ": " << used_ws.allocations << " allocations, "
+                         << used_ws.bytes << " bytes, " << used_ws.deallocations << " deallocations" << endl;
+
+                if (!parser.option("model"))
+                    continue;
+                std::vector<rectangle> faces;
+                if (objects.size() != 0)
+                    for (unsigned long j = 0; j < objects[i].size(); ++j)
+                        faces.push_back(objects[i][j].get_rect());
+                else
+                    for (unsigned long j = 0; j < dets.size(); ++j)
+                        faces.push_back(dets[j].rect);
+                for (unsigned long j = 0; j < faces.size(); ++j)
+                {
+                    call_shape_predictor align(sp, images[i], faces[j], shape);
+                    const alloc_counts used = count_allocations(align);
+                    if (counted)
+                        sp_stats.add(used, warm);
+                    if (pass == 0)
+                        ++cold_sp_calls;
+                    if (warm && parser.option("per-call"))
+                        cout << "shape_predictor " << i << "." << j << ": " << used.allocations << " allocations, "
+                             << used.bytes << " bytes, " << used.deallocations << " deallocations" << endl;
+                }
+            }
+        }
+
+        cout << fixed << setprecision(1);
+        cout << left << setw(24) << "call" << right << setw(8) << "calls" << setw(14) << "cold_allocs" << setw(14) << "cold_bytes"
+             << setw(12) << "allocs_p50" << setw(12) << "allocs_max" << setw(14) << "bytes_p50" << setw(12) << "net_max" << endl;
+        detector_stats.print("frontal_face_detector", images.size());
+        workspace_stats.print("detector_workspace", images.size());
+        if (parser.option("model"))
+            sp_stats.print("shape_predictor", cold_sp_calls);
+
+        bool failed = false;
+        if (parser.option("max-detector-allocations") &&
+            detector_stats.max_warm_allocations > get_option(parser, "max-detector-allocations", 0ULL))
+        {
+            cout << "FAIL: a warm frontal_face_detector call made " << detector_stats.max_warm_allocations
+                 << " allocations, more than " << parser.option("max-detector-allocations").argument() << endl;
+            failed = true;
+        }
+        if (parser.option("max-detector-allocations") &&
+            workspace_stats.max_warm_allocations > get_option(parser, "max-detector-allocations", 0ULL))
+        {
+            cout << "FAIL: a warm detector_workspace call made " << workspace_stats.max_warm_allocations
+                 << " allocations, more than " << parser.option("max-detector-allocations").argument() << endl;
+            failed = true;
+        }
+        if (parser.option("model") && parser.option("max-shape-predictor-allocations") &&
+            sp_stats.max_warm_allocations > get_option(parser, "max-shape-predictor-allocations", 0ULL))
+        {
+            cout << "FAIL: a warm shape_predictor call made " << sp_stats.max_warm_allocations
+                 << " allocations, more than " << parser.option("max-shape-predictor-allocations").argument() << endl;
+            failed = true;
+        }
+        return failed ? 1 : 0;
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
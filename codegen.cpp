@@ -0,0 +1,341 @@
+//[TIF] Exports a trained shape_predictor as specialized C++ source.
+//
+//  The generated file holds the whole model as code and constant data: every feature
+//  of a cascade level becomes one call with its triplet anchors and ratios as
+//  literals, every tree becomes nested comparisons with constant feature indices and
+//  thresholds, and the leaves become constant arrays.  The compiler can then fold the
+//  constants and schedule the loads, where shape_predictor has to walk its data.
+//
+//  The result is self-contained apart from the dlib headers for the image and
+//  geometry types.  It defines one class with the same operator()(img, rect) (and
+//  operator()(img, rect, component)) as shape_predictor, which gives exactly the same
+//  landmarks; make -f Makefile_codegen check builds the generated code with
+//  codegen_check.cpp and verifies that on an image list.  Since operator() is a
+//  template over the image type the file is meant to be #included by the one
+//  translation unit of your program that uses the model.
+
+#include <dlib/image_processing.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+std::string float_literal (
+    float val
+)
+{
+    char buf[32];
+    sprintf(buf, "%.9g", val);
+    std::string s = buf;
+    if (s.find_first_of(".e") == std::string::npos)
+        s += ".0";
+    return s + "f";
+}
+
+std::string double_literal (
+    double val
+)
+{
+    char buf[32];
+    sprintf(buf, "%.17g", val);
+    std::string s = buf;
+    if (s.find_first_of(".e") == std::string::npos)
+        s += ".0";
+    return s;
+}
+
+void write_floats (
+    ostream& out,
+    const matrix<float,0,1>& vals
+)
+{
+    out << "{";
+    for (long i = 0; i < vals.size(); ++i)
+        out << (i == 0 ? "" : ",") << float_literal(vals(i));
+    out << "}";
+}
+
+// ----------------------------------------------------------------------------------------
+
+void write_tree (
+    ostream& out,
+    const impl::regression_tree& tree,
+    const std::string& leaves,
+    unsigned long node,
+    const std::string& indent
+)
+/*!
+    ensures
+        - writes the subtree of tree rooted at node as nested if statements that add
+          the leaf they end in, leaves[leaf index], to the shape sum.
+!*/
+{
+    if (node >= tree.splits.size())
+    {
+        out << indent << "add(sum, " << leaves << "[" << node - tree.splits.size() << "], dims);\n";
+        return;
+    }
+    const impl::split_feature& split = tree.splits[node];
+    out << indent << "if (f[" << split.idx1 << "] - f[" << split.idx2 << "] > " << float_literal(split.thresh) << ")\n";
+    out << indent << "{\n";
+    write_tree(out, tree, leaves, impl::left_child(node), indent + "    ");
+    out << indent << "}\n" << indent << "else\n" << indent << "{\n";
+    write_tree(out, tree, leaves, impl::right_child(node), indent + "    ");
+    out << indent << "}\n";
+}
+
+void write_cascade (
+    ostream& out,
+    const shape_predictor& sp,
+    unsigned long level
+)
+{
+    const std::vector<impl::regression_tree>& forest = sp.get_forests()[level];
+    impl::index_feature index = sp.get_index()[level];
+    const bool low_rank = sp.get_leaf_bases().size() != 0 && sp.get_leaf_bases()[level].size() != 0;
+    const long dims = sp.get_initial_shape().size();
+    const long leaf_dims = forest.size() != 0 ? forest[0].leaf_values[0].size() : dims;
+
+    out << "    // cascade level " << level << "\n";
+    if (forest.size() != 0)
+    {
+        out << "    static const float leaves_" << level << "[" << forest.size() << "]["
+            << forest[0].leaf_values.size() << "][" << leaf_dims << "] = {\n";
+        for (unsigned long t = 0; t < forest.size(); ++t)
+        {
+            out << "        {\n";
+            for (unsigned long l = 0; l < forest[t].leaf_values.size(); ++l)
+            {
+                out << "            ";
+                write_floats(out, forest[t].leaf_values[l]);
+                out << (l+1 < forest[t].leaf_values.size() ? ",\n" : "\n");
+            }
+            out << "        }" << (t+1 < forest.size() ? ",\n" : "\n");
+        }
+        out << "    };\n";
+    }
+    if (low_rank)
+    {
+        const matrix<float>& basis = sp.get_leaf_bases()[level];
+        out << "    static const float basis_" << level << "[" << basis.nr() << "][" << basis.nc() << "] = {\n";
+        for (long r = 0; r < basis.nr(); ++r)
+        {
+            out << "        ";
+            write_floats(out, trans(rowm(basis, r)));
+            out << (r+1 < basis.nr() ? ",\n" : "\n");
+        }
+        out << "    };\n";
+    }
+
+    out << "\n    template <typename image_type>\n"
+        << "    void cascade_" << level << " (\n"
+        << "        const image_type& img,\n"
+        << "        const dlib::point_transform_affine& tform_to_img,\n"
+        << "        float* shape\n"
+        << "    )\n"
+        << "    {\n"
+        << "        const dlib::const_image_view<image_type> view(img);\n"
+        << "        const dlib::rectangle area = dlib::get_rect(img);\n"
+        << "        const float* s = shape;\n"
+        << "        float f[" << std::max<unsigned long>(index.get_num_of_anchors(), 1) << "];\n";
+    for (unsigned long i = 0; i < index.get_num_of_anchors(); ++i)
+    {
+        const std::vector<unsigned long> anchor = index.anchor(i);
+        const std::vector<double> ratio = index.ratio(i);
+        out << "        f[" << i << "] = feature(view, area, tform_to_img, s[" << 2*anchor[0] << "], s[" << 2*anchor[0]+1 << "], s["
+            << 2*anchor[1] << "], s[" << 2*anchor[1]+1 << "], s[" << 2*anchor[2] << "], s[" << 2*anchor[2]+1 << "], "
+            << double_literal(ratio[0]) << ", " << double_literal(ratio[1]) << ");\n";
+    }
+
+    if (low_rank)
+        out << "        const unsigned long dims = " << leaf_dims << ";\n"
+            << "        float sum[dims] = {0};\n";
+    else
+        out << "        const unsigned long dims = " << dims << ";\n"
+            << "        float* sum = shape;\n";
+    for (unsigned long t = 0; t < forest.size(); ++t)
+    {
+        std::ostringstream leaves;
+        leaves << "leaves_" << level << "[" << t << "]";
+        out << "        // tree " << t << "\n";
+        write_tree(out, forest[t], leaves.str(), 0, "        ");
+    }
+    if (low_rank)
+    {
+        // the same order of operations as shape_predictor's basis*coefficients
+        out << "        for (unsigned long r = 0; r < " << dims << "; ++r)\n"
+            << "        {\n"
+            << "            float acc = basis_" << level << "[r][0]*sum[0];\n"
+            << "            for (unsigned long c = 1; c < dims; ++c)\n"
+            << "                acc += basis_" << level << "[r][c]*sum[c];\n"
+            << "            shape[r] += acc;\n"
+            << "        }\n";
+    }
+    out << "    }\n\n";
+}
+
+// ----------------------------------------------------------------------------------------
+
+void write_predictor (
+    ostream& out,
+    const shape_predictor& sp,
+    const std::string& name,
+    const std::string& model_file
+)
+{
+    const long dims = sp.get_initial_shape().size();
+    const std::vector<matrix<float,0,1> >& components = sp.get_component_initial_shapes();
+    std::string guard = name;
+    for (unsigned long i = 0; i < guard.size(); ++i)
+        guard[i] = toupper(guard[i]);
+
+    out << "// Generated by TIF_codegen from " << model_file << ".  Do not edit.\n"
+        << "//   parts: " << dims/2 << ", cascade levels: " << sp.get_forests().size() << "\n"
+        << "// It predicts exactly what dlib::shape_predictor does with that model.\n\n"
+        << "#ifndef " << guard << "_H_\n"
+        << "#define " << guard << "_H_\n\n"
+        << "#include <dlib/geometry.h>\n"
+        << "#include <dlib/pixel.h>\n"
+        << "#include <dlib/image_processing/generic_image.h>\n"
+        << "#include <dlib/image_processing/full_object_detection.h>\n"
+        << "#include <vector>\n\n"
+        << "namespace " << name << "_impl\n{\n";
+
+    out << "    static const float initial_shape[" << dims << "] = ";
+    write_floats(out, sp.get_initial_shape());
+    out << ";\n";
+    if (components.size() != 0)
+    {
+        out << "    static const float component_shapes[" << components.size() << "][" << dims << "] = {\n";
+        for (unsigned long c = 0; c < components.size(); ++c)
+        {
+            out << "        ";
+            // components without objects use the initial shape
+            write_floats(out, components[c].size() != 0 ? components[c] : sp.get_initial_shape());
+            out << (c+1 < components.size() ? ",\n" : "\n");
+        }
+        out << "    };\n";
+    }
+
+    out << "\n"
+        << "    inline dlib::point_transform_affine unnormalizing_tform (\n"
+        << "        const dlib::rectangle& rect\n"
+        << "    )\n"
+        << "    {\n"
+        << "        std::vector<dlib::vector<float,2> > from_points, to_points;\n"
+        << "        to_points.push_back(rect.tl_corner()); from_points.push_back(dlib::point(0,0));\n"
+        << "        to_points.push_back(rect.tr_corner()); from_points.push_back(dlib::point(1,0));\n"
+        << "        to_points.push_back(rect.br_corner()); from_points.push_back(dlib::point(1,1));\n"
+        << "        return dlib::find_affine_transform(from_points, to_points);\n"
+        << "    }\n\n"
+        << "    template <typename view_type>\n"
+        << "    inline float feature (\n"
+        << "        const view_type& view,\n"
+        << "        const dlib::rectangle& area,\n"
+        << "        const dlib::point_transform_affine& tform_to_img,\n"
+        << "        float x0, float y0, float x1, float y1, float x2, float y2,\n"
+        << "        double a, double b\n"
+        << "    )\n"
+        << "    {\n"
+        << "        const dlib::vector<float,2> q(a*(x1-x0) + b*(x2-x0) + x0, a*(y1-y0) + b*(y2-y0) + y0);\n"
+        << "        const dlib::point p = tform_to_img(q);\n"
+        << "        if (area.contains(p))\n"
+        << "            return dlib::get_pixel_intensity(view[p.y()][p.x()]);\n"
+        << "        return 0;\n"
+        << "    }\n\n"
+        << "    inline void add (\n"
+        << "        float* sum,\n"
+        << "        const float* leaf,\n"
+        << "        unsigned long dims\n"
+        << "    )\n"
+        << "    {\n"
+        << "        for (unsigned long k = 0; k < dims; ++k)\n"
+        << "            sum[k] += leaf[k];\n"
+        << "    }\n\n";
+
+    for (unsigned long level = 0; level < sp.get_forests().size(); ++level)
+        write_cascade(out, sp, level);
+    out << "}\n\n";
+
+    out << "class " << name << "\n"
+        << "{\n"
+        << "public:\n"
+        << "    unsigned long num_parts (\n"
+        << "    ) const { return " << dims/2 << "; }\n\n"
+        << "    template <typename image_type>\n"
+        << "    dlib::full_object_detection operator() (\n"
+        << "        const image_type& img,\n"
+        << "        const dlib::rectangle& rect\n"
+        << "    ) const\n"
+        << "    {\n"
+        << "        return (*this)(img, rect, " << components.size() << ");\n"
+        << "    }\n\n"
+        << "    template <typename image_type>\n"
+        << "    dlib::full_object_detection operator() (\n"
+        << "        const image_type& img,\n"
+        << "        const dlib::rectangle& rect,\n"
+        << "        unsigned long component\n"
+        << "    ) const\n"
+        << "    {\n"
+        << "        using namespace " << name << "_impl;\n"
+        << "        const dlib::point_transform_affine tform_to_img = unnormalizing_tform(rect);\n"
+        << "        float shape[" << dims << "];\n";
+    if (components.size() != 0)
+        out << "        const float* start = component < " << components.size() << " ? component_shapes[component] : initial_shape;\n";
+    else
+        out << "        const float* start = initial_shape;\n";
+    out << "        for (unsigned long k = 0; k < " << dims << "; ++k)\n"
+        << "            shape[k] = start[k];\n";
+    for (unsigned long level = 0; level < sp.get_forests().size(); ++level)
+        out << "        cascade_" << level << "(img, tform_to_img, shape);\n";
+    out << "\n"
+        << "        std::vector<dlib::point> parts(" << dims/2 << ");\n"
+        << "        for (unsigned long i = 0; i < parts.size(); ++i)\n"
+        << "            parts[i] = tform_to_img(dlib::vector<float,2>(shape[2*i], shape[2*i+1]));\n"
+        << "        return dlib::full_object_detection(rect, parts);\n"
+        << "    }\n"
+        << "};\n\n"
+        << "#endif // " << guard << "_H_\n\n";
+}
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        if (argc < 3)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_codegen model.dat generated_predictor.h [class_name]" << endl;
+            cout << "class_name defaults to generated_shape_predictor." << endl;
+            return 0;
+        }
+
+        shape_predictor sp;
+        deserialize(argv[1]) >> sp;
+        const std::string name = argc > 3 ? argv[3] : "generated_shape_predictor";
+
+        ofstream fout(argv[2]);
+        if (!fout)
+            throw error(std::string("Unable to open ") + argv[2]);
+        write_predictor(fout, sp, name, argv[1]);
+        fout.close();
+        if (!fout)
+            throw error(std::string("Unable to write ") + argv[2]);
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
@@ -0,0 +1,110 @@
+//[TIF] Check of the code written by TIF_codegen.
+//
+//  Built together with a generated file (see the check target of Makefile_codegen),
+//  it runs the generated class and shape_predictor::operator() of the model it was
+//  generated from on the faces of an image list, and on boxes that stick out of the
+//  images, with every initial shape of the model.  It prints the faces where a landmark
+//  differs and exits with 1 if there are any, so a change to codegen.cpp that breaks
+//  "exactly the same landmarks" is caught by running it.
+//
+//  TIF_GENERATED_HEADER and TIF_GENERATED_CLASS name the generated file and class.
+
+#include <dlib/image_processing.h>
+#include <iostream>
+#include "imagelist.h"
+
+#ifndef TIF_GENERATED_HEADER
+#error "Build with -DTIF_GENERATED_HEADER=\"file.h\" -DTIF_GENERATED_CLASS=class_name, see Makefile_codegen"
+#endif
+#include TIF_GENERATED_HEADER
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+bool same_shape (
+    const full_object_detection& a,
+    const full_object_detection& b
+)
+{
+    if (a.get_rect() != b.get_rect() || a.num_parts() != b.num_parts())
+        return false;
+    for (unsigned long i = 0; i < a.num_parts(); ++i)
+    {
+        if (a.part(i) != b.part(i))
+            return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        if (argc < 3)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_codegen_check model.dat imagelist.txt" << endl;
+            cout << "model.dat must be the model the built in generated file was made from." << endl;
+            return 0;
+        }
+
+        shape_predictor sp;
+        deserialize(argv[1]) >> sp;
+        const TIF_GENERATED_CLASS generated;
+        if ((long)generated.num_parts() != sp.get_initial_shape().size()/2)
+            throw error("The generated file wasn't made from " + std::string(argv[1]));
+
+        std::vector<std::string> names;
+        std::vector<std::vector<full_object_detection> > objects;
+        dlib::array<array2d<unsigned char> > images;
+        load_imagelist(argv[2], names, objects);
+        load_imagelist_images(names, images);
+
+        // component num_components is the initial shape of the model.
+        const unsigned long num_components = sp.get_component_initial_shapes().size();
+        unsigned long checked = 0, mismatches = 0;
+        for (unsigned long i = 0; i < images.size(); ++i)
+        {
+            std::vector<rectangle> boxes;
+            for (unsigned long j = 0; j < objects[i].size(); ++j)
+                boxes.push_back(objects[i][j].get_rect());
+            const long side = std::max<long>(std::min(images[i].nr(), images[i].nc())/2, 1);
+            boxes.push_back(centered_rect(point(0,0), side, side));
+            boxes.push_back(centered_rect(point(images[i].nc(), images[i].nr()), side, side));
+
+            for (unsigned long j = 0; j < boxes.size(); ++j)
+            {
+                for (unsigned long c = 0; c <= num_components; ++c)
+                {
+                    ++checked;
+                    if (same_shape(generated(images[i], boxes[j], c), sp(images[i], boxes[j], c)))
+                        continue;
+                    ++mismatches;
+                    cout << "MISMATCH: " << names[i] << " box " << boxes[j] << " component " << c << endl;
+                }
+                ++checked;
+                if (!same_shape(generated(images[i], boxes[j]), sp(images[i], boxes[j])))
+                {
+                    ++mismatches;
+                    cout << "MISMATCH: " << names[i] << " box " << boxes[j] << endl;
+                }
+            }
+        }
+
+        cout << checked << " predictions checked, " << mismatches << " differ" << endl;
+        return mismatches == 0 ? 0 : 1;
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
@@ -64,6 +64,64 @@ namespace dlib
         feature_vector_type w;
     };
 
+// ----------------------------------------------------------------------------------------
+
+    template <typename image_scanner_type>
+    class detection_workspace
+    {
+        /*!
+            WHAT THIS OBJECT REPRESENTS
+                The memory an object_detector needs while it looks at one image, e.g. the
+                feature pyramid.  The const object_detector::operator()s take it from the
+                caller, so that one object_detector can be used by many threads at once,
+                each with its own workspace, and so that a thread can reuse its workspace
+                across images instead of allocating it again.  
+
+                Like processed_weight_vector, an image scanner can overload this template.
+                scan_fhog_pyramid does so to keep just its HOG pyramid and filter outputs
+                here.  This generic version holds a copy of the detector's scanner.
+        !*/
+    public:
+
+        template <typename image_type>
+        void load (
+            const image_scanner_type& config,
+            const image_type& img
+        )
+        /*!
+            ensures
+                - computes, into this workspace, the features config would compute for
+                  img in config.load(img).  config is not modified.
+        !*/
+        {
+            scanner.copy_configuration(config);
+            scanner.load(img);
+        }
+
+        std::vector<rect_detection>& detect (
+            const std::vector<processed_weight_vector<image_scanner_type> >& w,
+            const double adjust_threshold
+        )
+        /*!
+            requires
+                - load() has been called.
+            ensures
+                - returns the detections of all the weight vectors in w on the last image
+                  given to load(), as detect_with_weight_vectors() gives them.  The
+                  returned vector lives in this workspace and is overwritten by the next
+                  call.
+        !*/
+        {
+            dets_accum.clear();
+            detect_with_weight_vectors(scanner, w, adjust_threshold, dets_accum);
+            return dets_accum;
+        }
+
+    private:
+        image_scanner_type scanner;
+        std::vector<rect_detection> dets_accum;
+    };
+
 // ----------------------------------------------------------------------------------------
 
     template <
@@ -177,6 +235,33 @@ namespace dlib
             double adjust_threshold = 0
         );
 
+        typedef detection_workspace<image_scanner_type> workspace_type;
+
+        template <
+            typename image_type
+            >
+        void operator() (
+            const image_type& img,
+            workspace_type& workspace,
+            std::vector<rect_detection>& final_dets,
+            double adjust_threshold = 0
+        ) const;
+
+        template <
+            typename image_type
+            >
+        std::vector<rectangle> operator() (
+            const image_type& img,
+            workspace_type& workspace,
+            double adjust_threshold = 0
+        ) const;
+
+        void operator() (
+            workspace_type& workspace,
+            std::vector<rect_detection>& final_dets,
+            double adjust_threshold = 0
+        ) const;
+
         template <typename T>
         friend void serialize (
             const object_detector<T>& item,
@@ -191,6 +276,28 @@ namespace dlib
 
     private:
 
+        void suppress_overlaps (
+            std::vector<rect_detection>& dets_accum,
+            std::vector<rect_detection>& final_dets
+        ) const
+        /*!
+            ensures
+                - #final_dets == the detections in dets_accum, best first, that don't
+                  overlap a better one.
+        !*/
+        {
+            final_dets.clear();
+            if (w.size() > 1)
+                std::sort(dets_accum.rbegin(), dets_accum.rend());
+            for (unsigned long i = 0; i < dets_accum.size(); ++i)
+            {
+                if (overlaps_any_box(final_dets, dets_accum[i].rect))
+                    continue;
+
+                final_dets.push_back(dets_accum[i]);
+            }
+        }
+
         bool overlaps_any_box (
             const std::vector<rect_detection>& rects,
             const dlib::rectangle& rect
@@ -422,19 +529,26 @@ namespace dlib
     template <
         typename image_scanner_type
         >
-    template <
-        typename image_type
-        >
-    void object_detector<image_scanner_type>::
-    operator() (
-        const image_type& img,
-        std::vector<rect_detection>& final_dets,
-        double adjust_threshold
-    ) 
+    void detect_with_weight_vectors (
+        const image_scanner_type& scanner,
+        const std::vector<processed_weight_vector<image_scanner_type> >& w,
+        const double adjust_threshold,
+        std::vector<rect_detection>& dets_accum
+    )
+    /*!
+        requires
+            - scanner.is_loaded_with_image() == true
+        ensures
+            - runs scanner.detect() with each weight vector in w and appends the
+              detections to dets_accum, with weight_index set to the index of the weight
+              vector that found them.  Their detection_confidence is relative to the
+              weight vector's threshold, which is lowered by adjust_threshold.
+            - This is what object_detector::operator() uses to run all its weight vectors.
+              An image scanner can overload it, like scan_fhog_pyramid does, to evaluate
+              all the weight vectors in one pass over the image.
+    !*/
     {
-        scanner.load(img);
         std::vector<std::pair<double, rectangle> > dets;
-        std::vector<rect_detection> dets_accum;
         for (unsigned long i = 0; i < w.size(); ++i)
         {
             const double thresh = w[i].w(scanner.get_num_dimensions());
@@ -448,18 +562,89 @@ namespace dlib
                 dets_accum.push_back(temp);
             }
         }
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_scanner_type
+        >
+    template <
+        typename image_type
+        >
+    void object_detector<image_scanner_type>::
+    operator() (
+        const image_type& img,
+        std::vector<rect_detection>& final_dets,
+        double adjust_threshold
+    ) 
+    {
+        scanner.load(img);
+        std::vector<rect_detection> dets_accum;
+        detect_with_weight_vectors(scanner, w, adjust_threshold, dets_accum);
 
         // Do non-max suppression
-        final_dets.clear();
-        if (w.size() > 1)
-            std::sort(dets_accum.rbegin(), dets_accum.rend());
-        for (unsigned long i = 0; i < dets_accum.size(); ++i)
-        {
-            if (overlaps_any_box(final_dets, dets_accum[i].rect))
-                continue;
+        suppress_overlaps(dets_accum, final_dets);
+    }
 
-            final_dets.push_back(dets_accum[i]);
-        }
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_scanner_type
+        >
+    template <
+        typename image_type
+        >
+    void object_detector<image_scanner_type>::
+    operator() (
+        const image_type& img,
+        workspace_type& workspace,
+        std::vector<rect_detection>& final_dets,
+        double adjust_threshold
+    ) const
+    {
+        workspace.load(scanner, img);
+        (*this)(workspace, final_dets, adjust_threshold);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_scanner_type
+        >
+    void object_detector<image_scanner_type>::
+    operator() (
+        workspace_type& workspace,
+        std::vector<rect_detection>& final_dets,
+        double adjust_threshold
+    ) const
+    {
+        suppress_overlaps(workspace.detect(w, adjust_threshold), final_dets);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_scanner_type
+        >
+    template <
+        typename image_type
+        >
+    std::vector<rectangle> object_detector<image_scanner_type>::
+    operator() (
+        const image_type& img,
+        workspace_type& workspace,
+        double adjust_threshold
+    ) const
+    {
+        std::vector<rect_detection> dets;
+        (*this)(img, workspace, dets, adjust_threshold);
+
+        std::vector<rectangle> final_dets(dets.size());
+        for (unsigned long i = 0; i < dets.size(); ++i)
+            final_dets[i] = dets[i].rect;
+
+        return final_dets;
     }
 
 // ----------------------------------------------------------------------------------------
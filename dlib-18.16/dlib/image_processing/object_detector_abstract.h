@@ -27,6 +27,29 @@ namespace dlib
         full_object_detection rect;
     };
 
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_scanner_type
+        >
+    class detection_workspace
+    {
+        /*!
+            WHAT THIS OBJECT REPRESENTS
+                This object holds the memory an object_detector<image_scanner_type> needs
+                while it looks at one image, e.g. the feature pyramid.  It is given to the
+                const object_detector::operator()s, which lets one object_detector be used
+                by many threads at once, each with its own detection_workspace.  
+
+                Usually you don't need to call its members yourself.  The exception is
+                load(scanner, img), which computes the features of img and may be called
+                before object_detector::operator()(workspace, dets).  An image scanner may
+                overload this template to keep only what it needs, the way
+                scan_fhog_pyramid does.  Its overload also has a load(tp, scanner, img)
+                which uses the threads of a thread_pool, like scan_fhog_pyramid::load(tp,img).
+        !*/
+    };
+
 // ----------------------------------------------------------------------------------------
 
     template <
@@ -366,6 +389,66 @@ namespace dlib
                   it doesn't include a double valued score.  That is, it just outputs the
                   full_object_detections.
         !*/
+
+        typedef detection_workspace<image_scanner_type> workspace_type;
+
+        template <
+            typename image_type
+            >
+        void operator() (
+            const image_type& img,
+            workspace_type& workspace,
+            std::vector<rect_detection>& dets,
+            double adjust_threshold = 0
+        ) const;
+        /*!
+            requires
+                - img == an object which can be accepted by image_scanner_type::load()
+            ensures
+                - Performs object detection on the given image and stores the detected
+                  objects into #dets, exactly like operator()(img, dets, adjust_threshold)
+                  does.  The difference is that the feature pyramid and the other scratch
+                  memory of the detection is kept in workspace rather than in this object,
+                  so get_scanner() is not loaded with img and this object is not modified.
+                  Therefore, many threads can detect objects with one object_detector at
+                  the same time, as long as each of them uses its own workspace.  Reusing a
+                  workspace across images also avoids reallocating its memory when the
+                  images have the same size.
+                - A workspace may be used with any object_detector with this
+                  image_scanner_type.
+        !*/
+
+        template <
+            typename image_type
+            >
+        std::vector<rectangle> operator() (
+            const image_type& img,
+            workspace_type& workspace,
+            double adjust_threshold = 0
+        ) const;
+        /*!
+            requires
+                - img == an object which can be accepted by image_scanner_type::load()
+            ensures
+                - This function is identical to the above operator() routine, except that
+                  it returns a std::vector<rectangle> which contains just the bounding
+                  boxes of all the detections. 
+        !*/
+
+        void operator() (
+            workspace_type& workspace,
+            std::vector<rect_detection>& dets,
+            double adjust_threshold = 0
+        ) const;
+        /*!
+            requires
+                - workspace.load(get_scanner(), img) has been called for some image img.
+            ensures
+                - #dets == the detections operator()(img, workspace, dets, adjust_threshold)
+                  would give.  This is the second half of that routine, so the feature
+                  extraction done by workspace.load() can be timed, or run on a
+                  thread_pool, separately from the filtering and non-max suppression.
+        !*/
     };
 
 // ----------------------------------------------------------------------------------------
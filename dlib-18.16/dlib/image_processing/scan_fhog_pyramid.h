@@ -9,6 +9,7 @@
 #include "../array.h"
 #include "../array2d.h"
 #include "object_detector.h"
+#include "../threads.h"
 
 namespace dlib
 {
@@ -92,6 +93,14 @@ namespace dlib
             const image_type& img
         );
 
+        template <
+            typename image_type
+            >
+        void load (
+            thread_pool& tp,
+            const image_type& img
+        );
+
         inline bool is_loaded_with_image (
         ) const;
 
@@ -290,6 +299,12 @@ namespace dlib
             const double thresh
         ) const;
 
+        void detect (
+            const std::vector<const fhog_filterbank*>& w,
+            const std::vector<double>& thresh,
+            std::vector<std::vector<std::pair<double, rectangle> > >& dets
+        ) const;
+
 
         void get_feature_vector (
             const full_object_detection& obj,
@@ -612,6 +627,120 @@ namespace dlib
                 }
             }
         }
+
+        inline void wait_for_tasks (
+            thread_pool& tp,
+            const std::vector<uint64>& ids
+        )
+        {
+            for (unsigned long i = 0; i < ids.size(); ++i)
+                tp.wait_for_task(ids[i]);
+        }
+
+        template <
+            typename image_type,
+            typename feature_extractor_type
+            >
+        struct fhog_level_task
+        {
+            // extracts the features of one pyramid level, as a thread_pool task.
+            fhog_level_task (
+                const image_type& img_,
+                const feature_extractor_type& fe_,
+                array<array2d<float> >& feats_,
+                int cell_size_,
+                int filter_rows_padding_,
+                int filter_cols_padding_
+            ) : img(img_), fe(fe_), feats(feats_), cell_size(cell_size_),
+                filter_rows_padding(filter_rows_padding_), filter_cols_padding(filter_cols_padding_) {}
+
+            void operator() (
+            ) const
+            {
+                fe(img, feats, cell_size,filter_rows_padding,filter_cols_padding);
+            }
+
+            const image_type& img;
+            const feature_extractor_type& fe;
+            array<array2d<float> >& feats;
+            int cell_size;
+            int filter_rows_padding;
+            int filter_cols_padding;
+        };
+
+        template <
+            typename pyramid_type,
+            typename image_type,
+            typename feature_extractor_type
+            >
+        void create_fhog_pyramid (
+            thread_pool& tp,
+            const image_type& img,
+            const feature_extractor_type& fe,
+            array<array<array2d<float> > >& feats,
+            int cell_size,
+            int filter_rows_padding,
+            int filter_cols_padding,
+            unsigned long min_pyramid_layer_width,
+            unsigned long min_pyramid_layer_height,
+            unsigned long max_pyramid_levels
+        )
+        /*!
+            ensures
+                - computes the same feats as the version above, but the features of each
+                  level are extracted by tp while the calling thread goes on making the
+                  smaller levels.  So level 0, the most expensive one, is extracted at the
+                  same time as the whole rest of the pyramid.
+        !*/
+        {
+            unsigned long levels = 0;
+            rectangle rect = get_rect(img);
+
+            pyramid_type pyr;
+            do
+            {
+                rect = pyr.rect_down(rect);
+                ++levels;
+            } while (rect.width() >= min_pyramid_layer_width && rect.height() >= min_pyramid_layer_height &&
+                levels < max_pyramid_levels);
+
+            if (feats.max_size() < levels)
+                feats.set_max_size(levels);
+            feats.set_size(levels);
+
+            // Every level is kept until its features are done, so, unlike above, the
+            // downsampled images can't share two buffers.
+            typedef typename image_traits<image_type>::pixel_type pixel_type;
+            typedef fhog_level_task<image_type, feature_extractor_type> top_task_type;
+            typedef fhog_level_task<array2d<pixel_type>, feature_extractor_type> task_type;
+            array<array2d<pixel_type> > pyr_imgs(levels-1);
+            std::vector<uint64> ids;
+            ids.reserve(levels);
+            try
+            {
+                ids.push_back(tp.add_task_by_value(top_task_type(img, fe, feats[0], cell_size,filter_rows_padding,filter_cols_padding)));
+                for (unsigned long i = 1; i < levels; ++i)
+                {
+                    if (i == 1)
+                        pyr(img, pyr_imgs[0]);
+                    else
+                        pyr(pyr_imgs[i-2], pyr_imgs[i-1]);
+                    ids.push_back(tp.add_task_by_value(task_type(pyr_imgs[i-1], fe, feats[i], cell_size,filter_rows_padding,filter_cols_padding)));
+                }
+            }
+            catch (...)
+            {
+                // the queued tasks still use pyr_imgs, so they must finish before it is
+                // destroyed.
+                wait_for_tasks(tp, ids);
+                throw;
+            }
+            wait_for_tasks(tp, ids);
+
+            DLIB_ASSERT(feats[0].size() == fe.get_num_planes(), 
+                "Invalid feature extractor used with dlib::scan_fhog_pyramid.  The output does not have the \n"
+                "indicated number of planes.");
+        }
     }
 
 // ----------------------------------------------------------------------------------------
@@ -635,6 +764,28 @@ namespace dlib
             max_pyramid_levels);
     }
 
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename Pyramid_type,
+        typename feature_extractor_type
+        >
+    template <
+        typename image_type
+        >
+    void scan_fhog_pyramid<Pyramid_type,feature_extractor_type>::
+    load (
+        thread_pool& tp,
+        const image_type& img
+    )
+    {
+        unsigned long width, height;
+        compute_fhog_window_size(width,height);
+        impl::create_fhog_pyramid<Pyramid_type>(tp, img, fe, feats, cell_size, height,
+            width, min_pyramid_layer_width, min_pyramid_layer_height,
+            max_pyramid_levels);
+    }
+
 // ----------------------------------------------------------------------------------------
 
     template <
@@ -806,6 +957,224 @@ namespace dlib
             std::sort(dets.rbegin(), dets.rend(), compare_pair_rect);
         }
 
+        template <
+            typename pyramid_type,
+            typename feature_extractor_type,
+            typename fhog_filterbank
+            >
+        void detect_from_fhog_pyramid_level (
+            const array<array2d<float> >& level_feats,
+            const unsigned long level,
+            const feature_extractor_type& fe,
+            const std::vector<const fhog_filterbank*>& w,
+            const std::vector<double>& thresh,
+            const unsigned long det_box_height,
+            const unsigned long det_box_width,
+            const int cell_size,
+            const int filter_rows_padding,
+            const int filter_cols_padding,
+            array2d<float>& saliency_image,
+            std::vector<std::vector<std::pair<double, rectangle> > >& dets
+        )
+        /*!
+            ensures
+                - for all i, appends the detections of *w[i] on the pyramid level
+                  level_feats to dets[i], in the order detect_from_fhog_pyramid() finds
+                  them.
+        !*/
+        {
+            pyramid_type pyr;
+            for (unsigned long i = 0; i < w.size(); ++i)
+            {
+                const rectangle area = apply_filters_to_fhog(*w[i], level_feats, saliency_image);
+
+                for (long r = area.top(); r <= area.bottom(); ++r)
+                {
+                    for (long c = area.left(); c <= area.right(); ++c)
+                    {
+                        if (saliency_image[r][c] >= thresh[i])
+                        {
+                            rectangle rect = fe.feats_to_image(centered_rect(point(c,r),det_box_width,det_box_height), 
+                                cell_size, filter_rows_padding, filter_cols_padding);
+                            rect = pyr.rect_up(rect, level);
+                            dets[i].push_back(std::make_pair(saliency_image[r][c], rect));
+                        }
+                    }
+                }
+            }
+        }
+
+        template <
+            typename pyramid_type,
+            typename feature_extractor_type,
+            typename fhog_filterbank
+            >
+        void detect_from_fhog_pyramid (
+            const array<array<array2d<float> > >& feats,
+            const feature_extractor_type& fe,
+            const std::vector<const fhog_filterbank*>& w,
+            const std::vector<double>& thresh,
+            const unsigned long det_box_height,
+            const unsigned long det_box_width,
+            const int cell_size,
+            const int filter_rows_padding,
+            const int filter_cols_padding,
+            array2d<float>& saliency_image,
+            std::vector<std::vector<std::pair<double, rectangle> > >& dets
+        ) 
+        /*!
+            requires
+                - w.size() == thresh.size()
+            ensures
+                - #dets.size() == w.size()
+                - for all i: #dets[i] == the output of the single filterbank version above
+                  for *w[i] and thresh[i].  But each pyramid level is run through all the
+                  filterbanks before moving on to the next, so it is read while it's still
+                  in the cache rather than once per filterbank.
+                - saliency_image is used as scratch memory.
+        !*/
+        {
+            dets.resize(w.size());
+            for (unsigned long i = 0; i < dets.size(); ++i)
+                dets[i].clear();
+
+            for (unsigned long l = 0; l < feats.size(); ++l)
+            {
+                detect_from_fhog_pyramid_level<pyramid_type>(feats[l], l, fe, w, thresh, det_box_height,
+                    det_box_width, cell_size, filter_rows_padding, filter_cols_padding, saliency_image, dets);
+            }
+
+            for (unsigned long i = 0; i < dets.size(); ++i)
+                std::sort(dets[i].rbegin(), dets[i].rend(), compare_pair_rect);
+        }
+
+        template <
+            typename pyramid_type,
+            typename feature_extractor_type,
+            typename fhog_filterbank
+            >
+        void detect_from_fhog_pyramid (
+            const array<array<array2d<float> > >& feats,
+            const feature_extractor_type& fe,
+            const std::vector<const fhog_filterbank*>& w,
+            const std::vector<double>& thresh,
+            const unsigned long det_box_height,
+            const unsigned long det_box_width,
+            const int cell_size,
+            const int filter_rows_padding,
+            const int filter_cols_padding,
+            std::vector<std::vector<std::pair<double, rectangle> > >& dets
+        ) 
+        {
+            array2d<float> saliency_image;
+            detect_from_fhog_pyramid<pyramid_type>(feats, fe, w, thresh, det_box_height, det_box_width,
+                cell_size, filter_rows_padding, filter_cols_padding, saliency_image, dets);
+        }
+
+        template <
+            typename pyramid_type,
+            typename feature_extractor_type,
+            typename fhog_filterbank
+            >
+        struct fhog_level_detect_task
+        {
+            // detect_from_fhog_pyramid_level() as a thread_pool task.
+            fhog_level_detect_task (
+                const array<array2d<float> >& level_feats_,
+                const unsigned long level_,
+                const feature_extractor_type& fe_,
+                const std::vector<const fhog_filterbank*>& w_,
+                const std::vector<double>& thresh_,
+                const unsigned long det_box_height_,
+                const unsigned long det_box_width_,
+                const int cell_size_,
+                const int filter_rows_padding_,
+                const int filter_cols_padding_,
+                std::vector<std::vector<std::pair<double, rectangle> > >& dets_
+            ) : level_feats(level_feats_), level(level_), fe(fe_), w(w_), thresh(thresh_),
+                det_box_height(det_box_height_), det_box_width(det_box_width_), cell_size(cell_size_),
+                filter_rows_padding(filter_rows_padding_), filter_cols_padding(filter_cols_padding_), dets(dets_) {}
+
+            void operator() (
+            ) const
+            {
+                array2d<float> saliency_image;
+                detect_from_fhog_pyramid_level<pyramid_type>(level_feats, level, fe, w, thresh, det_box_height,
+                    det_box_width, cell_size, filter_rows_padding, filter_cols_padding, saliency_image, dets);
+            }
+
+            const array<array2d<float> >& level_feats;
+            const unsigned long level;
+            const feature_extractor_type& fe;
+            const std::vector<const fhog_filterbank*>& w;
+            const std::vector<double>& thresh;
+            const unsigned long det_box_height;
+            const unsigned long det_box_width;
+            const int cell_size;
+            const int filter_rows_padding;
+            const int filter_cols_padding;
+            std::vector<std::vector<std::pair<double, rectangle> > >& dets;
+        };
+
+        template <
+            typename pyramid_type,
+            typename feature_extractor_type,
+            typename fhog_filterbank
+            >
+        void detect_from_fhog_pyramid (
+            thread_pool& tp,
+            const array<array<array2d<float> > >& feats,
+            const feature_extractor_type& fe,
+            const std::vector<const fhog_filterbank*>& w,
+            const std::vector<double>& thresh,
+            const unsigned long det_box_height,
+            const unsigned long det_box_width,
+            const int cell_size,
+            const int filter_rows_padding,
+            const int filter_cols_padding,
+            std::vector<std::vector<std::pair<double, rectangle> > >& dets
+        ) 
+        /*!
+            requires
+                - w.size() == thresh.size()
+            ensures
+                - computes the same dets as the version above, but the pyramid levels are
+                  filtered in parallel by the threads in tp.
+        !*/
+        {
+            typedef fhog_level_detect_task<pyramid_type, feature_extractor_type, fhog_filterbank> task_type;
+            std::vector<std::vector<std::vector<std::pair<double, rectangle> > > > level_dets(feats.size(),
+                std::vector<std::vector<std::pair<double, rectangle> > >(w.size()));
+            std::vector<uint64> ids;
+            ids.reserve(feats.size());
+            try
+            {
+                for (unsigned long l = 0; l < feats.size(); ++l)
+                {
+                    ids.push_back(tp.add_task_by_value(task_type(feats[l], l, fe, w, thresh, det_box_height,
+                        det_box_width, cell_size, filter_rows_padding, filter_cols_padding, level_dets[l])));
+                }
+            }
+            catch (...)
+            {
+                // the queued tasks write into level_dets.
+                wait_for_tasks(tp, ids);
+                throw;
+            }
+            wait_for_tasks(tp, ids);
+
+            // put the detections together in the order the serial version finds them, so
+            // that detections with equal scores are sorted the same way.
+            dets.resize(w.size());
+            for (unsigned long i = 0; i < dets.size(); ++i)
+            {
+                dets[i].clear();
+                for (unsigned long l = 0; l < level_dets.size(); ++l)
+                    dets[i].insert(dets[i].end(), level_dets[l][i].begin(), level_dets[l][i].end());
+                std::sort(dets[i].rbegin(), dets[i].rend(), compare_pair_rect);
+            }
+        }
+
         inline bool overlaps_any_box (
             const test_box_overlap& tester,
             const std::vector<rect_detection>& rects,
@@ -855,6 +1224,49 @@ namespace dlib
             height-2*padding, width-2*padding, cell_size, height, width, dets);
     }
 
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename Pyramid_type,
+        typename feature_extractor_type
+        >
+    void scan_fhog_pyramid<Pyramid_type,feature_extractor_type>::
+    detect (
+        const std::vector<const fhog_filterbank*>& w,
+        const std::vector<double>& thresh,
+        std::vector<std::vector<std::pair<double, rectangle> > >& dets
+    ) const
+    {
+        // make sure requires clause is not broken
+        DLIB_ASSERT(is_loaded_with_image() && w.size() == thresh.size(),
+            "\t void scan_fhog_pyramid::detect()"
+            << "\n\t Invalid inputs were given to this function "
+            << "\n\t is_loaded_with_image(): " << is_loaded_with_image()
+            << "\n\t w.size():               " << w.size()
+            << "\n\t thresh.size():          " << thresh.size()
+            << "\n\t this: " << this
+            );
+#ifdef ENABLE_ASSERTS
+        for (unsigned long i = 0; i < w.size(); ++i)
+        {
+            DLIB_ASSERT(w[i]->get_num_dimensions() == get_num_dimensions(), 
+                "\t void scan_fhog_pyramid::detect()"
+                << "\n\t Invalid inputs were given to this function "
+                << "\n\t i:                         " << i
+                << "\n\t w[i]->get_num_dimensions(): " << w[i]->get_num_dimensions()
+                << "\n\t get_num_dimensions():       " << get_num_dimensions()
+                << "\n\t this: " << this
+                );
+        }
+#endif
+
+        unsigned long width, height;
+        compute_fhog_window_size(width,height);
+
+        impl::detect_from_fhog_pyramid<pyramid_type>(feats, fe, w, thresh,
+            height-2*padding, width-2*padding, cell_size, height, width, dets);
+    }
+
 // ----------------------------------------------------------------------------------------
 
     template <
@@ -1213,6 +1625,166 @@ namespace dlib
 
     };
 
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename Pyramid_type,
+        typename feature_extractor_type
+        >
+    void detect_with_weight_vectors (
+        const scan_fhog_pyramid<Pyramid_type,feature_extractor_type>& scanner,
+        const std::vector<processed_weight_vector<scan_fhog_pyramid<Pyramid_type,feature_extractor_type> > >& w,
+        const double adjust_threshold,
+        std::vector<rect_detection>& dets_accum
+    )
+    /*!
+        ensures
+            - The overload of detect_with_weight_vectors() (see object_detector.h) used by
+              object_detector.  It runs all the filterbanks over each pyramid level at
+              once instead of scanning the whole pyramid once per weight vector, and
+              gives the same detections.
+    !*/
+    {
+        typedef typename scan_fhog_pyramid<Pyramid_type,feature_extractor_type>::fhog_filterbank fhog_filterbank;
+        std::vector<const fhog_filterbank*> filterbanks(w.size());
+        std::vector<double> thresh(w.size()), adjusted_thresh(w.size());
+        for (unsigned long i = 0; i < w.size(); ++i)
+        {
+            filterbanks[i] = &w[i].get_detect_argument();
+            thresh[i] = w[i].w(scanner.get_num_dimensions());
+            adjusted_thresh[i] = thresh[i] + adjust_threshold;
+        }
+
+        std::vector<std::vector<std::pair<double, rectangle> > > dets;
+        scanner.detect(filterbanks, adjusted_thresh, dets);
+        for (unsigned long i = 0; i < dets.size(); ++i)
+        {
+            for (unsigned long j = 0; j < dets[i].size(); ++j)
+            {
+                rect_detection temp;
+                temp.detection_confidence = dets[i][j].first-thresh[i];
+                temp.weight_index = i;
+                temp.rect = dets[i][j].second;
+                dets_accum.push_back(temp);
+            }
+        }
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename Pyramid_type,
+        typename feature_extractor_type
+        >
+    class detection_workspace<scan_fhog_pyramid<Pyramid_type,feature_extractor_type> >
+    {
+        /*!
+            WHAT THIS OBJECT REPRESENTS
+                The overload of detection_workspace (see object_detector.h) for
+                scan_fhog_pyramid.  It holds the HOG pyramid of the image, the saliency
+                image the filters are written into and the detections, all of which keep
+                their memory from one image to the next.  Like scan_fhog_pyramid, it can
+                also be loaded by a thread_pool, which then filters the pyramid too.
+        !*/
+    public:
+        typedef scan_fhog_pyramid<Pyramid_type,feature_extractor_type> scanner_type;
+        typedef typename scanner_type::fhog_filterbank fhog_filterbank;
+
+        detection_workspace (
+        ) : scanner(0), tp(0) {}
+
+        template <typename image_type>
+        void load (
+            const scanner_type& config,
+            const image_type& img
+        )
+        {
+            scanner = &config;
+            tp = 0;
+            impl::create_fhog_pyramid<Pyramid_type>(img, config.get_feature_extractor(), feats, config.get_cell_size(),
+                config.get_fhog_window_height(), config.get_fhog_window_width(), config.get_min_pyramid_layer_width(),
+                config.get_min_pyramid_layer_height(), config.get_max_pyramid_levels());
+        }
+
+        template <typename image_type>
+        void load (
+            thread_pool& tp_,
+            const scanner_type& config,
+            const image_type& img
+        )
+        /*!
+            ensures
+                - performs load(config, img), but the pyramid levels are extracted by the
+                  threads in tp_, as scan_fhog_pyramid::load(tp_, img) does, and the
+                  following detect() also filters them in parallel with tp_.
+        !*/
+        {
+            scanner = &config;
+            tp = &tp_;
+            impl::create_fhog_pyramid<Pyramid_type>(tp_, img, config.get_feature_extractor(), feats, config.get_cell_size(),
+                config.get_fhog_window_height(), config.get_fhog_window_width(), config.get_min_pyramid_layer_width(),
+                config.get_min_pyramid_layer_height(), config.get_max_pyramid_levels());
+        }
+
+        std::vector<rect_detection>& detect (
+            const std::vector<processed_weight_vector<scanner_type> >& w,
+            const double adjust_threshold
+        )
+        {
+            // make sure requires clause is not broken
+            DLIB_ASSERT(scanner != 0,
+                "\t std::vector<rect_detection>& detection_workspace::detect()"
+                << "\n\t You must call load() before detect()."
+                << "\n\t this: " << this
+                );
+
+            filterbanks.resize(w.size());
+            thresh.resize(w.size());
+            adjusted_thresh.resize(w.size());
+            for (unsigned long i = 0; i < w.size(); ++i)
+            {
+                filterbanks[i] = &w[i].get_detect_argument();
+                thresh[i] = w[i].w(scanner->get_num_dimensions());
+                adjusted_thresh[i] = thresh[i] + adjust_threshold;
+            }
+
+            const unsigned long det_box_width  = scanner->get_fhog_window_width()  - 2*scanner->get_padding();
+            const unsigned long det_box_height = scanner->get_fhog_window_height() - 2*scanner->get_padding();
+            if (tp)
+                impl::detect_from_fhog_pyramid<Pyramid_type>(*tp, feats, scanner->get_feature_extractor(), filterbanks,
+                    adjusted_thresh, det_box_height, det_box_width, scanner->get_cell_size(),
+                    scanner->get_fhog_window_height(), scanner->get_fhog_window_width(), dets);
+            else
+                impl::detect_from_fhog_pyramid<Pyramid_type>(feats, scanner->get_feature_extractor(), filterbanks,
+                    adjusted_thresh, det_box_height, det_box_width, scanner->get_cell_size(),
+                    scanner->get_fhog_window_height(), scanner->get_fhog_window_width(), saliency_image, dets);
+
+            dets_accum.clear();
+            for (unsigned long i = 0; i < dets.size(); ++i)
+            {
+                for (unsigned long j = 0; j < dets[i].size(); ++j)
+                {
+                    rect_detection temp;
+                    temp.detection_confidence = dets[i][j].first-thresh[i];
+                    temp.weight_index = i;
+                    temp.rect = dets[i][j].second;
+                    dets_accum.push_back(temp);
+                }
+            }
+            return dets_accum;
+        }
+
+    private:
+        const scanner_type* scanner;
+        thread_pool* tp;
+        array<array<array2d<float> > > feats;
+        array2d<float> saliency_image;
+        std::vector<const fhog_filterbank*> filterbanks;
+        std::vector<double> thresh, adjusted_thresh;
+        std::vector<std::vector<std::pair<double, rectangle> > > dets;
+        std::vector<rect_detection> dets_accum;
+    };
+
 // ----------------------------------------------------------------------------------------
 // ----------------------------------------------------------------------------------------
 
@@ -1268,7 +1840,9 @@ namespace dlib
                 min_pyramid_layer_height, max_pyramid_levels);
         }
 
-        std::vector<std::pair<double, rectangle> > temp_dets;
+        std::vector<std::vector<std::pair<double, rectangle> > > temp_dets;
+        std::vector<const typename scanner_type::fhog_filterbank*> filterbanks;
+        std::vector<double> thresh, adjusted_thresh;
         for (unsigned long i = 0; i < detectors.size(); ++i)
         {
             const scanner_type& scanner = detectors[i].get_scanner();
@@ -1283,22 +1857,30 @@ namespace dlib
             const unsigned long det_box_width  = scanner.get_fhog_window_width()  - 2*scanner.get_padding();
             const unsigned long det_box_height = scanner.get_fhog_window_height() - 2*scanner.get_padding();
             // A single detector object might itself have multiple weight vectors in it. So
-            // we need to evaluate all of them.
+            // we need to evaluate all of them.  They are run over each pyramid level
+            // together.
+            filterbanks.resize(detectors[i].num_detectors());
+            thresh.resize(detectors[i].num_detectors());
+            adjusted_thresh.resize(detectors[i].num_detectors());
             for (unsigned d = 0; d < detectors[i].num_detectors(); ++d)
             {
-                const double thresh = detectors[i].get_processed_w(d).w(scanner.get_num_dimensions());
+                filterbanks[d] = &detectors[i].get_processed_w(d).get_detect_argument();
+                thresh[d] = detectors[i].get_processed_w(d).w(scanner.get_num_dimensions());
+                adjusted_thresh[d] = thresh[d]+adjust_threshold;
+            }
 
-                impl::detect_from_fhog_pyramid<pyramid_type>(feats, scanner.get_feature_extractor(),
-                    detectors[i].get_processed_w(d).get_detect_argument(), thresh+adjust_threshold,
-                    det_box_height, det_box_width, cell_size, max_filter_height,
-                    max_filter_width, temp_dets);
+            impl::detect_from_fhog_pyramid<pyramid_type>(feats, scanner.get_feature_extractor(),
+                filterbanks, adjusted_thresh, det_box_height, det_box_width, cell_size, max_filter_height,
+                max_filter_width, temp_dets);
 
-                for (unsigned long j = 0; j < temp_dets.size(); ++j)
+            for (unsigned d = 0; d < temp_dets.size(); ++d)
+            {
+                for (unsigned long j = 0; j < temp_dets[d].size(); ++j)
                 {
                     rect_detection temp;
-                    temp.detection_confidence = temp_dets[j].first-thresh;
+                    temp.detection_confidence = temp_dets[d][j].first-thresh[d];
                     temp.weight_index = i;
-                    temp.rect = temp_dets[j].second;
+                    temp.rect = temp_dets[d][j].second;
                     dets_accum.push_back(temp);
                 }
             }
@@ -278,6 +278,25 @@ namespace dlib
                   locations.  Call detect() to do this.
         !*/
 
+        template <
+            typename image_type
+            >
+        void load (
+            thread_pool& tp,
+            const image_type& img
+        );
+        /*!
+            requires
+                - image_type == is an implementation of array2d/array2d_kernel_abstract.h
+                - img contains some kind of pixel type. 
+                  (i.e. pixel_traits<typename image_type::type> is defined)
+            ensures
+                - performs load(img), giving the same result, but the HOG features of the
+                  pyramid levels are extracted by the threads in tp, in parallel with each
+                  other and with the downsampling of the image.  This makes loading large
+                  images, which have many pyramid levels, faster.
+        !*/
+
         const feature_extractor_type& get_feature_extractor(
         ) const;
         /*!
@@ -578,6 +597,26 @@ namespace dlib
                   then it is reported in #dets.
         !*/
 
+        void detect (
+            const std::vector<const fhog_filterbank*>& w,
+            const std::vector<double>& thresh,
+            std::vector<std::vector<std::pair<double, rectangle> > >& dets
+        ) const;
+        /*!
+            requires
+                - w.size() == thresh.size()
+                - for all valid i: w[i]->get_num_dimensions() == get_num_dimensions()
+                - is_loaded_with_image() == true
+            ensures
+                - #dets.size() == w.size()
+                - for all valid i: #dets[i] is what detect(*w[i], #dets[i], thresh[i]) 
+                  would have output.
+                - This gives the same results as calling detect() once for each filter but
+                  is faster, since each level of the HOG pyramid is run through all the
+                  filters while it is still in the CPU cache rather than reading the whole
+                  pyramid once per filter.
+        !*/
+
         void detect (
             const feature_vector_type& w,
             std::vector<std::pair<double, rectangle> >& dets,
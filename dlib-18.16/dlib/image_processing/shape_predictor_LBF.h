@@ -0,0 +1,887 @@
+//[TIF] local binary features and global linear regression for the triplet-indexed
+//      shape_predictor
+//This code is used for the following paper:
+//Heng Yang*, Renqiao Zhang*, Peter Robinson,
+//"Human and Sheep Landmarks Localisation by Triplet-Interpolated Features", WACV2016
+//If you use this code please cite the above publication.
+// The license for dlib.net is : Boost Software License   See LICENSE.txt for the full license.
+#ifndef DLIB_SHAPE_PREDICToR_LBF_H_
+#define DLIB_SHAPE_PREDICToR_LBF_H_
+
+#include "shape_predictor_TIF.h"
+#include <deque>
+
+namespace dlib
+{
+
+// ----------------------------------------------------------------------------------------
+
+    namespace impl
+    {
+        inline void sample_local_pixel_coordinates (
+            dlib::rand& rnd,
+            index_feature& index,
+            unsigned long num_parts,
+            unsigned long features_per_part,
+            double radius
+        )
+        /*!
+            ensures
+                - #index holds num_parts*features_per_part triplet features.  Features
+                  [l*features_per_part, (l+1)*features_per_part) are anchored at part l,
+                  i.e. they sit at x_l + a*(x_j-x_l) + b*(x_k-x_l) for two other parts j
+                  and k and |a|,|b| <= radius, so they only look at the image around
+                  part l.
+        !*/
+        {
+            index.set_size(num_parts*features_per_part);
+            for (unsigned long l = 0; l < num_parts; ++l)
+            {
+                for (unsigned long f = 0; f < features_per_part; ++f)
+                {
+                    unsigned long j, k;
+                    do
+                    {
+                        j = rnd.get_random_32bit_number()%num_parts;
+                        k = rnd.get_random_32bit_number()%num_parts;
+                    }
+                    while (num_parts > 2 && (j == l || k == l || j == k));
+
+                    const double a = radius*(2*rnd.get_random_double() - 1);
+                    const double b = radius*(2*rnd.get_random_double() - 1);
+                    index.assign(l*features_per_part + f, l, j, k, a, b);
+                }
+            }
+        }
+
+        struct lbf_sample
+        {
+            unsigned long image_idx;
+            rectangle rect;
+            matrix<float,0,1> target_shape;
+            matrix<float,0,1> current_shape;
+            std::vector<float> feature_pixel_values;
+            // leaves[l*trees_per_part + t] == the leaf tree t of part l puts us in
+            std::vector<unsigned long> leaves;
+        };
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    class lbf_shape_predictor
+    {
+        /*!
+            WHAT THIS OBJECT REPRESENTS
+                A shape predictor in the style of "Face Alignment at 3000 FPS via
+                Regressing Local Binary Features" (Ren et al, CVPR 2014), made by
+                lbf_shape_predictor_trainer.  Like shape_predictor it starts from a mean
+                shape and refines it over a cascade of levels, each of which looks at the
+                image through triplet-interpolated pixel features (impl::index_feature).
+
+                At each level a small forest per part turns the features of that part
+                into a sparse binary code, one leaf per tree, and the shape update is a
+                global linear function of the code.  That function is stored as one
+                weight row per leaf, so the update is just the sum of the rows of the
+                leaves the face lands in.  All the trees of a level, and all their rows,
+                are kept in two flat arrays that are walked in order.
+
+                The speed comes from the size of the model: the local codes are
+                informative enough that a few short trees per part and a few cascade
+                levels do what shape_predictor needs hundreds of trees per level for.
+        !*/
+    public:
+
+        lbf_shape_predictor (
+        ) : tree_depth(0) {}
+
+        lbf_shape_predictor (
+            const matrix<float,0,1>& initial_shape_,
+            const std::vector<impl::index_feature>& index_,
+            const std::vector<std::vector<impl::split_feature> >& splits_,
+            const std::vector<matrix<float> >& weights_,
+            unsigned long tree_depth_
+        ) : initial_shape(initial_shape_), index(index_), splits(splits_), weights(weights_), tree_depth(tree_depth_)
+        /*!
+            requires
+                - initial_shape_.size()%2 == 0 && tree_depth_ > 0
+                - index_.size() == splits_.size() == weights_.size()
+                - for all valid l:
+                    - splits_[l] holds the trees of level l, one after the other, each
+                      as its 2^tree_depth_-1 splits in the order of impl::left_child()
+                      and impl::right_child().  They index the features of index_[l].
+                    - weights_[l].nc() == initial_shape_.size()
+                    - weights_[l].nr() == 2^tree_depth_ * the number of trees of level l.
+                      Row t*2^tree_depth_ + k is added to the shape when tree t ends in
+                      leaf k.
+        !*/
+        {
+            const unsigned long num_split_nodes = (1ul<<tree_depth) - 1;
+            DLIB_CASSERT(initial_shape.size()%2 == 0 && tree_depth > 0 &&
+                index.size() == splits.size() && index.size() == weights.size(),
+                "\t lbf_shape_predictor::lbf_shape_predictor()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t initial_shape.size(): " << initial_shape.size()
+                << "\n\t tree_depth:           " << tree_depth
+                << "\n\t index.size():         " << index.size()
+                << "\n\t splits.size():        " << splits.size()
+                << "\n\t weights.size():       " << weights.size()
+            );
+            for (unsigned long l = 0; l < splits.size(); ++l)
+            {
+                DLIB_CASSERT(splits[l].size()%num_split_nodes == 0 &&
+                    (unsigned long)weights[l].nr() == splits[l].size()/num_split_nodes*(num_split_nodes+1) &&
+                    weights[l].nc() == initial_shape.size(),
+                    "\t lbf_shape_predictor::lbf_shape_predictor()"
+                    << "\n\t The trees and weight rows of a level don't match. "
+                    << "\n\t level:              " << l
+                    << "\n\t splits[l].size():   " << splits[l].size()
+                    << "\n\t weights[l].nr():    " << weights[l].nr()
+                    << "\n\t weights[l].nc():    " << weights[l].nc()
+                );
+            }
+        }
+
+        unsigned long num_parts (
+        ) const { return initial_shape.size()/2; }
+
+        const matrix<float,0,1>& get_initial_shape (
+        ) const { return initial_shape; }
+
+        unsigned long get_cascade_depth (
+        ) const { return index.size(); }
+
+        unsigned long get_tree_depth (
+        ) const { return tree_depth; }
+
+        const std::vector<impl::index_feature>& get_index (
+        ) const { return index; }
+
+        const std::vector<std::vector<impl::split_feature> >& get_splits (
+        ) const { return splits; }
+
+        const std::vector<matrix<float> >& get_weights (
+        ) const { return weights; }
+
+        template <typename image_type>
+        full_object_detection operator()(
+            const image_type& img,
+            const rectangle& rect
+        ) const
+        /*!
+            ensures
+                - returns the landmarks of the object in rect of img, like
+                  shape_predictor::operator() does.
+        !*/
+        {
+            using namespace impl;
+            const point_transform_affine tform_to_img = unnormalizing_tform(rect);
+            const unsigned long num_split_nodes = (1ul<<tree_depth) - 1;
+            const long dims = initial_shape.size();
+            matrix<float,0,1> current_shape = initial_shape;
+            std::vector<float> feature_pixel_values;
+            for (unsigned long level = 0; level < index.size(); ++level)
+            {
+                extract_feature_pixel_values(img, tform_to_img, current_shape, index[level], feature_pixel_values);
+
+                const split_feature* tree = &splits[level][0];
+                const float* rows = &weights[level](0,0);
+                const unsigned long num_trees = splits[level].size()/num_split_nodes;
+                for (unsigned long t = 0; t < num_trees; ++t, tree += num_split_nodes, rows += (num_split_nodes+1)*dims)
+                {
+                    unsigned long node = 0;
+                    while (node < num_split_nodes)
+                    {
+                        const split_feature& split = tree[node];
+                        if (feature_pixel_values[split.idx1] - feature_pixel_values[split.idx2] > split.thresh)
+                            node = left_child(node);
+                        else
+                            node = right_child(node);
+                    }
+                    const float* row = rows + (node - num_split_nodes)*dims;
+                    for (long k = 0; k < dims; ++k)
+                        current_shape(k) += row[k];
+                }
+            }
+
+            std::vector<point> parts(current_shape.size()/2);
+            for (unsigned long i = 0; i < parts.size(); ++i)
+                parts[i] = tform_to_img(location(current_shape, i));
+            return full_object_detection(rect, parts);
+        }
+
+        friend void serialize (const lbf_shape_predictor& item, std::ostream& out)
+        {
+            int version = 1;
+            dlib::serialize(version, out);
+            dlib::serialize(item.initial_shape, out);
+            dlib::serialize(item.index, out);
+            dlib::serialize(item.splits, out);
+            dlib::serialize(item.weights, out);
+            dlib::serialize(item.tree_depth, out);
+        }
+
+        friend void deserialize (lbf_shape_predictor& item, std::istream& in)
+        {
+            int version = 0;
+            dlib::deserialize(version, in);
+            if (version != 1)
+                throw serialization_error("Unexpected version found while deserializing dlib::lbf_shape_predictor.");
+            dlib::deserialize(item.initial_shape, in);
+            dlib::deserialize(item.index, in);
+            dlib::deserialize(item.splits, in);
+            dlib::deserialize(item.weights, in);
+            dlib::deserialize(item.tree_depth, in);
+        }
+
+    private:
+        matrix<float,0,1> initial_shape;
+        std::vector<impl::index_feature> index;
+        std::vector<std::vector<impl::split_feature> > splits;
+        std::vector<matrix<float> > weights;
+        unsigned long tree_depth;
+    };
+
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_array
+        >
+    double test_shape_predictor (
+        const lbf_shape_predictor& sp,
+        const image_array& images,
+        const std::vector<std::vector<full_object_detection> >& objects,
+        const std::vector<std::vector<double> >& scales
+    )
+    /*!
+        requires
+            - images.size() == objects.size()
+            - all the objects have sp.num_parts() parts.
+            - scales.size() == 0 or scales has one scale per object.
+        ensures
+            - returns the mean landmark error of sp, the same way test_shape_predictor()
+              does for a shape_predictor.
+    !*/
+    {
+        DLIB_CASSERT(images.size() == objects.size() && (scales.size() == 0 || scales.size() == objects.size()),
+            "\t double test_shape_predictor()"
+            << "\n\t Invalid inputs were given to this function. "
+            << "\n\t images.size():  " << images.size()
+            << "\n\t objects.size(): " << objects.size()
+            << "\n\t scales.size():  " << scales.size()
+        );
+
+        running_stats<double> rs;
+        for (unsigned long i = 0; i < objects.size(); ++i)
+        {
+            for (unsigned long j = 0; j < objects[i].size(); ++j)
+            {
+                DLIB_CASSERT(objects[i][j].num_parts() == sp.num_parts() &&
+                    (scales.size() == 0 || scales[i].size() == objects[i].size()),
+                    "\t double test_shape_predictor()"
+                    << "\n\t Invalid inputs were given to this function. "
+                    << "\n\t objects["<<i<<"]["<<j<<"].num_parts(): " << objects[i][j].num_parts()
+                    << "\n\t sp.num_parts(): " << sp.num_parts()
+                );
+                const double scale = scales.size()==0 ? 1 : scales[i][j];
+                const full_object_detection det = sp(images[i], objects[i][j].get_rect());
+                for (unsigned long k = 0; k < det.num_parts(); ++k)
+                    rs.add(length(det.part(k) - objects[i][j].part(k))/scale);
+            }
+        }
+        return rs.mean();
+    }
+
+    template <
+        typename image_array
+        >
+    double test_shape_predictor (
+        const lbf_shape_predictor& sp,
+        const image_array& images,
+        const std::vector<std::vector<full_object_detection> >& objects
+    )
+    {
+        std::vector<std::vector<double> > no_scales;
+        return test_shape_predictor(sp, images, objects, no_scales);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    class lbf_shape_predictor_trainer
+    {
+        /*!
+            WHAT THIS OBJECT REPRESENTS
+                The trainer of lbf_shape_predictor.  Each cascade level fits a small
+                random forest per part, using only triplet features anchored at that
+                part.  The leaves the trees put a face in form a sparse binary code.  One
+                global ridge regression from the codes of all the parts to the whole
+                shape update is then fit on all the training samples.
+
+                The defaults give a model of 4 levels of 5 trees of depth 4 per part,
+                which reads 30 pixels per part and level.  That is a small fraction of
+                the features and trees of a shape_predictor_trainer model with its
+                defaults, and about as accurate.
+
+                Like shape_predictor_trainer, this only really works with unsigned char
+                or rgb_pixel images.
+        !*/
+    public:
+
+        lbf_shape_predictor_trainer (
+        )
+        {
+            _cascade_depth = 4;
+            _num_trees_per_part = 5;
+            _tree_depth = 4;
+            _features_per_part = 30;
+            _feature_radius = 0.5;
+            _nu = 0.5;
+            _num_test_splits = 20;
+            _oversampling_amount = 10;
+            _lambda = 1;
+            _num_threads = 0;
+            _verbose = false;
+        }
+
+        unsigned long get_cascade_depth (
+        ) const { return _cascade_depth; }
+        void set_cascade_depth (
+            unsigned long depth
+        )
+        {
+            DLIB_CASSERT(depth > 0,
+                "\t void lbf_shape_predictor_trainer::set_cascade_depth()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t depth:  " << depth
+            );
+            _cascade_depth = depth;
+        }
+
+        unsigned long get_num_trees_per_part (
+        ) const { return _num_trees_per_part; }
+        void set_num_trees_per_part (
+            unsigned long num
+        )
+        {
+            DLIB_CASSERT(num > 0,
+                "\t void lbf_shape_predictor_trainer::set_num_trees_per_part()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t num:  " << num
+            );
+            _num_trees_per_part = num;
+        }
+
+        unsigned long get_tree_depth (
+        ) const { return _tree_depth; }
+        void set_tree_depth (
+            unsigned long depth
+        )
+        {
+            DLIB_CASSERT(depth > 0,
+                "\t void lbf_shape_predictor_trainer::set_tree_depth()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t depth:  " << depth
+            );
+            _tree_depth = depth;
+        }
+
+        unsigned long get_features_per_part (
+        ) const { return _features_per_part; }
+        void set_features_per_part (
+            unsigned long num
+        )
+        {
+            DLIB_CASSERT(num > 1,
+                "\t void lbf_shape_predictor_trainer::set_features_per_part()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t num:  " << num
+            );
+            _features_per_part = num;
+        }
+
+        double get_feature_radius (
+        ) const { return _feature_radius; }
+        void set_feature_radius (
+            double radius
+        )
+        /*!
+            requires
+                - radius > 0
+            ensures
+                - the features of the first cascade level are at most radius times the
+                  distance to two other parts away from the part they belong to (see
+                  impl::sample_local_pixel_coordinates()).  Every later level uses 3/4 of
+                  the radius of the level before it since the shapes get closer to the
+                  truth.
+        !*/
+        {
+            DLIB_CASSERT(radius > 0,
+                "\t void lbf_shape_predictor_trainer::set_feature_radius()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t radius:  " << radius
+            );
+            _feature_radius = radius;
+        }
+
+        double get_nu (
+        ) const { return _nu; }
+        void set_nu (
+            double nu
+        )
+        /*!
+            requires
+                - 0 < nu <= 1
+            ensures
+                - the trees of a part are boosted on the part's residual, each one fit to
+                  what the trees before it leave after shrinking their leaf means by nu,
+                  so that they split on different features.  Only the splits are kept:
+                  the shape update is the global regression's, whatever nu is.
+        !*/
+        {
+            DLIB_CASSERT(0 < nu && nu <= 1,
+                "\t void lbf_shape_predictor_trainer::set_nu()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t nu: " << nu
+            );
+            _nu = nu;
+        }
+
+        unsigned long get_num_test_splits (
+        ) const { return _num_test_splits; }
+        void set_num_test_splits (
+            unsigned long num
+        )
+        {
+            DLIB_CASSERT(num > 0,
+                "\t void lbf_shape_predictor_trainer::set_num_test_splits()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t num:  " << num
+            );
+            _num_test_splits = num;
+        }
+
+        unsigned long get_oversampling_amount (
+        ) const { return _oversampling_amount; }
+        void set_oversampling_amount (
+            unsigned long amount
+        )
+        {
+            DLIB_CASSERT(amount > 0,
+                "\t void lbf_shape_predictor_trainer::set_oversampling_amount()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t amount: " << amount
+            );
+            _oversampling_amount = amount;
+        }
+
+        double get_lambda (
+        ) const { return _lambda; }
+        void set_lambda (
+            double lambda
+        )
+        /*!
+            requires
+                - lambda > 0
+            ensures
+                - lambda is the ridge penalty of the global regression, per training
+                  sample.  Larger values give smaller weight rows and a less overfit
+                  model.  The later cascade levels make up for rows that are too small,
+                  so erring on the large side is usually cheaper than overfitting.
+        !*/
+        {
+            DLIB_CASSERT(lambda > 0,
+                "\t void lbf_shape_predictor_trainer::set_lambda()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t lambda: " << lambda
+            );
+            _lambda = lambda;
+        }
+
+        std::string get_random_seed (
+        ) const { return _random_seed; }
+        void set_random_seed (
+            const std::string& seed
+        ) { _random_seed = seed; }
+
+        unsigned long get_num_threads (
+        ) const { return _num_threads; }
+        void set_num_threads (
+            unsigned long num
+        )
+        /*!
+            ensures
+                - training will use num threads.  The trained model is the same for any
+                  number of threads.
+        !*/
+        {
+            _num_threads = num;
+        }
+
+        void be_verbose (
+        )
+        {
+            _verbose = true;
+        }
+
+        void be_quiet (
+        )
+        {
+            _verbose = false;
+        }
+
+        template <typename image_array>
+        lbf_shape_predictor train (
+            const image_array& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        ) const
+        /*!
+            requires
+                - images.size() == objects.size() && images.size() > 0
+                - all the objects have the same, non-zero, number of parts.
+            ensures
+                - returns an lbf_shape_predictor with get_cascade_depth() cascade levels
+                  of num parts*get_num_trees_per_part() trees each.
+        !*/
+        {
+            using namespace impl;
+            DLIB_CASSERT(
+                images.size() == objects.size() && images.size() > 0,
+                "\t lbf_shape_predictor lbf_shape_predictor_trainer::train()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t images.size():  " << images.size()
+                << "\n\t objects.size(): " << objects.size()
+            );
+
+            std::vector<lbf_sample> samples;
+            const matrix<float,0,1> initial_shape = populate_samples(objects, samples);
+            const unsigned long num_parts = initial_shape.size()/2;
+            const unsigned long trees_per_level = num_parts*get_num_trees_per_part();
+            const unsigned long num_leaves = 1ul<<get_tree_depth();
+            const long dims = initial_shape.size();
+
+            thread_pool tp(get_num_threads());
+            std::vector<index_feature> index(get_cascade_depth());
+            std::vector<std::vector<split_feature> > splits(get_cascade_depth());
+            std::vector<matrix<float> > weights(get_cascade_depth());
+            double radius = get_feature_radius();
+            for (unsigned long cascade = 0; cascade < get_cascade_depth(); ++cascade, radius *= 0.75)
+            {
+                if (_verbose)
+                    std::cout << "Fitting cascade level " << cascade+1 << " of " << get_cascade_depth() << std::endl;
+
+                dlib::rand rnd;
+                seed_random_stream(rnd, get_random_seed(), feature_pool_stream, cascade);
+                sample_local_pixel_coordinates(rnd, index[cascade], num_parts, get_features_per_part(), radius);
+                parallel_for(tp, 0, samples.size(), extract_lbf_features<image_array>(images, index[cascade], samples), 1);
+
+                // the local forests give every sample its binary code
+                splits[cascade].resize(trees_per_level*(num_leaves-1));
+                for (unsigned long i = 0; i < samples.size(); ++i)
+                    samples[i].leaves.resize(trees_per_level);
+                parallel_for(tp, 0, num_parts, fit_part_forest(*this, cascade, samples, splits[cascade]), 1);
+
+                // and the global regression maps the codes to shape updates
+                fit_global_regression(tp, samples, trees_per_level*num_leaves, weights[cascade]);
+                for (unsigned long i = 0; i < samples.size(); ++i)
+                {
+                    for (unsigned long t = 0; t < trees_per_level; ++t)
+                    {
+                        const float* row = &weights[cascade](t*num_leaves + samples[i].leaves[t], 0);
+                        for (long k = 0; k < dims; ++k)
+                            samples[i].current_shape(k) += row[k];
+                    }
+                }
+            }
+
+            if (_verbose)
+                std::cout << "Training complete" << std::endl;
+
+            return lbf_shape_predictor(initial_shape, index, splits, weights, get_tree_depth());
+        }
+
+    private:
+
+        template <typename image_array>
+        struct extract_lbf_features
+        {
+            extract_lbf_features (
+                const image_array& images_,
+                const impl::index_feature& index_,
+                std::vector<impl::lbf_sample>& samples_
+            ) : images(images_), index(index_), samples(samples_) {}
+
+            void operator() (long i) const
+            {
+                impl::extract_feature_pixel_values(images[samples[i].image_idx], samples[i].rect,
+                    samples[i].current_shape, index, samples[i].feature_pixel_values);
+            }
+
+            const image_array& images;
+            const impl::index_feature& index;
+            std::vector<impl::lbf_sample>& samples;
+        };
+
+        struct fit_part_forest
+        {
+            // Fits the trees of part l at one cascade level and records the leaf every
+            // sample lands in.  The splits and the leaves of the samples must already
+            // be sized for the whole level.  Only the slots of part l are written so
+            // the parts can be fit at the same time.
+            fit_part_forest (
+                const lbf_shape_predictor_trainer& trainer_,
+                unsigned long cascade_,
+                std::vector<impl::lbf_sample>& samples_,
+                std::vector<impl::split_feature>& splits_
+            ) : trainer(trainer_), cascade(cascade_), samples(samples_), splits(splits_) {}
+
+            void operator() (long l) const
+            {
+                using namespace impl;
+                const unsigned long num_trees = trainer.get_num_trees_per_part();
+                const unsigned long features = trainer.get_features_per_part();
+                const unsigned long num_split_nodes = (1ul<<trainer.get_tree_depth()) - 1;
+
+                // The trees are boosted on the part's residual so they don't all learn
+                // the same split.  Their own leaf values are thrown away afterwards.
+                std::vector<matrix<float,0,1> > residuals(samples.size());
+                for (unsigned long i = 0; i < samples.size(); ++i)
+                {
+                    residuals[i] = rowm(samples[i].target_shape - samples[i].current_shape, range(2*l, 2*l+1));
+                }
+
+                std::vector<unsigned long> order(samples.size());
+                dlib::rand rnd;
+                for (unsigned long t = 0; t < num_trees; ++t)
+                {
+                    const unsigned long tree_idx = l*num_trees + t;
+                    split_feature* tree = &splits[tree_idx*num_split_nodes];
+                    for (unsigned long i = 0; i < order.size(); ++i)
+                        order[i] = i;
+
+                    std::deque<std::pair<unsigned long,unsigned long> > parts;
+                    parts.push_back(std::make_pair(0ul, (unsigned long)order.size()));
+                    std::vector<matrix<float,0,1> > sums(num_split_nodes*2+1);
+                    for (unsigned long i = 0; i < order.size(); ++i)
+                        sums[0] += residuals[i];
+
+                    for (unsigned long n = 0; n < num_split_nodes; ++n)
+                    {
+                        const std::pair<unsigned long,unsigned long> node = parts.front();
+                        parts.pop_front();
+
+                        seed_random_stream(rnd, trainer.get_random_seed(), split_stream, cascade, tree_idx, n);
+                        std::vector<split_feature> feats(trainer.get_num_test_splits());
+                        std::vector<matrix<float,0,1> > left_sums(feats.size());
+                        std::vector<unsigned long> left_cnt(feats.size());
+                        for (unsigned long c = 0; c < feats.size(); ++c)
+                        {
+                            do
+                            {
+                                feats[c].idx1 = l*features + rnd.get_random_32bit_number()%features;
+                                feats[c].idx2 = l*features + rnd.get_random_32bit_number()%features;
+                            }
+                            while (feats[c].idx1 == feats[c].idx2);
+                            feats[c].thresh = (rnd.get_random_double()*256 - 128)/2.0;
+
+                            for (unsigned long j = node.first; j < node.second; ++j)
+                            {
+                                const std::vector<float>& v = samples[order[j]].feature_pixel_values;
+                                if (v[feats[c].idx1] - v[feats[c].idx2] > feats[c].thresh)
+                                {
+                                    left_sums[c] += residuals[order[j]];
+                                    ++left_cnt[c];
+                                }
+                            }
+                        }
+                        const split_feature split = feats[select_best_split(sums[n], node.second-node.first,
+                            left_sums, left_cnt, sums[left_child(n)], sums[right_child(n)])];
+                        tree[n] = split;
+
+                        unsigned long mid = node.first;
+                        for (unsigned long j = node.first; j < node.second; ++j)
+                        {
+                            const std::vector<float>& v = samples[order[j]].feature_pixel_values;
+                            if (v[split.idx1] - v[split.idx2] > split.thresh)
+                                std::swap(order[mid++], order[j]);
+                        }
+                        parts.push_back(std::make_pair(node.first, mid));
+                        parts.push_back(std::make_pair(mid, node.second));
+                    }
+
+                    for (unsigned long leaf = 0; leaf < parts.size(); ++leaf)
+                    {
+                        const unsigned long num = parts[leaf].second - parts[leaf].first;
+                        for (unsigned long j = parts[leaf].first; j < parts[leaf].second; ++j)
+                        {
+                            samples[order[j]].leaves[tree_idx] = leaf;
+                            residuals[order[j]] -= trainer.get_nu()*sums[num_split_nodes+leaf]/num;
+                        }
+                    }
+                }
+            }
+
+            const lbf_shape_predictor_trainer& trainer;
+            unsigned long cascade;
+            std::vector<impl::lbf_sample>& samples;
+            std::vector<impl::split_feature>& splits;
+        };
+
+        struct solve_regression_column
+        {
+            // Solves (C'C + lambda*N*I)w = C'r for output dimension d, where C is the
+            // sparse binary code matrix and r the d-th residual coordinate, with conjugate
+            // gradient.  Every output dimension is independent of the others.
+            solve_regression_column (
+                const std::vector<impl::lbf_sample>& samples_,
+                unsigned long num_features_,
+                double lambda_,
+                matrix<double>& weights_
+            ) : samples(samples_), num_features(num_features_), lambda(lambda_), weights(weights_) {}
+
+            void apply (
+                const matrix<double,0,1>& w,
+                matrix<double,0,1>& out
+            ) const
+            {
+                out = lambda*samples.size()*w;
+                for (unsigned long i = 0; i < samples.size(); ++i)
+                {
+                    const std::vector<unsigned long>& leaves = samples[i].leaves;
+                    double s = 0;
+                    for (unsigned long t = 0; t < leaves.size(); ++t)
+                        s += w(t*num_leaves() + leaves[t]);
+                    for (unsigned long t = 0; t < leaves.size(); ++t)
+                        out(t*num_leaves() + leaves[t]) += s;
+                }
+            }
+
+            unsigned long num_leaves (
+            ) const { return num_features/samples[0].leaves.size(); }
+
+            void operator() (long d) const
+            {
+                matrix<double,0,1> b = zeros_matrix<double>(num_features, 1);
+                for (unsigned long i = 0; i < samples.size(); ++i)
+                {
+                    const double r = samples[i].target_shape(d) - samples[i].current_shape(d);
+                    const std::vector<unsigned long>& leaves = samples[i].leaves;
+                    for (unsigned long t = 0; t < leaves.size(); ++t)
+                        b(t*num_leaves() + leaves[t]) += r;
+                }
+
+                matrix<double,0,1> w = zeros_matrix<double>(num_features, 1);
+                matrix<double,0,1> r = b, p = b, Ap;
+                double rr = dot(r,r);
+                // The ridge term keeps the system well conditioned so a couple hundred
+                // iterations is plenty.
+                const double stop = 1e-12*rr;
+                for (unsigned long iter = 0; iter < 200 && rr > stop; ++iter)
+                {
+                    apply(p, Ap);
+                    const double alpha = rr/dot(p,Ap);
+                    w += alpha*p;
+                    r -= alpha*Ap;
+                    const double rr_new = dot(r,r);
+                    p = r + (rr_new/rr)*p;
+                    rr = rr_new;
+                }
+                set_colm(weights, d) = w;
+            }
+
+            const std::vector<impl::lbf_sample>& samples;
+            unsigned long num_features;
+            double lambda;
+            matrix<double>& weights;
+        };
+
+        void fit_global_regression (
+            thread_pool& tp,
+            const std::vector<impl::lbf_sample>& samples,
+            unsigned long num_features,
+            matrix<float>& rows
+        ) const
+        /*!
+            ensures
+                - rowm(#rows,k) == the shape update the global ridge regression gives to
+                  binary feature k, i.e. to leaf k%num_leaves of tree k/num_leaves.
+        !*/
+        {
+            matrix<double> weights(num_features, samples[0].target_shape.size());
+            parallel_for(tp, 0, weights.nc(), solve_regression_column(samples, num_features, get_lambda(), weights), 1);
+            rows = matrix_cast<float>(weights);
+        }
+
+        matrix<float,0,1> populate_samples (
+            const std::vector<std::vector<full_object_detection> >& objects,
+            std::vector<impl::lbf_sample>& samples
+        ) const
+        {
+            // Same initial shapes as shape_predictor_trainer: the mean shape and random
+            // convex combinations of two of the target shapes.
+            samples.clear();
+            unsigned long num_parts = 0;
+            matrix<float,0,1> mean_shape;
+            for (unsigned long i = 0; i < objects.size(); ++i)
+            {
+                for (unsigned long j = 0; j < objects[i].size(); ++j)
+                {
+                    DLIB_CASSERT(objects[i][j].num_parts() != 0 && (num_parts == 0 || objects[i][j].num_parts() == num_parts),
+                        "\t lbf_shape_predictor lbf_shape_predictor_trainer::train()"
+                        << "\n\t All the objects must have the same, non-zero, number of parts."
+                        << "\n\t objects["<<i<<"]["<<j<<"].num_parts(): " << objects[i][j].num_parts()
+                    );
+                    num_parts = objects[i][j].num_parts();
+
+                    impl::lbf_sample sample;
+                    sample.image_idx = i;
+                    sample.rect = objects[i][j].get_rect();
+                    sample.target_shape = impl::object_to_shape(objects[i][j]);
+                    for (unsigned long itr = 0; itr < get_oversampling_amount(); ++itr)
+                        samples.push_back(sample);
+                    mean_shape += sample.target_shape;
+                }
+            }
+            DLIB_CASSERT(samples.size() != 0,
+                "\t lbf_shape_predictor lbf_shape_predictor_trainer::train()"
+                << "\n\t You must give at least one full_object_detection."
+            );
+            mean_shape /= samples.size()/get_oversampling_amount();
+
+            dlib::rand rnd;
+            for (unsigned long i = 0; i < samples.size(); ++i)
+            {
+                if ((i%get_oversampling_amount()) == 0)
+                {
+                    samples[i].current_shape = mean_shape;
+                }
+                else
+                {
+                    impl::seed_random_stream(rnd, get_random_seed(), impl::initial_shape_stream, i);
+                    const unsigned long rand_idx = rnd.get_random_32bit_number()%samples.size();
+                    const unsigned long rand_idx2 = rnd.get_random_32bit_number()%samples.size();
+                    const double alpha = rnd.get_random_double();
+                    samples[i].current_shape = alpha*samples[rand_idx].target_shape + (1-alpha)*samples[rand_idx2].target_shape;
+                }
+            }
+            return mean_shape;
+        }
+
+        std::string _random_seed;
+        unsigned long _cascade_depth;
+        unsigned long _num_trees_per_part;
+        unsigned long _tree_depth;
+        unsigned long _features_per_part;
+        double _feature_radius;
+        double _nu;
+        unsigned long _num_test_splits;
+        unsigned long _oversampling_amount;
+        double _lambda;
+        unsigned long _num_threads;
+        bool _verbose;
+    };
+
+// ----------------------------------------------------------------------------------------
+
+}
+
+#endif // DLIB_SHAPE_PREDICToR_LBF_H_
+
@@ -12,11 +12,31 @@
 
 #include "shape_predictor_abstract.h"
 #include "full_object_detection.h"
+#include "object_detector.h"
 #include "../algs.h"
 #include "../matrix.h"
 #include "../geometry.h"
 #include "../pixel.h"
 #include "../console_progress_indicator.h"
+#include "../threads.h"
+#include "../rand.h"
+#include "../misc_api.h"
+#include "../simd.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <algorithm>
+#include <iterator>
+#include <cmath>
+#include <limits>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+#ifdef WIN32
+#include "../windows_magic.h"
+#include <windows.h>
+#endif
 
 namespace dlib
 {
@@ -104,6 +124,304 @@ namespace dlib
             }
         };
 
+        inline bool is_fern (
+            const regression_tree& tree
+        )
+        /*!
+            ensures
+                - returns true if all the nodes at the same depth of tree use the same
+                  split.  That is, tree is a random fern written out as a full tree.
+        !*/
+        {
+            unsigned long level_start = 0;
+            for (unsigned long width = 1; level_start < tree.splits.size(); width *= 2)
+            {
+                for (unsigned long i = level_start+1; i < level_start+width; ++i)
+                {
+                    const split_feature& a = tree.splits[i];
+                    const split_feature& b = tree.splits[level_start];
+                    if (a.idx1 != b.idx1 || a.idx2 != b.idx2 || a.thresh != b.thresh)
+                        return false;
+                }
+                level_start += width;
+            }
+            return true;
+        }
+
+        class fern_level
+        {
+            /*!
+                WHAT THIS OBJECT REPRESENTS
+                    The splits of a cascade level whose trees are all ferns of the same
+                    depth, laid out so that four ferns are evaluated at once with SIMD
+                    instructions.  The leaf of a fern is its comparisons packed into bits
+                    so, unlike walking a tree, no comparison waits on the one before it.
+                    The leaf values stay in the trees themselves.
+            !*/
+        public:
+            fern_level (
+            ) : num_ferns(0), depth(0) {}
+
+            explicit fern_level (
+                const std::vector<regression_tree>& forest
+            ) : num_ferns(0), depth(0)
+            /*!
+                ensures
+                    - if all the trees in forest are ferns of the same depth then #empty()
+                      == false and this object evaluates them.  Otherwise #empty() == true.
+            !*/
+            {
+                if (forest.size() == 0 || forest[0].splits.size() == 0)
+                    return;
+                const unsigned long num_splits = forest[0].splits.size();
+                for (unsigned long i = 0; i < forest.size(); ++i)
+                {
+                    if (forest[i].splits.size() != num_splits || !is_fern(forest[i]))
+                        return;
+                }
+                while ((2ul<<depth)-1 <= num_splits)
+                    ++depth;
+
+                // pad up to a multiple of 4 ferns.  The padding is never looked at.
+                const unsigned long padded = (forest.size()+3)/4*4;
+                idx1.assign(depth*padded, 0);
+                idx2.assign(depth*padded, 0);
+                thresh.assign(depth*padded, 0);
+                for (unsigned long d = 0; d < depth; ++d)
+                {
+                    for (unsigned long i = 0; i < forest.size(); ++i)
+                    {
+                        const split_feature& split = forest[i].splits[(1ul<<d)-1];
+                        idx1[d*padded+i] = split.idx1;
+                        idx2[d*padded+i] = split.idx2;
+                        thresh[d*padded+i] = split.thresh;
+                    }
+                }
+                num_ferns = forest.size();
+            }
+
+            bool empty (
+            ) const { return num_ferns == 0; }
+
+            void operator() (
+                const std::vector<regression_tree>& forest,
+                const std::vector<float>& feature_pixel_values,
+                matrix<float,0,1>& current_shape
+            ) const
+            /*!
+                requires
+                    - forest is the forest this object was made from and !empty()
+                ensures
+                    - adds the leaf of every tree in forest to current_shape, in order.
+                      This gives exactly what adding forest[i](feature_pixel_values) for
+                      each i does.
+            !*/
+            {
+                const std::vector<float>& v = feature_pixel_values;
+                const unsigned long padded = idx1.size()/depth;
+                for (unsigned long i = 0; i < num_ferns; i += 4)
+                {
+                    // a fern that goes right at depth d sets bit depth-1-d of its leaf
+                    simd4f leaf(0);
+                    float bit = 1ul<<depth;
+                    for (unsigned long d = 0, k = i; d < depth; ++d, k += padded)
+                    {
+                        bit /= 2;
+                        const simd4f a(v[idx1[k]], v[idx1[k+1]], v[idx1[k+2]], v[idx1[k+3]]);
+                        const simd4f b(v[idx2[k]], v[idx2[k+1]], v[idx2[k+2]], v[idx2[k+3]]);
+                        simd4f t;
+                        t.load(&thresh[k]);
+                        leaf += select(a - b > t, simd4f(0), simd4f(bit));
+                    }
+                    for (unsigned long j = 0; j < 4 && i+j < num_ferns; ++j)
+                        current_shape += forest[i+j].leaf_values[(unsigned long)leaf[j]];
+                }
+            }
+
+        private:
+            unsigned long num_ferns;
+            unsigned long depth;
+            // the splits at depth d of all the ferns are at [d*padded, (d+1)*padded)
+            std::vector<unsigned long> idx1;
+            std::vector<unsigned long> idx2;
+            std::vector<float> thresh;
+        };
+
+        class forest_layout
+        {
+            /*!
+                WHAT THIS OBJECT REPRESENTS
+                    The splits of the trees of a cascade level packed into one array of
+                    nodes with explicit children.  The trees are stored in an evaluation
+                    order that puts trees testing the same features next to each other,
+                    and the nodes of each tree are laid out depth first with the more
+                    often taken child first, so the usual path through a tree is one
+                    contiguous run of memory.  Only where the splits are looked at changes,
+                    the leaves are still added up in the order of the forest, so the result
+                    is exactly the same as walking the trees.
+
+                    It is made by reorder_shape_predictor_trees() from the branch counts
+                    of profile_shape_predictor_branches().
+            !*/
+        public:
+            forest_layout (
+            ) {}
+
+            forest_layout (
+                const std::vector<regression_tree>& forest,
+                const std::vector<unsigned long>& tree_order,
+                const std::vector<std::vector<unsigned long> >& visits
+            )
+            /*!
+                requires
+                    - tree_order is a permutation of the indices of forest.
+                    - visits.size() == 0 or visits.size() == forest.size()
+                    - for all valid i: visits[i].size() == forest[i].splits.size() +
+                      forest[i].leaf_values.size(), i.e. the number of times each node of
+                      tree i, numbered like left_child()/right_child() do with the leaves
+                      after the splits, was visited.
+                ensures
+                    - #empty() == (forest.size() == 0)
+                    - #get_tree_order() == tree_order
+            !*/
+            {
+                unsigned long num_nodes = 0;
+                for (unsigned long i = 0; i < forest.size(); ++i)
+                    num_nodes += forest[i].splits.size();
+                nodes.reserve(num_nodes);
+
+                tree_of = tree_order;
+                roots.resize(forest.size());
+                for (unsigned long e = 0; e < tree_of.size(); ++e)
+                {
+                    const regression_tree& tree = forest[tree_of[e]];
+                    const std::vector<unsigned long> no_visits;
+                    roots[e] = add_subtree(tree, visits.size() != 0 ? visits[tree_of[e]] : no_visits, 0, num_nodes);
+                }
+            }
+
+            bool empty (
+            ) const { return tree_of.size() == 0; }
+
+            const std::vector<unsigned long>& get_tree_order (
+            ) const { return tree_of; }
+
+            void operator() (
+                const std::vector<regression_tree>& forest,
+                const std::vector<float>& feature_pixel_values,
+                std::vector<unsigned long>& leaves,
+                matrix<float,0,1>& current_shape
+            ) const
+            /*!
+                requires
+                    - forest is the forest this object was made from
+                ensures
+                    - adds the leaf of every tree in forest to current_shape, in order.
+                      This gives exactly what adding forest[i](feature_pixel_values) for
+                      each i does.
+                    - leaves is scratch space.
+            !*/
+            {
+                const std::vector<float>& v = feature_pixel_values;
+                const uint32 num_nodes = nodes.size();
+                leaves.resize(tree_of.size());
+                for (unsigned long e = 0; e < tree_of.size(); ++e)
+                {
+                    uint32 n = roots[e];
+                    while (n < num_nodes)
+                    {
+                        const node& nd = nodes[n];
+                        n = v[nd.idx1] - v[nd.idx2] > nd.thresh ? nd.left : nd.right;
+                    }
+                    leaves[tree_of[e]] = n - num_nodes;
+                }
+                for (unsigned long i = 0; i < forest.size(); ++i)
+                    current_shape += forest[i].leaf_values[leaves[i]];
+            }
+
+            friend void serialize (const forest_layout& item, std::ostream& out)
+            {
+                dlib::serialize(item.nodes, out);
+                dlib::serialize(item.roots, out);
+                dlib::serialize(item.tree_of, out);
+            }
+            friend void deserialize (forest_layout& item, std::istream& in)
+            {
+                dlib::deserialize(item.nodes, in);
+                dlib::deserialize(item.roots, in);
+                dlib::deserialize(item.tree_of, in);
+            }
+
+        private:
+            struct node
+            {
+                // a child at or past nodes.size() is leaf child - nodes.size()
+                uint32 idx1;
+                uint32 idx2;
+                float thresh;
+                uint32 left;
+                uint32 right;
+
+                friend void serialize (const node& item, std::ostream& out)
+                {
+                    dlib::serialize(item.idx1, out);
+                    dlib::serialize(item.idx2, out);
+                    dlib::serialize(item.thresh, out);
+                    dlib::serialize(item.left, out);
+                    dlib::serialize(item.right, out);
+                }
+                friend void deserialize (node& item, std::istream& in)
+                {
+                    dlib::deserialize(item.idx1, in);
+                    dlib::deserialize(item.idx2, in);
+                    dlib::deserialize(item.thresh, in);
+                    dlib::deserialize(item.left, in);
+                    dlib::deserialize(item.right, in);
+                }
+            };
+
+            uint32 add_subtree (
+                const regression_tree& tree,
+                const std::vector<unsigned long>& visits,
+                unsigned long i,
+                unsigned long num_nodes
+            )
+            /*!
+                ensures
+                    - appends the subtree rooted at node i of tree to nodes, hot child
+                      first, and returns where node i went.
+            !*/
+            {
+                if (i >= tree.splits.size())
+                    return num_nodes + i - tree.splits.size();
+
+                const uint32 pos = nodes.size();
+                node nd;
+                nd.idx1 = tree.splits[i].idx1;
+                nd.idx2 = tree.splits[i].idx2;
+                nd.thresh = tree.splits[i].thresh;
+                nodes.push_back(nd);
+
+                const unsigned long l = left_child(i);
+                const unsigned long r = right_child(i);
+                if (visits.size() != 0 && visits[r] > visits[l])
+                {
+                    nodes[pos].right = add_subtree(tree, visits, r, num_nodes);
+                    nodes[pos].left = add_subtree(tree, visits, l, num_nodes);
+                }
+                else
+                {
+                    nodes[pos].left = add_subtree(tree, visits, l, num_nodes);
+                    nodes[pos].right = add_subtree(tree, visits, r, num_nodes);
+                }
+                return pos;
+            }
+
+            std::vector<node> nodes;
+            std::vector<uint32> roots;
+            std::vector<unsigned long> tree_of;  // tree_of[e] == the e-th tree evaluated
+        };
+
 
 
 
@@ -125,6 +443,72 @@ namespace dlib
         }
 
 
+    // ------------------------------------------------------------------------------------
+
+        inline matrix<float> leaf_value_basis (
+            const std::vector<regression_tree>& forest,
+            unsigned long basis_size
+        )
+        /*!
+            requires
+                - forest.size() > 0 and all its leaf values have the same size
+            ensures
+                - returns the top min(basis_size, leaf size) principal directions of all
+                  the leaf values in forest, as the orthonormal columns of a matrix.
+                  These are the directions that keep the most of the leaf values when
+                  they are projected onto them.
+        !*/
+        {
+            const long dims = forest[0].leaf_values[0].size();
+            matrix<double> scatter = zeros_matrix<double>(dims, dims);
+            for (unsigned long i = 0; i < forest.size(); ++i)
+            {
+                for (unsigned long j = 0; j < forest[i].leaf_values.size(); ++j)
+                {
+                    const matrix<double,0,1> leaf = matrix_cast<double>(forest[i].leaf_values[j]);
+                    scatter += leaf*trans(leaf);
+                }
+            }
+
+            eigenvalue_decomposition<matrix<double> > eig(make_symmetric(scatter));
+            const matrix<double,0,1> eigenvalues = eig.get_real_eigenvalues();
+            std::vector<std::pair<double,long> > order;
+            for (long i = 0; i < dims; ++i)
+                order.push_back(std::make_pair(-eigenvalues(i), i));
+            std::sort(order.begin(), order.end());
+
+            const long k = std::min<long>(basis_size, dims);
+            matrix<float> basis(dims, k);
+            for (long i = 0; i < k; ++i)
+                set_colm(basis, i) = matrix_cast<float>(colm(eig.get_pseudo_v(), order[i].second));
+            return basis;
+        }
+
+        inline std::vector<std::vector<regression_tree> > expand_leaf_values (
+            const std::vector<std::vector<regression_tree> >& forests,
+            const std::vector<matrix<float> >& leaf_bases
+        )
+        /*!
+            ensures
+                - returns forests with every leaf of forests[i] multiplied by
+                  leaf_bases[i], i.e. with full shape updates in the leaves again.  An
+                  empty leaf_bases, or an empty leaf_bases[i], leaves forests[i] alone.
+        !*/
+        {
+            std::vector<std::vector<regression_tree> > result(forests);
+            for (unsigned long i = 0; i < leaf_bases.size(); ++i)
+            {
+                if (leaf_bases[i].size() == 0)
+                    continue;
+                for (unsigned long j = 0; j < result[i].size(); ++j)
+                {
+                    for (unsigned long l = 0; l < result[i][j].leaf_values.size(); ++l)
+                        result[i][j].leaf_values[l] = leaf_bases[i]*result[i][j].leaf_values[l];
+                }
+            }
+            return result;
+        }
+
     // ------------------------------------------------------------------------------------
 
 
@@ -333,8 +717,24 @@ namespace dlib
         !*/
         {
             //[ANDY] tform_to_img: shape -> rect (img)
-            const point_transform_affine tform_to_img = unnormalizing_tform(rect);
+            extract_feature_pixel_values(img_, unnormalizing_tform(rect), current_shape, index, feature_pixel_values);
+        }
 
+        template <typename image_type>
+        void extract_feature_pixel_values (
+            const image_type& img_,
+            const point_transform_affine& tform_to_img,
+            const matrix<float,0,1>& current_shape,
+            const index_feature& index,
+            std::vector<float>& feature_pixel_values
+        )
+        /*!
+            ensures
+                - same as above except that the shape space is mapped into the image by
+                  tform_to_img instead of by the box of the object.  This is how the
+                  trainer looks at jittered and mirrored samples.
+        !*/
+        {
             const rectangle area = get_rect(img_);
             const_image_view<image_type> img(img_);
 
@@ -353,105 +753,1392 @@ namespace dlib
             }
         }
 
-    } // end namespace impl
-
-// ----------------------------------------------------------------------------------------
-
-    class shape_predictor
-    {
-    public:
-
-
-        shape_predictor (
-        ) 
-        {}
-
-        shape_predictor (
+    // ------------------------------------------------------------------------------------
 
-            const matrix<float,0,1>& initial_shape_,
-            const std::vector<std::vector<impl::regression_tree> >& forests_,
+        inline matrix<float,0,1> object_to_shape (
+            const full_object_detection& obj
+        )
+        {
+            matrix<float,0,1> shape(obj.num_parts()*2);
+            const point_transform_affine tform_from_img = normalizing_tform(obj.get_rect());
+            for (unsigned long i = 0; i < obj.num_parts(); ++i)
+            {
+                vector<float,2> p = tform_from_img(obj.part(i));
+                shape(2*i)   = p.x();
+                shape(2*i+1) = p.y();
+            }
+            return shape;
+        }
 
-            const std::vector<impl::index_feature> index_
+    // ------------------------------------------------------------------------------------
 
-        ) : initial_shape(initial_shape_), forests(forests_), index(index_)
+        // The random streams the trainer draws from.  Each one is seeded from the user's
+        // seed and the place it is used, so no stream depends on the order in which
+        // the others get consumed.
+        enum random_stream
+        {
+            initial_shape_stream,
+            feature_pool_stream,
+            split_stream,
+            augmentation_stream
+        };
 
-        //[ANDY] this constructor generates a shape_predictor, 
-        //       consisting forests/initial_shape/anchor_idx/ratio
+        inline uint64 splitmix64 (
+            uint64 x
+        )
+        {
+            x += 0x9E3779B97F4A7C15ULL;
+            x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27))*0x94D049BB133111EBULL;
+            return x ^ (x >> 31);
+        }
 
+        inline void seed_random_stream (
+            dlib::rand& rnd,
+            const std::string& seed,
+            random_stream stream,
+            unsigned long a,
+            unsigned long b = 0,
+            unsigned long c = 0
+        )
         /*!
-            requires
-                - initial_shape.size()%2 == 0
-                - forests.size() == pixel_coordinates.size() == the number of cascades
-                - for all valid i:
-                    - all the index values in forests[i] are less than pixel_coordinates[i].size()
-                - for all valid i and j: 
-                    - forests[i][j].leaf_values.size() is a power of 2.
-                      (i.e. we require a tree with all the levels fully filled out.
-                    - forests[i][j].leaf_values.size() == forests[i][j].splits.size()+1
-                      (i.e. there need to be the right number of leaves given the number of splits in the tree)
+            ensures
+                - seeds rnd with a mix of seed, stream, a, b and c.  Every split of every
+                  tree gets its own stream, so this runs often: the key is mixed with
+                  splitmix64 and handed to the twister as is, without set_seed(string)'s
+                  string hashing and 10000 discarded draws.
         !*/
-        {}
-
-        unsigned long num_parts (
-        ) const
         {
-            std::cout << "test" << std::endl;
-            return initial_shape.size()/2;
+            // FNV-1a of the user's seed string.
+            uint64 key = 0xCBF29CE484222325ULL;
+            for (std::string::size_type i = 0; i < seed.size(); ++i)
+                key = (key ^ static_cast<unsigned char>(seed[i]))*0x100000001B3ULL;
+            key = splitmix64(key ^ stream);
+            key = splitmix64(key ^ a);
+            key = splitmix64(key ^ b);
+            key = splitmix64(key ^ c);
+            rnd.set_seed(static_cast<uint32>(key ^ (key >> 32)));
         }
 
-        template <typename image_type>
-        full_object_detection operator()(
-            const image_type& img,
-            const rectangle& rect
-        ) const
+    // ------------------------------------------------------------------------------------
+
+        inline split_feature randomly_generate_split_feature (
+            dlib::rand& rnd,
+
+            //[ANDY] outpu >>
+            const index_feature& index,
+        
+            //[ANDY] input >>
+            const matrix<float, 0,1>& shape,
+            unsigned long feature_pool_size,
+            double lambda
+        )
+        //[ANDY] generate split feature for one cascade, pixel_coordinates is replaced by ratio and anchor
         {
-            using namespace impl;
-            matrix<float,0,1> current_shape = initial_shape;
-            std::vector<float> feature_pixel_values;
+            split_feature feat;
 
-            //[ANDY] iter->cascade, i->individual trees
-            for (unsigned long iter = 0; iter < forests.size(); ++iter)
+            double accept_prob;
+            do 
             {
-                extract_feature_pixel_values(img, rect, current_shape, index[iter], feature_pixel_values);
-                // evaluate all the trees at this level of the cascade.
-                for (unsigned long i = 0; i < forests[iter].size(); ++i)
-                    current_shape += forests[iter][i](feature_pixel_values);
-            }
+                feat.idx1   = rnd.get_random_32bit_number()%feature_pool_size;
+                feat.idx2   = rnd.get_random_32bit_number()%feature_pool_size;
 
-            // convert the current_shape into a full_object_detection
-            const point_transform_affine tform_to_img = unnormalizing_tform(rect);
+                //[ANDY] dist = ||u-v||
+                const double dist = length(
+                    index.p_location(shape, feat.idx1) - index.p_location(shape, feat.idx2)
+                );
 
-            std::vector<point> parts(current_shape.size()/2);
+                accept_prob = std::exp(-dist/lambda);
+            }
+            while( feat.idx1 == feat.idx2 || !(accept_prob > rnd.get_random_double()));
 
-            for (unsigned long i = 0; i < parts.size(); ++i)
-                parts[i] = tform_to_img(location(current_shape, i));
-            return full_object_detection(rect, parts);
-        }
+            feat.thresh = (rnd.get_random_double()*256 - 128)/2.0;
 
-        friend void serialize (const shape_predictor& item, std::ostream& out)
-        {
-            int version = 1;
-            dlib::serialize(version, out);
-            dlib::serialize(item.initial_shape, out);
-            dlib::serialize(item.forests, out);
-            dlib::serialize(item.index, out);
-        }
-        friend void deserialize (shape_predictor& item, std::istream& in)
-        {
-            int version = 0;
-            dlib::deserialize(version, in);
-            if (version != 1)
-                throw serialization_error("Unexpected version found while deserializing dlib::shape_predictor.");
-            dlib::deserialize(item.initial_shape, in);
-            dlib::deserialize(item.forests, in);
-            dlib::deserialize(item.index, in);
+            return feat;
         }
 
-    private:
-        matrix<float,0,1> initial_shape;
-        std::vector< std::vector<impl::regression_tree> > forests;
-        std::vector< impl::index_feature > index;
-    };
+    // ------------------------------------------------------------------------------------
+
+        inline unsigned long select_best_split (
+            const matrix<float,0,1>& sum,
+            unsigned long num,
+            std::vector<matrix<float,0,1> >& left_sums,
+            const std::vector<unsigned long>& left_cnt,
+            matrix<float,0,1>& left_sum,
+            matrix<float,0,1>& right_sum 
+        )
+        /*!
+            requires
+                - sum == the sum of the residuals of the num samples in a tree node
+                - left_sums[i], left_cnt[i] == the sum and count of the residuals that go
+                  left under the i-th candidate split.
+            ensures
+                - returns the index of the candidate that best splits the node.
+                - #left_sum and #right_sum are the residual sums of its two children.
+        !*/
+        {
+            matrix<float,0,1> temp;
+            // now figure out which feature is the best
+            double best_score = -1;
+            unsigned long best_feat = 0;
+            for (unsigned long i = 0; i < left_sums.size(); ++i)
+            {
+                // check how well the feature splits the space.
+                double score = 0;
+                unsigned long right_cnt = num-left_cnt[i];
+                if (left_cnt[i] != 0 && right_cnt != 0)
+                {
+                    temp = sum - left_sums[i];
+                    score = dot(left_sums[i],left_sums[i])/left_cnt[i] + dot(temp,temp)/right_cnt;
+                    if (score > best_score)
+                    {
+                        best_score = score;
+                        best_feat = i;
+                    }
+                }
+            }
+
+            left_sums[best_feat].swap(left_sum);
+            if (left_sum.size() != 0)
+            {
+                right_sum = sum - left_sum;
+            }
+            else
+            {
+                right_sum = sum;
+                left_sum = zeros_matrix(sum);
+            }
+            return best_feat;
+        }
+
+    // ------------------------------------------------------------------------------------
+
+        inline void sample_pixel_coordinates (
+            dlib::rand& rnd,
+            //-------------------------------------------
+            index_feature& index,
+            //-------------------------------------------
+            const matrix<float, 0,1>& shape,
+            unsigned long feature_pool_size
+        )
+        {
+            index.set_size( feature_pool_size );
+
+            for (unsigned long i = 0; i < feature_pool_size; ++i) 
+            {
+                double alpha_new = rnd.get_random_double()*(0.5);           
+                double beta_new  = rnd.get_random_double()*(0.5);
+
+                unsigned long id0;  unsigned long id1;  unsigned long id2;
+
+                do
+                {
+                    id0 = rnd.get_random_32bit_number() % ( (shape.size())/2 );
+                    id1 = rnd.get_random_32bit_number() % ( (shape.size())/2 );
+                    id2 = rnd.get_random_32bit_number() % ( (shape.size())/2 );
+                }
+                while ( id0==id1 || id1==id2 || id2==id0 );
+
+                index.assign( i, id0, id1, id2, alpha_new, beta_new );
+
+            }
+        }
+
+    // ------------------------------------------------------------------------------------
+
+        struct augmentation
+        {
+            /*!
+                WHAT THIS OBJECT REPRESENTS
+                    How one training sample is perturbed from the object it comes from.
+                    The sample's box is the object's box moved by (dx,dy) box sizes and
+                    scaled by scale about its center.  If mirrored is true the image and
+                    the landmarks are also flipped left to right inside that box.
+            !*/
+
+            augmentation() : mirrored(false), dx(0), dy(0), scale(1) {}
+
+            bool is_identity (
+            ) const { return !mirrored && dx == 0 && dy == 0 && scale == 1; }
+
+            bool mirrored;
+            float dx;
+            float dy;
+            float scale;
+
+            friend void serialize (const augmentation& item, std::ostream& out)
+            {
+                dlib::serialize(item.mirrored, out);
+                dlib::serialize(item.dx, out);
+                dlib::serialize(item.dy, out);
+                dlib::serialize(item.scale, out);
+            }
+            friend void deserialize (augmentation& item, std::istream& in)
+            {
+                dlib::deserialize(item.mirrored, in);
+                dlib::deserialize(item.dx, in);
+                dlib::deserialize(item.dy, in);
+                dlib::deserialize(item.scale, in);
+            }
+        };
+
+        struct training_sample
+        {
+            /*!
+
+            CONVENTION
+                - feature_pixel_values.size() == get_feature_pool_size()
+                - feature_pixel_values[j] == the value of the j-th feature pool
+                  pixel when you look it up relative to the shape in current_shape.
+
+                - object_idx == the object in the training_objects table this sample
+                  is made from and aug == how it is perturbed.  The sample's box and
+                  truth shape are worked out from these two when needed instead of being
+                  stored, so every extra sample only costs its current_shape,
+                  diff_shape and feature_pixel_values.
+                - diff_shape == truth shape - current_shape as of the start of the tree
+                  currently being fit.
+                - image_idx == the image the object is in.
+            !*/
+
+            unsigned long image_idx;
+            unsigned long object_idx;
+            augmentation aug;
+
+            matrix<float,0,1> current_shape;
+            matrix<float,0,1> diff_shape;
+            std::vector<float> feature_pixel_values;
+
+            void swap(training_sample& item)
+            {
+                std::swap(image_idx, item.image_idx);
+                std::swap(object_idx, item.object_idx);
+                std::swap(aug, item.aug);
+                current_shape.swap(item.current_shape);
+                diff_shape.swap(item.diff_shape);
+                feature_pixel_values.swap(item.feature_pixel_values);
+            }
+
+            // diff_shape and feature_pixel_values are recomputed for every tree and
+            // cascade so we don't bother saving them.
+            friend void serialize (const training_sample& item, std::ostream& out)
+            {
+                dlib::serialize(item.image_idx, out);
+                dlib::serialize(item.object_idx, out);
+                serialize(item.aug, out);
+                dlib::serialize(item.current_shape, out);
+            }
+            friend void deserialize (training_sample& item, std::istream& in)
+            {
+                dlib::deserialize(item.image_idx, in);
+                dlib::deserialize(item.object_idx, in);
+                deserialize(item.aug, in);
+                dlib::deserialize(item.current_shape, in);
+            }
+        };
+
+        class training_objects
+        {
+            /*!
+                WHAT THIS OBJECT REPRESENTS
+                    The boxes and truth shapes of the training objects.  They are stored
+                    once per object and shared by all the samples made from it.  Given a
+                    sample, this object works out the sample's truth shape and the
+                    transform from the sample's shape space to image pixels.
+            !*/
+        public:
+            void clear (
+            ) { rects.clear(); targets.clear(); }
+
+            void add (
+                const full_object_detection& obj
+            )
+            {
+                rects.push_back(obj.get_rect());
+                targets.push_back(object_to_shape(obj));
+            }
+
+            unsigned long size (
+            ) const { return rects.size(); }
+
+            void set_mirror_permutation (
+                const std::vector<unsigned long>& perm
+            ) { mirror_perm = perm; }
+
+            const matrix<float,0,1>& target_shape (
+                unsigned long object_idx
+            ) const { return targets[object_idx]; }
+
+            void residual (
+                const training_sample& s,
+                matrix<float,0,1>& diff
+            ) const
+            /*!
+                ensures
+                    - #diff == the truth shape of s minus s.current_shape.
+            !*/
+            {
+                const matrix<float,0,1>& target = targets[s.object_idx];
+                if (s.aug.is_identity())
+                {
+                    diff = target - s.current_shape;
+                    return;
+                }
+
+                // Map the object's truth into the perturbed box.  In the object's shape
+                // space that box is centered at (0.5+dx, 0.5+dy) and is scale wide.
+                diff.set_size(target.size());
+                const float cx = 0.5f + s.aug.dx;
+                const float cy = 0.5f + s.aug.dy;
+                for (long k = 0; k < target.size()/2; ++k)
+                {
+                    const long src = s.aug.mirrored ? mirror_perm[k] : k;
+                    float u = (target(2*src) - cx)/s.aug.scale;
+                    const float v = (target(2*src+1) - cy)/s.aug.scale;
+                    if (s.aug.mirrored)
+                        u = -u;
+                    diff(2*k)   = 0.5f + u - s.current_shape(2*k);
+                    diff(2*k+1) = 0.5f + v - s.current_shape(2*k+1);
+                }
+            }
+
+            point_transform_affine tform_to_img (
+                const training_sample& s
+            ) const
+            /*!
+                ensures
+                    - returns the transform from the shape space of s to pixels in the
+                      image s is in.
+            !*/
+            {
+                const point_transform_affine to_img = unnormalizing_tform(rects[s.object_idx]);
+                if (s.aug.is_identity())
+                    return to_img;
+
+                matrix<double,2,2> m;
+                m = (s.aug.mirrored ? -s.aug.scale : s.aug.scale), 0,
+                    0, s.aug.scale;
+                const dlib::vector<double,2> b(0.5 + s.aug.dx - 0.5*m(0,0), 0.5 + s.aug.dy - 0.5*m(1,1));
+                return to_img*point_transform_affine(m, b);
+            }
+
+        private:
+            std::vector<rectangle> rects;
+            std::vector<matrix<float,0,1> > targets;
+            std::vector<unsigned long> mirror_perm;
+        };
+
+        struct training_state
+        {
+            /*!
+                CONVENTION
+                    - the first cascades_done entries of forests are complete.
+                    - objects holds the truth of samples.  It is rebuilt from the
+                      training data rather than checkpointed.
+                    - samples[i].current_shape == where the model built so far moves the
+                      i-th sample.  The order of samples matters since tree fitting
+                      partitions them in place.
+                    - if (features_cascade != -1) then the feature_pixel_values of the
+                      samples are already extracted for cascade level features_cascade.
+                      They are not checkpointed, so a loaded state always has -1.
+                    - component_initial_shapes[k] == the mean shape of the objects of
+                      detector component k, or empty if there are none.  It is empty if
+                      training wasn't given components.
+                    - stopped_early == true if early stopping ended the run after
+                      cascades_done cascades, so resuming must not add any more.
+            !*/
+
+            training_state() : cascades_done(0), features_cascade(-1), stopped_early(false) {}
+
+            training_objects objects;
+            matrix<float,0,1> initial_shape;
+            std::vector<matrix<float,0,1> > component_initial_shapes;
+            std::vector<index_feature> index;
+            std::vector<std::vector<regression_tree> > forests;
+            std::vector<training_sample> samples;
+            unsigned long cascades_done;
+            long features_cascade;
+            bool stopped_early;
+        };
+
+    // ------------------------------------------------------------------------------------
+
+        inline double mean_training_residual (
+            const training_objects& objects,
+            const std::vector<training_sample>& samples
+        )
+        /*!
+            ensures
+                - returns the mean distance between the current and the target position
+                  of a landmark over all the samples, in normalized shape coordinates.
+        !*/
+        {
+            double sum = 0;
+            unsigned long count = 0;
+            matrix<float,0,1> diff;
+            for (unsigned long i = 0; i < samples.size(); ++i)
+            {
+                objects.residual(samples[i], diff);
+                for (long k = 0; k+1 < diff.size(); k += 2)
+                {
+                    const double dx = diff(k);
+                    const double dy = diff(k+1);
+                    sum += std::sqrt(dx*dx + dy*dy);
+                    ++count;
+                }
+            }
+            return count == 0 ? 0 : sum/count;
+        }
+
+        inline unsigned long peak_resident_memory (
+        )
+        /*!
+            ensures
+                - returns the peak resident set size of this process in bytes, or 0 if
+                  the platform doesn't tell us.
+        !*/
+        {
+#if defined(__APPLE__)
+            rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) == 0)
+                return usage.ru_maxrss;
+#elif defined(__unix__)
+            rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) == 0)
+                return usage.ru_maxrss*1024UL;
+#endif
+            return 0;
+        }
+
+    // ------------------------------------------------------------------------------------
+
+        template <typename image_array, typename sample_type>
+        struct extract_sample_features
+        {
+            //[TIF] refreshes the feature_pixel_values of one training sample, the image is
+            //      looked up in an image_array that holds every decoded training image.
+            extract_sample_features (
+                const image_array& images_,
+                const training_objects& objects_,
+                std::vector<sample_type>& samples_,
+                const index_feature& index_
+            ) : images(images_), objects(objects_), samples(samples_), index(index_) {}
+
+            void operator() (long i) const
+            {
+                extract_feature_pixel_values(
+                    images[samples[i].image_idx], objects.tform_to_img(samples[i]), samples[i].current_shape,
+                    index, samples[i].feature_pixel_values
+                );
+            }
+
+            const image_array& images;
+            const training_objects& objects;
+            std::vector<sample_type>& samples;
+            const index_feature& index;
+        };
+
+        template <typename image_array>
+        class in_memory_feature_extractor
+        {
+            /*!
+                WHAT THIS OBJECT REPRESENTS
+                    Computes the feature_pixel_values of all the training samples for one
+                    cascade level when all the training images are already decoded and held
+                    in an image_array.
+            !*/
+        public:
+            explicit in_memory_feature_extractor (
+                const image_array& images_
+            ) : images(images_) {}
+
+            template <typename sample_type>
+            void operator() (
+                thread_pool& tp,
+                const training_objects& objects,
+                std::vector<sample_type>& samples,
+                const index_feature& index
+            ) const
+            {
+                parallel_for(tp, 0, samples.size(),
+                    extract_sample_features<image_array,sample_type>(images, objects, samples, index));
+            }
+
+        private:
+            const image_array& images;
+        };
+
+    // ------------------------------------------------------------------------------------
+
+        template <typename image_source, typename sample_type>
+        struct stream_image_features
+        {
+            //[TIF] decodes one image and refreshes the feature_pixel_values of every
+            //      training sample that lives in it.  Images with an index below
+            //      cache.size() are decoded once and then kept in the cache.
+            typedef typename image_source::image_type image_type;
+
+            stream_image_features (
+                const image_source& source_,
+                std::vector<image_type>& cache_,
+                std::vector<char>& cached_,
+                const std::vector<std::vector<unsigned long> >& samples_of_image_,
+                const training_objects& objects_,
+                std::vector<sample_type>& samples_,
+                const index_feature& index_,
+                std::vector<std::string>& errors_
+            ) : source(source_), cache(cache_), cached(cached_), samples_of_image(samples_of_image_),
+                objects(objects_), samples(samples_), index(index_), errors(errors_) {}
+
+            void operator() (long i) const
+            {
+                const std::vector<unsigned long>& ids = samples_of_image[i];
+                if (ids.size() == 0)
+                    return;
+
+                try
+                {
+                    image_type temp;
+                    const image_type* img = &temp;
+                    if (static_cast<unsigned long>(i) < cache.size())
+                    {
+                        if (!cached[i])
+                        {
+                            source(i, cache[i]);
+                            cached[i] = 1;
+                        }
+                        img = &cache[i];
+                    }
+                    else
+                    {
+                        source(i, temp);
+                    }
+
+                    for (unsigned long j = 0; j < ids.size(); ++j)
+                    {
+                        sample_type& s = samples[ids[j]];
+                        extract_feature_pixel_values(*img, objects.tform_to_img(s), s.current_shape, index, s.feature_pixel_values);
+                    }
+                }
+                catch (std::exception& e)
+                {
+                    errors[i] = e.what();
+                }
+            }
+
+            const image_source& source;
+            std::vector<image_type>& cache;
+            std::vector<char>& cached;
+            const std::vector<std::vector<unsigned long> >& samples_of_image;
+            const training_objects& objects;
+            std::vector<sample_type>& samples;
+            const index_feature& index;
+            std::vector<std::string>& errors;
+        };
+
+        template <typename image_source>
+        class streaming_feature_extractor
+        {
+            /*!
+                WHAT THIS OBJECT REPRESENTS
+                    Computes the feature_pixel_values of all the training samples for one
+                    cascade level while decoding the training images on demand.  Each image
+                    is decoded at most once per cascade, the images are processed in
+                    parallel, and at most one decoded image per worker thread plus the
+                    first cache_size images are resident at any time.
+            !*/
+        public:
+            typedef typename image_source::image_type image_type;
+
+            streaming_feature_extractor (
+                const image_source& source_,
+                unsigned long cache_size
+            ) : source(source_),
+                cache(std::min<unsigned long>(cache_size, source_.size())),
+                cached(cache.size(), 0)
+            {}
+
+            template <typename sample_type>
+            void operator() (
+                thread_pool& tp,
+                const training_objects& objects,
+                std::vector<sample_type>& samples,
+                const index_feature& index
+            ) const
+            {
+                // The samples get shuffled around while the trees are fit, so regroup
+                // them by image every time we come through here.
+                std::vector<std::vector<unsigned long> > samples_of_image(source.size());
+                for (unsigned long i = 0; i < samples.size(); ++i)
+                    samples_of_image[samples[i].image_idx].push_back(i);
+
+                std::vector<std::string> errors(source.size());
+                parallel_for(tp, 0, source.size(),
+                    stream_image_features<image_source,sample_type>(
+                        source, cache, cached, samples_of_image, objects, samples, index, errors), 1);
+
+                for (unsigned long i = 0; i < errors.size(); ++i)
+                {
+                    if (errors[i].size() != 0)
+                        throw error("Unable to load training image " + cast_to_string(i) + ": " + errors[i]);
+                }
+            }
+
+        private:
+            const image_source& source;
+            mutable std::vector<image_type> cache;
+            mutable std::vector<char> cached;
+        };
+
+    } // end namespace impl
+
+// ----------------------------------------------------------------------------------------
+
+    template <typename image_type_ = array2d<unsigned char> >
+    class file_list_image_source
+    {
+        /*!
+            WHAT THIS OBJECT REPRESENTS
+                This is an image source for shape_predictor_trainer::train_streaming().
+                It decodes the i-th training image from the i-th file in a list of image
+                files, using a loader function such as dlib::load_image().  Loading is
+                thread safe as long as the loader is.
+        !*/
+    public:
+        typedef image_type_ image_type;
+        typedef void (*loader_type)(image_type&, const std::string&);
+
+        file_list_image_source (
+            const std::vector<std::string>& filenames_,
+            loader_type loader_
+        ) : filenames(filenames_), loader(loader_) {}
+
+        unsigned long size (
+        ) const { return filenames.size(); }
+
+        void operator() (
+            unsigned long idx,
+            image_type& img
+        ) const
+        {
+            loader(img, filenames[idx]);
+        }
+
+    private:
+        std::vector<std::string> filenames;
+        loader_type loader;
+    };
+
+// ----------------------------------------------------------------------------------------
+
+    class shape_predictor
+    {
+    public:
+
+
+        shape_predictor (
+        ) 
+        {}
+
+        shape_predictor (
+
+            const matrix<float,0,1>& initial_shape_,
+            const std::vector<std::vector<impl::regression_tree> >& forests_,
+
+            const std::vector<impl::index_feature> index_
+
+        ) : initial_shape(initial_shape_), forests(forests_), index(index_)
+
+        //[ANDY] this constructor generates a shape_predictor, 
+        //       consisting forests/initial_shape/anchor_idx/ratio
+
+        /*!
+            requires
+                - initial_shape.size()%2 == 0
+                - forests.size() == pixel_coordinates.size() == the number of cascades
+                - for all valid i:
+                    - all the index values in forests[i] are less than pixel_coordinates[i].size()
+                - for all valid i and j: 
+                    - forests[i][j].leaf_values.size() is a power of 2.
+                      (i.e. we require a tree with all the levels fully filled out.
+                    - forests[i][j].leaf_values.size() == forests[i][j].splits.size()+1
+                      (i.e. there need to be the right number of leaves given the number of splits in the tree)
+        !*/
+        {
+            make_fern_levels();
+        }
+
+        shape_predictor (
+            const matrix<float,0,1>& initial_shape_,
+            const std::vector<std::vector<impl::regression_tree> >& forests_,
+            const std::vector<impl::index_feature>& index_,
+            const std::vector<matrix<float> >& leaf_bases_,
+            const std::vector<matrix<float,0,1> >& component_initial_shapes_ = std::vector<matrix<float,0,1> >(),
+            const std::vector<impl::forest_layout>& forest_layouts_ = std::vector<impl::forest_layout>()
+        ) : initial_shape(initial_shape_), forests(forests_), index(index_), leaf_bases(leaf_bases_),
+            component_initial_shapes(component_initial_shapes_), forest_layouts(forest_layouts_)
+        /*!
+            requires
+                - same as above, and also:
+                - leaf_bases.size() == 0 or leaf_bases.size() == forests.size()
+                - for all valid i where leaf_bases[i].size() != 0:
+                    - leaf_bases[i].nr() == initial_shape.size()
+                    - the leaf values of forests[i] hold leaf_bases[i].nc() coefficients
+                      and the shape update of a leaf is leaf_bases[i] times them.
+                - for all valid i: component_initial_shapes[i].size() == 0 or
+                  component_initial_shapes[i].size() == initial_shape.size()
+                - forest_layouts.size() == 0 or forest_layouts.size() == forests.size()
+                - for all valid i: forest_layouts[i] is empty or was made from forests[i]
+                  (or a forest with the same splits).
+        !*/
+        {
+            make_fern_levels();
+        }
+
+        unsigned long num_parts (
+        ) const
+        {
+            std::cout << "test" << std::endl;
+            return initial_shape.size()/2;
+        }
+
+        const matrix<float,0,1>& get_initial_shape (
+        ) const { return initial_shape; }
+
+        const std::vector<std::vector<impl::regression_tree> >& get_forests (
+        ) const { return forests; }
+
+        const std::vector<impl::index_feature>& get_index (
+        ) const { return index; }
+
+        const std::vector<matrix<float> >& get_leaf_bases (
+        ) const
+        /*!
+            ensures
+                - returns the low rank leaf bases (see compress_shape_predictor_leaves()).
+                  It is empty if every leaf holds a full shape update.
+        !*/
+        {
+            return leaf_bases;
+        }
+
+        const std::vector<matrix<float,0,1> >& get_component_initial_shapes (
+        ) const
+        /*!
+            ensures
+                - returns the initial shapes learned for the components of the object
+                  detector (see shape_predictor_trainer::train() with components).  An
+                  empty entry, or a component past the end, uses get_initial_shape().
+        !*/
+        {
+            return component_initial_shapes;
+        }
+
+        const std::vector<impl::forest_layout>& get_forest_layouts (
+        ) const
+        /*!
+            ensures
+                - returns the profile guided memory layouts of the cascade levels (see
+                  reorder_shape_predictor_trees()).  It is empty if the trees are walked
+                  as they are stored.
+        !*/
+        {
+            return forest_layouts;
+        }
+
+        template <typename image_type>
+        full_object_detection operator()(
+            const image_type& img,
+            const rectangle& rect
+        ) const
+        {
+            return (*this)(img, rect, component_initial_shapes.size());
+        }
+
+        template <typename image_type>
+        full_object_detection operator()(
+            const image_type& img,
+            const rectangle& rect,
+            unsigned long component
+        ) const
+        /*!
+            ensures
+                - same as operator()(img, rect) except that the search starts from the
+                  initial shape of the given detector component, e.g. the weight_index of
+                  the rect_detection rect came from.
+        !*/
+        {
+            using namespace impl;
+            matrix<float,0,1> current_shape = component < component_initial_shapes.size() && 
+                                              component_initial_shapes[component].size() != 0 ?
+                                              component_initial_shapes[component] : initial_shape;
+            std::vector<float> feature_pixel_values;
+            std::vector<unsigned long> leaves;
+            matrix<float,0,1> coefficients;
+
+            //[ANDY] iter->cascade, i->individual trees
+            for (unsigned long iter = 0; iter < forests.size(); ++iter)
+            {
+                extract_feature_pixel_values(img, rect, current_shape, index[iter], feature_pixel_values);
+
+                //[TIF] with a leaf basis the trees only add up basis coefficients, which
+                //      are expanded into a shape update once per cascade.
+                const bool low_rank = leaf_bases.size() != 0 && leaf_bases[iter].size() != 0;
+                matrix<float,0,1>& sum = low_rank ? coefficients : current_shape;
+                if (low_rank)
+                {
+                    coefficients.set_size(leaf_bases[iter].nc());
+                    coefficients = 0;
+                }
+
+                // evaluate all the trees at this level of the cascade.
+                if (!ferns[iter].empty())
+                {
+                    ferns[iter](forests[iter], feature_pixel_values, sum);
+                }
+                else if (forest_layouts.size() != 0 && !forest_layouts[iter].empty())
+                {
+                    forest_layouts[iter](forests[iter], feature_pixel_values, leaves, sum);
+                }
+                else
+                {
+                    for (unsigned long i = 0; i < forests[iter].size(); ++i)
+                        sum += forests[iter][i](feature_pixel_values);
+                }
+
+                if (low_rank)
+                    current_shape += leaf_bases[iter]*coefficients;
+            }
+
+            // convert the current_shape into a full_object_detection
+            const point_transform_affine tform_to_img = unnormalizing_tform(rect);
+
+            std::vector<point> parts(current_shape.size()/2);
+
+            for (unsigned long i = 0; i < parts.size(); ++i)
+                parts[i] = tform_to_img(location(current_shape, i));
+            return full_object_detection(rect, parts);
+        }
+
+        friend void serialize (const shape_predictor& item, std::ostream& out)
+        {
+            // models without leaf bases, component shapes or layouts keep the original format
+            int version = 1;
+            if (item.forest_layouts.size() != 0)
+                version = 4;
+            else if (item.component_initial_shapes.size() != 0)
+                version = 3;
+            else if (item.leaf_bases.size() != 0)
+                version = 2;
+            dlib::serialize(version, out);
+            dlib::serialize(item.initial_shape, out);
+            dlib::serialize(item.forests, out);
+            dlib::serialize(item.index, out);
+            if (version >= 2)
+                dlib::serialize(item.leaf_bases, out);
+            if (version >= 3)
+                dlib::serialize(item.component_initial_shapes, out);
+            if (version >= 4)
+                dlib::serialize(item.forest_layouts, out);
+        }
+        friend void deserialize (shape_predictor& item, std::istream& in)
+        {
+            int version = 0;
+            dlib::deserialize(version, in);
+            if (version < 1 || version > 4)
+                throw serialization_error("Unexpected version found while deserializing dlib::shape_predictor.");
+            dlib::deserialize(item.initial_shape, in);
+            dlib::deserialize(item.forests, in);
+            dlib::deserialize(item.index, in);
+            item.leaf_bases.clear();
+            item.component_initial_shapes.clear();
+            item.forest_layouts.clear();
+            if (version >= 2)
+                dlib::deserialize(item.leaf_bases, in);
+            if (version >= 3)
+                dlib::deserialize(item.component_initial_shapes, in);
+            if (version >= 4)
+                dlib::deserialize(item.forest_layouts, in);
+            item.make_fern_levels();
+        }
+
+    private:
+        void make_fern_levels (
+        )
+        {
+            //[TIF] cascade levels made of ferns get the SIMD evaluator.
+            ferns.clear();
+            for (unsigned long i = 0; i < forests.size(); ++i)
+                ferns.push_back(impl::fern_level(forests[i]));
+        }
+
+        matrix<float,0,1> initial_shape;
+        std::vector< std::vector<impl::regression_tree> > forests;
+        std::vector< impl::index_feature > index;
+        std::vector< matrix<float> > leaf_bases;
+        std::vector< matrix<float,0,1> > component_initial_shapes;
+        std::vector< impl::forest_layout > forest_layouts;
+        std::vector< impl::fern_level > ferns;
+    };
+
+// ----------------------------------------------------------------------------------------
+
+    inline shape_predictor compress_shape_predictor_leaves (
+        const shape_predictor& sp,
+        unsigned long basis_size
+    )
+    /*!
+        requires
+            - basis_size > 0
+        ensures
+            - returns a copy of sp where the leaf values of each cascade level are
+              projected onto the top basis_size principal directions of that level's leaf
+              values (see get_leaf_bases()).  Each tree then adds basis_size coefficients
+              instead of a full shape update and the shape update is formed once per
+              cascade level.
+            - This is lossy.  The smaller basis_size the faster and smaller the model
+              and the larger its error.  A basis_size of at least 2*num parts loses
+              nothing but rounding.
+            - sp may already be compressed, in which case it is expanded first.
+    !*/
+    {
+        DLIB_CASSERT(basis_size > 0,
+            "\t shape_predictor compress_shape_predictor_leaves()"
+            << "\n\t Invalid inputs were given to this function. "
+            << "\n\t basis_size: " << basis_size
+        );
+
+        std::vector<std::vector<impl::regression_tree> > forests = impl::expand_leaf_values(sp.get_forests(), sp.get_leaf_bases());
+        std::vector<matrix<float> > leaf_bases(forests.size());
+        for (unsigned long i = 0; i < forests.size(); ++i)
+        {
+            if (forests[i].size() == 0)
+                continue;
+            leaf_bases[i] = impl::leaf_value_basis(forests[i], basis_size);
+            for (unsigned long j = 0; j < forests[i].size(); ++j)
+            {
+                for (unsigned long l = 0; l < forests[i][j].leaf_values.size(); ++l)
+                    forests[i][j].leaf_values[l] = trans(leaf_bases[i])*forests[i][j].leaf_values[l];
+            }
+        }
+        return shape_predictor(sp.get_initial_shape(), forests, sp.get_index(), leaf_bases, 
+                               sp.get_component_initial_shapes(), sp.get_forest_layouts());
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename image_array
+        >
+    std::vector<std::vector<std::vector<unsigned long> > > profile_shape_predictor_branches (
+        const shape_predictor& sp,
+        const image_array& images,
+        const std::vector<std::vector<full_object_detection> >& objects,
+        const std::vector<std::vector<unsigned long> >& components
+    )
+    /*!
+        requires
+            - images.size() == objects.size()
+            - components.size() == objects.size()
+            - for all valid i: components[i].size() == objects[i].size()
+        ensures
+            - runs sp on the boxes of objects (their parts aren't needed), starting each
+              from the initial shape of its detector component like
+              sp(img, rect, components[i][j]) does, and returns how often each tree node
+              is visited.  That is, #visits[i][j][n] is the number of times node n of
+              the j-th tree of cascade level i was visited, with the splits numbered as
+              left_child()/right_child() do and the leaves after them.  This is what
+              reorder_shape_predictor_trees() wants.
+    !*/
+    {
+        DLIB_CASSERT(images.size() == objects.size() && components.size() == objects.size(),
+            "\t profile_shape_predictor_branches()"
+            << "\n\t Invalid inputs were given to this function. "
+            << "\n\t images.size():     " << images.size() 
+            << "\n\t objects.size():    " << objects.size() 
+            << "\n\t components.size(): " << components.size() 
+        );
+
+        using namespace impl;
+        const std::vector<std::vector<regression_tree> > forests = expand_leaf_values(sp.get_forests(), sp.get_leaf_bases());
+        std::vector<std::vector<std::vector<unsigned long> > > visits(forests.size());
+        for (unsigned long i = 0; i < forests.size(); ++i)
+        {
+            visits[i].resize(forests[i].size());
+            for (unsigned long j = 0; j < forests[i].size(); ++j)
+                visits[i][j].assign(forests[i][j].splits.size() + forests[i][j].leaf_values.size(), 0);
+        }
+
+        std::vector<float> feature_pixel_values;
+        for (unsigned long k = 0; k < objects.size(); ++k)
+        {
+            DLIB_CASSERT(components[k].size() == objects[k].size(),
+                "\t profile_shape_predictor_branches()"
+                << "\n\t Every object needs a component."
+                << "\n\t objects["<<k<<"].size():    " << objects[k].size() 
+                << "\n\t components["<<k<<"].size(): " << components[k].size() 
+            );
+            for (unsigned long m = 0; m < objects[k].size(); ++m)
+            {
+                const unsigned long component = components[k][m];
+                const std::vector<matrix<float,0,1> >& component_shapes = sp.get_component_initial_shapes();
+                matrix<float,0,1> current_shape = component < component_shapes.size() && 
+                                                  component_shapes[component].size() != 0 ?
+                                                  component_shapes[component] : sp.get_initial_shape();
+                for (unsigned long i = 0; i < forests.size(); ++i)
+                {
+                    extract_feature_pixel_values(images[k], objects[k][m].get_rect(), current_shape, sp.get_index()[i], feature_pixel_values);
+                    for (unsigned long j = 0; j < forests[i].size(); ++j)
+                    {
+                        const regression_tree& tree = forests[i][j];
+                        unsigned long n = 0;
+                        while (n < tree.splits.size())
+                        {
+                            ++visits[i][j][n];
+                            const split_feature& split = tree.splits[n];
+                            if (feature_pixel_values[split.idx1] - feature_pixel_values[split.idx2] > split.thresh)
+                                n = left_child(n);
+                            else
+                                n = right_child(n);
+                        }
+                        ++visits[i][j][n];
+                        current_shape += tree.leaf_values[n - tree.splits.size()];
+                    }
+                }
+            }
+        }
+        return visits;
+    }
+
+    template <
+        typename image_array
+        >
+    std::vector<std::vector<std::vector<unsigned long> > > profile_shape_predictor_branches (
+        const shape_predictor& sp,
+        const image_array& images,
+        const std::vector<std::vector<full_object_detection> >& objects
+    )
+    /*!
+        requires
+            - images.size() == objects.size()
+        ensures
+            - same as above but every object starts from sp.get_initial_shape(), like
+              sp(img, rect) does.
+    !*/
+    {
+        std::vector<std::vector<unsigned long> > components(objects.size());
+        for (unsigned long i = 0; i < objects.size(); ++i)
+            components[i].assign(objects[i].size(), sp.get_component_initial_shapes().size());
+        return profile_shape_predictor_branches(sp, images, objects, components);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    inline shape_predictor reorder_shape_predictor_trees (
+        const shape_predictor& sp,
+        const std::vector<std::vector<std::vector<unsigned long> > >& visits
+    )
+    /*!
+        requires
+            - visits was made by profile_shape_predictor_branches() from sp.
+        ensures
+            - returns a copy of sp whose cascade levels are evaluated through
+              impl::forest_layout objects: every tree is laid out with its most visited
+              path first and trees that test overlapping sets of features are evaluated
+              one after the other.  The leaves are still added up in the original order
+              so the returned model predicts exactly what sp does.
+            - levels made of ferns keep their SIMD evaluator and are not laid out.
+    !*/
+    {
+        using namespace impl;
+        const std::vector<std::vector<regression_tree> >& forests = sp.get_forests();
+        DLIB_CASSERT(visits.size() == forests.size(),
+            "\t shape_predictor reorder_shape_predictor_trees()"
+            << "\n\t The branch counts don't come from this model."
+            << "\n\t visits.size():  " << visits.size() 
+            << "\n\t cascade levels: " << forests.size() 
+        );
+
+        std::vector<forest_layout> layouts(forests.size());
+        for (unsigned long i = 0; i < forests.size(); ++i)
+        {
+            const std::vector<regression_tree>& forest = forests[i];
+            if (forest.size() == 0 || !fern_level(forest).empty())
+                continue;
+
+            // the sorted features each tree tests
+            std::vector<std::vector<unsigned long> > features(forest.size());
+            for (unsigned long j = 0; j < forest.size(); ++j)
+            {
+                for (unsigned long n = 0; n < forest[j].splits.size(); ++n)
+                {
+                    features[j].push_back(forest[j].splits[n].idx1);
+                    features[j].push_back(forest[j].splits[n].idx2);
+                }
+                std::sort(features[j].begin(), features[j].end());
+                features[j].erase(std::unique(features[j].begin(), features[j].end()), features[j].end());
+            }
+
+            // Greedily chain the trees, each one followed by the unvisited tree that
+            // shares the most features with it.
+            std::vector<unsigned long> order(1, 0);
+            std::vector<bool> used(forest.size(), false);
+            used[0] = true;
+            std::vector<unsigned long> common;
+            while (order.size() < forest.size())
+            {
+                const std::vector<unsigned long>& last = features[order.back()];
+                unsigned long best = forest.size();
+                unsigned long best_overlap = 0;
+                for (unsigned long j = 0; j < forest.size(); ++j)
+                {
+                    if (used[j])
+                        continue;
+                    common.clear();
+                    std::set_intersection(last.begin(), last.end(), features[j].begin(), features[j].end(), std::back_inserter(common));
+                    if (best == forest.size() || common.size() > best_overlap)
+                    {
+                        best = j;
+                        best_overlap = common.size();
+                    }
+                }
+                used[best] = true;
+                order.push_back(best);
+            }
+
+            DLIB_CASSERT(visits[i].size() == forest.size(),
+                "\t shape_predictor reorder_shape_predictor_trees()"
+                << "\n\t The branch counts don't come from this model."
+                << "\n\t visits["<<i<<"].size(): " << visits[i].size() 
+                << "\n\t trees: " << forest.size() 
+            );
+            layouts[i] = forest_layout(forest, order, visits[i]);
+        }
+        return shape_predictor(sp.get_initial_shape(), forests, sp.get_index(), sp.get_leaf_bases(),
+                               sp.get_component_initial_shapes(), layouts);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    namespace impl
+    {
+        inline bool is_valid_landmark_subset (
+            const std::vector<unsigned long>& parts,
+            unsigned long num_parts
+        )
+        /*!
+            ensures
+                - returns true if parts is empty (i.e. no subset) or if it lists at least
+                  3 parts, each less than num_parts and none twice.  The features of a
+                  model are anchored on triplets of its parts, so with fewer than 3 there
+                  is nothing to sample them from.
+        !*/
+        {
+            if (parts.size() == 0)
+                return true;
+            if (parts.size() < 3 || std::set<unsigned long>(parts.begin(), parts.end()).size() != parts.size())
+                return false;
+            return *std::max_element(parts.begin(), parts.end()) < num_parts;
+        }
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    inline std::vector<std::vector<full_object_detection> > select_landmark_subset (
+        const std::vector<std::vector<full_object_detection> >& objects,
+        const std::vector<unsigned long>& parts
+    )
+    /*!
+        requires
+            - every element of parts is less than the number of parts of every object
+        ensures
+            - returns a copy of objects where each object only has the parts listed in
+              parts, in that order.  I.e. part k of #objects[i][j] is part parts[k] of
+              objects[i][j].  This is the ground truth a model trained with
+              shape_predictor_trainer::set_landmark_subset(parts) is measured against.
+    !*/
+    {
+        std::vector<std::vector<full_object_detection> > result(objects.size());
+        std::vector<point> subset(parts.size());
+        for (unsigned long i = 0; i < objects.size(); ++i)
+        {
+            for (unsigned long j = 0; j < objects[i].size(); ++j)
+            {
+                for (unsigned long k = 0; k < parts.size(); ++k)
+                {
+                    DLIB_CASSERT(parts[k] < objects[i][j].num_parts(),
+                        "\t std::vector<std::vector<full_object_detection> > select_landmark_subset()"
+                        << "\n\t Invalid inputs were given to this function. "
+                        << "\n\t parts["<<k<<"]: " << parts[k]
+                        << "\n\t objects["<<i<<"]["<<j<<"].num_parts(): " << objects[i][j].num_parts()
+                    );
+                    subset[k] = objects[i][j].part(parts[k]);
+                }
+                result[i].push_back(full_object_detection(objects[i][j].get_rect(), subset));
+            }
+        }
+        return result;
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    class shape_predictor_training_start
+    {
+        /*!
+            WHAT THIS OBJECT REPRESENTS
+                The part of training that only depends on the training data, the random
+                seed, the oversampling amount, the augmentation settings, the landmark
+                subset and the feature pool size.  That is the
+                initial shapes of all the training samples, the feature pool of the first
+                cascade level and the feature_pixel_values of every sample at that level.
+                It is made by shape_predictor_trainer::prepare_training() and can be given
+                to shape_predictor_trainer::train() any number of times, from any number
+                of threads, to skip that work when many models are trained on the same
+                data (e.g. in a hyperparameter sweep).
+        !*/
+    public:
+        shape_predictor_training_start (
+        ) : oversampling_amount(0), feature_pool_size(0), box_translation_jitter(0), box_scale_jitter(0) {}
+
+        const std::string& get_random_seed (
+        ) const { return random_seed; }
+
+        unsigned long get_oversampling_amount (
+        ) const { return oversampling_amount; }
+
+        unsigned long get_feature_pool_size (
+        ) const { return feature_pool_size; }
+
+        unsigned long num_samples (
+        ) const { return state.samples.size(); }
+
+    private:
+        friend class shape_predictor_trainer;
+
+        std::string random_seed;
+        unsigned long oversampling_amount;
+        unsigned long feature_pool_size;
+        std::vector<unsigned long> mirror_part_permutation;
+        std::vector<unsigned long> landmark_subset;
+        double box_translation_jitter;
+        double box_scale_jitter;
+        impl::training_state state;
+    };
+
+// ----------------------------------------------------------------------------------------
+
+    namespace impl
+    {
+        struct no_validation
+        {
+            bool enabled (
+            ) const { return false; }
+
+            void set_landmark_subset (const std::vector<unsigned long>& ) {}
+            void start (const matrix<float,0,1>& ) {}
+            void begin_cascade (const index_feature& ) {}
+            void add_tree (const regression_tree& ) {}
+            void remove_tree (const regression_tree& ) {}
+
+            double error (
+            ) const { return 0; }
+        };
+
+        template <typename image_array>
+        class held_out_validation
+        {
+            /*!
+                WHAT THIS OBJECT REPRESENTS
+                    Tracks the mean landmark error, in pixels, of the shape_predictor being
+                    trained on a held out set of images.  It keeps the current shape of
+                    every held out object, so adding a tree only costs one leaf lookup per
+                    object instead of rerunning the whole predictor.  error() matches what
+                    test_shape_predictor() would report for the trees added so far up to
+                    float rounding: remove_tree() subtracts the float leaf values again,
+                    which doesn't always give back the exact shapes from before the tree
+                    was added.
+            !*/
+        public:
+            held_out_validation (
+                const image_array& images_,
+                const std::vector<std::vector<full_object_detection> >& objects_
+            ) : images(images_), objects(objects_) {}
+
+            bool enabled (
+            ) const { return true; }
+
+            void set_landmark_subset (
+                const std::vector<unsigned long>& parts_
+            ) { parts = parts_; }
+
+            void start (
+                const matrix<float,0,1>& initial_shape
+            )
+            {
+                current_shapes.clear();
+                for (unsigned long i = 0; i < objects.size(); ++i)
+                    current_shapes.resize(current_shapes.size() + objects[i].size(), initial_shape);
+                feature_pixel_values.resize(current_shapes.size());
+            }
+
+            void begin_cascade (
+                const index_feature& index
+            )
+            {
+                unsigned long k = 0;
+                for (unsigned long i = 0; i < objects.size(); ++i)
+                {
+                    for (unsigned long j = 0; j < objects[i].size(); ++j, ++k)
+                        extract_feature_pixel_values(images[i], objects[i][j].get_rect(), current_shapes[k], index, feature_pixel_values[k]);
+                }
+            }
+
+            void add_tree (
+                const regression_tree& tree
+            )
+            {
+                for (unsigned long k = 0; k < current_shapes.size(); ++k)
+                    current_shapes[k] += tree(feature_pixel_values[k]);
+            }
+
+            void remove_tree (
+                const regression_tree& tree
+            )
+            {
+                for (unsigned long k = 0; k < current_shapes.size(); ++k)
+                    current_shapes[k] -= tree(feature_pixel_values[k]);
+            }
+
+            double error (
+            ) const
+            {
+                // same rounding to whole pixels as a full_object_detection does
+                running_stats<double> rs;
+                unsigned long k = 0;
+                for (unsigned long i = 0; i < objects.size(); ++i)
+                {
+                    for (unsigned long j = 0; j < objects[i].size(); ++j, ++k)
+                    {
+                        const point_transform_affine tform_to_img = unnormalizing_tform(objects[i][j].get_rect());
+                        for (long p = 0; p < current_shapes[k].size()/2; ++p)
+                        {
+                            const point part = tform_to_img(location(current_shapes[k], p));
+                            const unsigned long truth = parts.size() != 0 ? parts[p] : p;
+                            rs.add(length(part - objects[i][j].part(truth)));
+                        }
+                    }
+                }
+                return rs.mean();
+            }
+
+        private:
+            const image_array& images;
+            const std::vector<std::vector<full_object_detection> >& objects;
+            std::vector<unsigned long> parts;
+            std::vector<matrix<float,0,1> > current_shapes;
+            std::vector<std::vector<float> > feature_pixel_values;
+        };
+    }
 
 // ----------------------------------------------------------------------------------------
 
@@ -476,6 +2163,14 @@ namespace dlib
             _num_test_splits = 20;
             _feature_pool_region_padding = 0;
             _verbose = false;
+            _num_threads = 0;
+            _image_cache_size = 0;
+            _box_translation_jitter = 0;
+            _box_scale_jitter = 0;
+            _early_stopping_patience = 0;
+            _early_stopping_tolerance = 0.001;
+            _fern_structured_trees = false;
+            _leaf_basis_size = 0;
         }
 
         unsigned long get_cascade_depth (
@@ -541,10 +2236,19 @@ namespace dlib
         }
 
         std::string get_random_seed (
-        ) const { return rnd.get_seed(); }
+        ) const { return _random_seed; }
         void set_random_seed (
             const std::string& seed
-        ) { rnd.set_seed(seed); }
+        ) 
+        /*!
+            ensures
+                - Every random choice the trainer makes (initial shapes, feature pools and
+                  split candidates) is drawn from its own stream, seeded by seed together
+                  with the cascade, tree, node or sample it is made for.  So the trained
+                  model only depends on seed and the training data, never on the number
+                  of threads.
+        !*/
+        { _random_seed = seed; }
 
         unsigned long get_oversampling_amount (
         ) const { return _oversampling_amount; }
@@ -582,72 +2286,606 @@ namespace dlib
             double lambda
         )
         {
-            DLIB_CASSERT(lambda > 0,
-                "\t void shape_predictor_trainer::set_lambda()"
+            DLIB_CASSERT(lambda > 0,
+                "\t void shape_predictor_trainer::set_lambda()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t lambda: " << lambda 
+            );
+
+            _lambda = lambda;
+        }
+
+        unsigned long get_num_test_splits (
+        ) const { return _num_test_splits; }
+        void set_num_test_splits (
+            unsigned long num
+        )
+        {
+            DLIB_CASSERT(num > 0, 
+                "\t void shape_predictor_trainer::set_num_test_splits()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t num: " << num 
+            );
+
+            _num_test_splits = num;
+        }
+
+
+        bool get_fern_structured_trees (
+        ) const { return _fern_structured_trees; }
+        void set_fern_structured_trees (
+            bool enabled
+        )
+        /*!
+            ensures
+                - if enabled then every tree is fit as a random fern: all the nodes at the
+                  same depth share one split, picked as the candidate that best splits
+                  all of them together.  The trees are stored like any other tree, but
+                  shape_predictor evaluates cascade levels made of ferns with SIMD
+                  instructions since the comparisons don't depend on each other.
+                - ferns are usually a little less accurate than trees of the same depth.
+        !*/
+        {
+            _fern_structured_trees = enabled;
+        }
+
+        unsigned long get_leaf_basis_size (
+        ) const { return _leaf_basis_size; }
+        void set_leaf_basis_size (
+            unsigned long size
+        )
+        /*!
+            ensures
+                - if size is not 0 then once a cascade level is fit its leaf values are
+                  projected onto their top size principal directions, the same way
+                  compress_shape_predictor_leaves() does it.  Unlike compressing the
+                  finished model, the later levels are fit to the residuals left by the
+                  projected leaves and so make up for some of the lost accuracy.
+                - the returned model holds the leaf bases (see
+                  shape_predictor::get_leaf_bases()).
+                - 0 (the default) keeps full shape updates in the leaves.
+        !*/
+        {
+            _leaf_basis_size = size;
+        }
+
+        double get_feature_pool_region_padding (
+        ) const { return _feature_pool_region_padding; }
+        void set_feature_pool_region_padding (
+            double padding 
+        )
+        {
+            _feature_pool_region_padding = padding;
+        }
+
+        const std::vector<unsigned long>& get_mirror_part_permutation (
+        ) const { return _mirror_part_permutation; }
+        void set_mirror_part_permutation (
+            const std::vector<unsigned long>& perm
+        )
+        /*!
+            ensures
+                - if perm is not empty then about half the oversampled copies of every
+                  training object are mirrored left to right.  Part k of a mirrored
+                  object is the mirror image of part perm[k] of the original, e.g. perm
+                  swaps the indices of the left and right eye corners.  perm must then
+                  be a permutation of the part indices.
+                - mirrored samples are not stored, they are looked up in the original
+                  image through a flipped transform.
+        !*/
+        {
+            _mirror_part_permutation = perm;
+        }
+
+        const std::vector<unsigned long>& get_landmark_subset (
+        ) const { return _landmark_subset; }
+        void set_landmark_subset (
+            const std::vector<unsigned long>& parts
+        )
+        /*!
+            requires
+                - parts.size() == 0 || parts.size() >= 3
+                - parts doesn't contain any index twice
+                - every element of parts is less than the number of parts of the objects
+                  this trainer is later given (checked by train() and
+                  prepare_training())
+            ensures
+                - if parts is not empty then only the listed parts of the training objects
+                  are used.  The trained model predicts parts.size() parts, its part k
+                  being part parts[k] of the training objects (see
+                  select_landmark_subset()).  Its feature anchors only use these parts
+                  and its leaves only hold their coordinates, so a model of, say, 5 of 68
+                  landmarks is many times smaller and faster than the full one while
+                  being trained from the same annotations.
+                - The mirror part permutation, if any, still refers to all the parts and
+                  must map the subset onto itself.
+                - if parts is empty then all the parts are used (the default).
+        !*/
+        {
+            DLIB_CASSERT(impl::is_valid_landmark_subset(parts, std::numeric_limits<unsigned long>::max()),
+                "\t void shape_predictor_trainer::set_landmark_subset()"
+                << "\n\t A landmark subset needs at least 3 parts and can't list a part twice. "
+                << "\n\t parts.size(): " << parts.size() 
+            );
+            _landmark_subset = parts;
+        }
+
+        double get_box_translation_jitter (
+        ) const { return _box_translation_jitter; }
+        void set_box_translation_jitter (
+            double jitter
+        )
+        /*!
+            requires
+                - jitter >= 0
+            ensures
+                - the boxes of the oversampled copies of every training object are moved
+                  by up to jitter box widths and heights, uniformly at random.
+        !*/
+        {
+            DLIB_CASSERT(jitter >= 0,
+                "\t void shape_predictor_trainer::set_box_translation_jitter()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t jitter: " << jitter 
+            );
+            _box_translation_jitter = jitter;
+        }
+
+        double get_box_scale_jitter (
+        ) const { return _box_scale_jitter; }
+        void set_box_scale_jitter (
+            double jitter
+        )
+        /*!
+            requires
+                - 0 <= jitter < 1
+            ensures
+                - the boxes of the oversampled copies of every training object are
+                  scaled by a factor drawn uniformly from [1-jitter, 1+jitter].
+        !*/
+        {
+            DLIB_CASSERT(0 <= jitter && jitter < 1,
+                "\t void shape_predictor_trainer::set_box_scale_jitter()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t jitter: " << jitter 
+            );
+            _box_scale_jitter = jitter;
+        }
+
+        unsigned long get_early_stopping_patience (
+        ) const { return _early_stopping_patience; }
+        void set_early_stopping_patience (
+            unsigned long num_trees
+        )
+        /*!
+            ensures
+                - if num_trees is not 0 and train() is given a validation set then a
+                  cascade level stops growing once num_trees trees in a row have not
+                  lowered the held out error by more than get_early_stopping_tolerance().
+                  Those trees are dropped again, so they cost nothing at prediction time.
+                - training stops adding cascade levels once a whole level fails to lower
+                  the held out error by more than get_early_stopping_tolerance().  A level
+                  left without any trees is dropped too.
+                - 0 (the default) turns early stopping off.
+        !*/
+        {
+            _early_stopping_patience = num_trees;
+        }
+
+        double get_early_stopping_tolerance (
+        ) const { return _early_stopping_tolerance; }
+        void set_early_stopping_tolerance (
+            double tolerance
+        )
+        /*!
+            requires
+                - 0 <= tolerance < 1
+            ensures
+                - the smallest improvement of the held out error, relative to its current
+                  value, that early stopping counts as progress.
+        !*/
+        {
+            DLIB_CASSERT(0 <= tolerance && tolerance < 1,
+                "\t void shape_predictor_trainer::set_early_stopping_tolerance()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t tolerance: " << tolerance 
+            );
+            _early_stopping_tolerance = tolerance;
+        }
+
+        const std::string& get_stop_reason (
+        ) const
+        /*!
+            ensures
+                - returns why the last training run of this object stopped adding cascade
+                  levels: "cascade_limit" if it reached get_cascade_depth() and "plateau"
+                  if early stopping ended it (see set_early_stopping_patience()).  A run
+                  resumed from a checkpoint of a run that stopped early stops right away
+                  with "plateau".
+                - returns an empty string if this object hasn't trained anything yet.
+        !*/
+        {
+            return _stop_reason;
+        }
+
+        unsigned long get_num_threads (
+        ) const { return _num_threads; }
+        void set_num_threads (
+            unsigned long num
+        )
+        /*!
+            ensures
+                - training will use num threads for feature extraction and split
+                  evaluation.  0 means all the work is done in the calling thread.  The
+                  trained model is the same for any number of threads.
+        !*/
+        {
+            _num_threads = num;
+        }
+
+        unsigned long get_image_cache_size (
+        ) const { return _image_cache_size; }
+        void set_image_cache_size (
+            unsigned long num_images
+        )
+        /*!
+            ensures
+                - train_streaming() will keep the first num_images decoded images resident
+                  between cascades instead of decoding them again.  All other images are
+                  decoded once per cascade and dropped right away.
+        !*/
+        {
+            _image_cache_size = num_images;
+        }
+
+        const std::string& get_checkpoint_file (
+        ) const { return _checkpoint_file; }
+        void set_checkpoint_file (
+            const std::string& filename
+        )
+        /*!
+            ensures
+                - if filename is not empty then training writes a checkpoint to filename
+                  after every cascade.  It holds the forests fit so far, the feature
+                  index, the current shapes of all the training samples, the random
+                  seed and the trainer settings.  The file is replaced atomically, so a
+                  crash never leaves it half written.
+                - if filename already holds a checkpoint when training starts then
+                  training resumes from it rather than starting over.  Resuming with a
+                  larger cascade depth keeps going from where the checkpoint left off
+                  and gives the same model a single uninterrupted run would have.
+                - resuming from a checkpoint made with a different random seed or
+                  different trainer settings (other than the cascade depth and the
+                  settings that don't change the model, like the number of threads)
+                  throws dlib::error.
+        !*/
+        {
+            _checkpoint_file = filename;
+        }
+
+        const std::string& get_telemetry_file (
+        ) const { return _telemetry_file; }
+        void set_telemetry_file (
+            const std::string& filename
+        )
+        /*!
+            ensures
+                - if filename is not empty then training appends one JSON object per
+                  line to filename: a "start" record, a "tree" record for every tree
+                  (wall time, samples/sec and mean training residual), a "cascade"
+                  record for every cascade level (wall time split into feature
+                  extraction and split search, samples/sec, mean training residual,
+                  held out error when a validation set is given and peak resident
+                  memory) and a "done" record.  With a validation set the "tree" records
+                  also hold the held out error, and the "cascade" and "done" records say
+                  why the level or the run stopped (see set_early_stopping_patience()).
+                - the residuals are in normalized shape coordinates and the held out
+                  error is the mean landmark error in pixels.
+        !*/
+        {
+            _telemetry_file = filename;
+        }
+
+        void be_verbose (
+        )
+        {
+            _verbose = true;
+        }
+
+        void be_quiet (
+        )
+        {
+            _verbose = false;
+        }
+
+        template <typename image_array>
+        shape_predictor train (
+
+            //[ANDY] input >> images + objects = labelled data
+            const image_array& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+
+        ) const
+
+        {
+            DLIB_CASSERT(
+                images.size() == objects.size() && images.size() > 0,
+                "\t shape_predictor shape_predictor_trainer::train()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t images.size():  " << images.size() 
+                << "\n\t objects.size(): " << objects.size() 
+            );
+
+            return train_impl(objects, impl::in_memory_feature_extractor<image_array>(images), impl::no_validation(), 0, 0);
+        }
+
+        template <typename image_array, typename validation_image_array>
+        shape_predictor train (
+            const image_array& images,
+            const std::vector<std::vector<full_object_detection> >& objects,
+            const validation_image_array& validation_images,
+            const std::vector<std::vector<full_object_detection> >& validation_objects
+        ) const
+        /*!
+            requires
+                - images.size() == objects.size() && images.size() > 0
+                - validation_images.size() == validation_objects.size()
+            ensures
+                - returns the same model as train(images, objects) unless early stopping
+                  is turned on (see set_early_stopping_patience()), in which case the
+                  validation set decides when to stop adding trees and cascade levels.
+                - the held out error is reported after every tree and cascade level (see
+                  set_telemetry_file()).
+        !*/
+        {
+            DLIB_CASSERT(
+                images.size() == objects.size() && images.size() > 0 &&
+                validation_images.size() == validation_objects.size(),
+                "\t shape_predictor shape_predictor_trainer::train()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t images.size():  " << images.size() 
+                << "\n\t objects.size(): " << objects.size() 
+                << "\n\t validation_images.size():  " << validation_images.size() 
+                << "\n\t validation_objects.size(): " << validation_objects.size() 
+            );
+
+            return train_impl(objects, impl::in_memory_feature_extractor<image_array>(images),
+                impl::held_out_validation<validation_image_array>(validation_images, validation_objects), 0, 0);
+        }
+
+        template <typename image_array>
+        shape_predictor train (
+            const image_array& images,
+            const std::vector<std::vector<full_object_detection> >& objects,
+            const std::vector<std::vector<unsigned long> >& components
+        ) const
+        /*!
+            requires
+                - images.size() == objects.size() && images.size() > 0
+                - components.size() == objects.size()
+                - for all valid i: components[i].size() == objects[i].size()
+            ensures
+                - components[i][j] is the detector component objects[i][j] was found by,
+                  e.g. the weight_index of its rect_detection (see
+                  find_detector_components()).
+                - trains like train(images, objects) except that the objects of each
+                  component get the mean shape of that component as their initial shape.
+                  The returned model holds these shapes (see
+                  shape_predictor::get_component_initial_shapes()) and uses them when it
+                  is given the component.  Profile and rotated faces then start much
+                  closer to the truth, so fewer cascade levels reach the same accuracy.
+        !*/
+        {
+            DLIB_CASSERT(
+                images.size() == objects.size() && images.size() > 0 &&
+                components.size() == objects.size(),
+                "\t shape_predictor shape_predictor_trainer::train()"
                 << "\n\t Invalid inputs were given to this function. "
-                << "\n\t lambda: " << lambda 
+                << "\n\t images.size():     " << images.size() 
+                << "\n\t objects.size():    " << objects.size() 
+                << "\n\t components.size(): " << components.size() 
             );
+#ifdef ENABLE_ASSERTS
+            for (unsigned long i = 0; i < objects.size(); ++i)
+            {
+                DLIB_CASSERT(components[i].size() == objects[i].size(),
+                    "\t shape_predictor shape_predictor_trainer::train()"
+                    << "\n\t Every object needs a component."
+                    << "\n\t objects["<<i<<"].size():    " << objects[i].size() 
+                    << "\n\t components["<<i<<"].size(): " << components[i].size() 
+                );
+            }
+#endif
 
-            _lambda = lambda;
+            return train_impl(objects, impl::in_memory_feature_extractor<image_array>(images), impl::no_validation(), 0, 0, &components);
         }
 
-        unsigned long get_num_test_splits (
-        ) const { return _num_test_splits; }
-        void set_num_test_splits (
-            unsigned long num
-        )
+        template <typename image_array>
+        shape_predictor_training_start prepare_training (
+            const image_array& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        ) const
+        /*!
+            requires
+                - images.size() == objects.size() && images.size() > 0
+            ensures
+                - returns the initial shapes and first cascade features that train() would
+                  compute for this data with the current random seed, oversampling amount,
+                  augmentation settings, landmark subset and feature pool size.
+        !*/
         {
-            DLIB_CASSERT(num > 0, 
-                "\t void shape_predictor_trainer::set_num_test_splits()"
+            DLIB_CASSERT(
+                images.size() == objects.size() && images.size() > 0,
+                "\t shape_predictor_training_start shape_predictor_trainer::prepare_training()"
                 << "\n\t Invalid inputs were given to this function. "
-                << "\n\t num: " << num 
+                << "\n\t images.size():  " << images.size() 
+                << "\n\t objects.size(): " << objects.size() 
             );
 
-            _num_test_splits = num;
-        }
-
+            //[TIF] a subset model is prepared by a trainer that sees only the subset.
+            if (_landmark_subset.size() != 0)
+            {
+                check_landmark_subset(objects);
+                shape_predictor_training_start start = subset_trainer().prepare_training(images, 
+                    select_landmark_subset(objects, _landmark_subset));
+                start.mirror_part_permutation = get_mirror_part_permutation();
+                start.landmark_subset = _landmark_subset;
+                return start;
+            }
 
-        double get_feature_pool_region_padding (
-        ) const { return _feature_pool_region_padding; }
-        void set_feature_pool_region_padding (
-            double padding 
-        )
-        {
-            _feature_pool_region_padding = padding;
+            shape_predictor_training_start start;
+            start.random_seed = get_random_seed();
+            start.oversampling_amount = get_oversampling_amount();
+            start.feature_pool_size = get_feature_pool_size();
+            start.mirror_part_permutation = get_mirror_part_permutation();
+            start.box_translation_jitter = get_box_translation_jitter();
+            start.box_scale_jitter = get_box_scale_jitter();
+
+            training_state& state = start.state;
+            state.initial_shape = populate_training_sample_shapes(objects, state.objects, state.samples);
+            state.index.resize(1);
+            dlib::rand rnd;
+            impl::seed_random_stream(rnd, get_random_seed(), impl::feature_pool_stream, 0);
+            impl::sample_pixel_coordinates(rnd, state.index[0], state.initial_shape, get_feature_pool_size());
+
+            thread_pool tp(get_num_threads());
+            const impl::in_memory_feature_extractor<image_array> extract_features(images);
+            extract_features(tp, state.objects, state.samples, state.index[0]);
+            state.features_cascade = 0;
+            return start;
         }
 
-        void be_verbose (
-        )
+        template <typename image_array>
+        shape_predictor train (
+            const image_array& images,
+            const std::vector<std::vector<full_object_detection> >& objects,
+            const shape_predictor_training_start& start
+        ) const
+        /*!
+            requires
+                - images.size() == objects.size() && images.size() > 0
+                - start was made by prepare_training() from the same images and objects
+                  by a trainer with the same random seed, oversampling amount,
+                  augmentation settings, landmark subset and feature pool size as this
+                  one.
+            ensures
+                - returns the same model as train(images, objects) but starts from the
+                  work already done in start instead of redoing it.
+                - A checkpoint file, if there is one, takes precedence over start.
+        !*/
         {
-            _verbose = true;
-        }
+            DLIB_CASSERT(
+                images.size() == objects.size() && images.size() > 0,
+                "\t shape_predictor shape_predictor_trainer::train()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t images.size():  " << images.size() 
+                << "\n\t objects.size(): " << objects.size() 
+            );
+            DLIB_CASSERT(
+                start.get_random_seed() == get_random_seed() &&
+                start.get_oversampling_amount() == get_oversampling_amount() &&
+                start.get_feature_pool_size() == get_feature_pool_size() &&
+                start.mirror_part_permutation == get_mirror_part_permutation() &&
+                start.landmark_subset == get_landmark_subset() &&
+                start.box_translation_jitter == get_box_translation_jitter() &&
+                start.box_scale_jitter == get_box_scale_jitter(),
+                "\t shape_predictor shape_predictor_trainer::train()"
+                << "\n\t The training start was prepared with different trainer settings."
+                << "\n\t start.get_oversampling_amount(): " << start.get_oversampling_amount() 
+                << "\n\t get_oversampling_amount():       " << get_oversampling_amount() 
+                << "\n\t start.get_feature_pool_size():   " << start.get_feature_pool_size() 
+                << "\n\t get_feature_pool_size():         " << get_feature_pool_size() 
+            );
 
-        void be_quiet (
-        )
-        {
-            _verbose = false;
+            return train_impl(objects, impl::in_memory_feature_extractor<image_array>(images), impl::no_validation(), 0, &start.state);
         }
 
         template <typename image_array>
-        shape_predictor train (
-
-            //[ANDY] input >> images + objects = labelled data
+        shape_predictor continue_training (
+            const shape_predictor& model,
             const image_array& images,
             const std::vector<std::vector<full_object_detection> >& objects
-
         ) const
-
+        /*!
+            requires
+                - images.size() == objects.size() && images.size() > 0
+                - model.get_initial_shape().size() == 2 * the number of parts in objects
+            ensures
+                - Warm-starts training from an existing model.  The model's initial shape,
+                  feature index and trees are kept as they are.  Cascades holding fewer
+                  than get_num_trees_per_cascade_level() trees get more trees appended and
+                  new cascades are added until there are get_cascade_depth() of them.
+                  Both are fit to the residuals left by the existing trees on the given
+                  training data.
+        !*/
         {
-
-            using namespace impl;
             DLIB_CASSERT(
                 images.size() == objects.size() && images.size() > 0,
-                "\t shape_predictor shape_predictor_trainer::train()"
+                "\t shape_predictor shape_predictor_trainer::continue_training()"
                 << "\n\t Invalid inputs were given to this function. "
                 << "\n\t images.size():  " << images.size() 
                 << "\n\t objects.size(): " << objects.size() 
             );
 
+            return train_impl(objects, impl::in_memory_feature_extractor<image_array>(images), impl::no_validation(), &model, 0);
+        }
+
+        template <typename image_source>
+        shape_predictor train_streaming (
+            const image_source& source,
+            const std::vector<std::vector<full_object_detection> >& objects
+        ) const
+        /*!
+            requires
+                - image_source has a nested image_type typedef, a size() member and an
+                  operator()(unsigned long idx, image_type& img) const that decodes the
+                  idx-th training image into img.  It must be safe to call operator()
+                  from several threads at once.  file_list_image_source is an example.
+                - source.size() == objects.size() && source.size() > 0
+            ensures
+                - Trains exactly the same model as train() would given the decoded images,
+                  but without ever holding all the decoded images in memory.  Each image
+                  is decoded once per cascade (see set_image_cache_size()) and only the
+                  per-sample feature_pixel_values stay resident.
+        !*/
+        {
+            DLIB_CASSERT(
+                source.size() == objects.size() && source.size() > 0,
+                "\t shape_predictor shape_predictor_trainer::train_streaming()"
+                << "\n\t Invalid inputs were given to this function. "
+                << "\n\t source.size():  " << source.size() 
+                << "\n\t objects.size(): " << objects.size() 
+            );
+
+            return train_impl(objects, impl::streaming_feature_extractor<image_source>(source, get_image_cache_size()), impl::no_validation(), 0, 0);
+        }
+
+    private:
+
+        template <typename feature_extractor, typename validator>
+        shape_predictor train_impl (
+            const std::vector<std::vector<full_object_detection> >& objects,
+            const feature_extractor& extract_features,
+            validator validate,
+            const shape_predictor* warm_start,
+            const impl::training_state* start,
+            const std::vector<std::vector<unsigned long> >* components = 0
+        ) const
+        {
+            using namespace impl;
+
+            //[TIF] a subset model is trained by a trainer that sees only the subset.
+            if (_landmark_subset.size() != 0)
+            {
+                check_landmark_subset(objects);
+                validate.set_landmark_subset(_landmark_subset);
+                const shape_predictor_trainer trainer = subset_trainer();
+                const shape_predictor sp = trainer.train_impl(select_landmark_subset(objects, _landmark_subset),
+                                                              extract_features, validate, warm_start, start, components);
+                _stop_reason = trainer._stop_reason;
+                return sp;
+            }
+
             // make sure the objects agree on the number of parts and that there is at
             // least one full_object_detection. 
             unsigned long num_parts = 0;
@@ -678,68 +2916,277 @@ namespace dlib
                 "\t shape_predictor shape_predictor_trainer::train()"
                 << "\n\t You must give at least one full_object_detection if you want to train a shape model and it must have parts."
             );
+            DLIB_CASSERT(_mirror_part_permutation.size() == 0 || 
+                         (_mirror_part_permutation.size() == num_parts &&
+                          std::set<unsigned long>(_mirror_part_permutation.begin(), _mirror_part_permutation.end()).size() == num_parts &&
+                          *std::max_element(_mirror_part_permutation.begin(), _mirror_part_permutation.end()) < num_parts),
+                "\t shape_predictor shape_predictor_trainer::train()"
+                << "\n\t The mirror part permutation must be a permutation of the part indices."
+                << "\n\t get_mirror_part_permutation().size(): " << _mirror_part_permutation.size()
+                << "\n\t num_parts: " << num_parts 
+            );
+            DLIB_CASSERT(warm_start == 0 || warm_start->get_initial_shape().size() == (long)num_parts*2,
+                "\t shape_predictor shape_predictor_trainer::continue_training()"
+                << "\n\t The model must predict the same number of parts as the objects have."
+                << "\n\t model parts: " << warm_start->get_initial_shape().size()/2
+                << "\n\t num_parts:   " << num_parts 
+            );
 
 
+            training_state state;
+            if (load_checkpoint(objects, num_parts, state))
+            {
+                fill_training_objects(objects, state.objects);
+                if (_verbose)
+                    std::cout << "Resuming from checkpoint after cascade " << state.cascades_done << std::endl;
+            }
+            else if (start)
+            {
+                //[TIF] initial shapes and first cascade features shared between runs.
+                state = *start;
+            }
+            else
+            {
+                //[ANDY] initial shape, generated by averaging training samples
+                state.initial_shape = populate_training_sample_shapes(objects, state.objects, state.samples,
+                                                                      components, &state.component_initial_shapes);
 
-            rnd.set_seed(get_random_seed());
-
-            std::vector<training_sample> samples;
-
-            //[ANDY] initial shape, generated by averaging training samples
-            const matrix<float,0,1> initial_shape = populate_training_sample_shapes(objects, samples);
-
-
-            //[ANDY] adjustment
-            //       instead of pixel_coordinates, we generate anchor_idx(3-long vector) and ratio to denote an indexed point 
-            std::vector< impl::index_feature > index;
+                //[TIF] a warm start keeps the initial shape, the index and the trees of the 
+                //      given model and only adds to them.
+                if (warm_start)
+                {
+                    state.initial_shape = warm_start->get_initial_shape();
+                    state.component_initial_shapes = warm_start->get_component_initial_shapes();
+                    state.index = warm_start->get_index();
+                    state.forests = expand_leaf_values(warm_start->get_forests(), warm_start->get_leaf_bases());
+                    for (unsigned long i = 0; i < state.samples.size(); ++i)
+                    {
+                        if ((i%get_oversampling_amount()) == 0)
+                            state.samples[i].current_shape = state.initial_shape;
+                    }
+                }
+            }
 
+            //[TIF] a run that stopped early stays stopped when it is resumed.
+            const unsigned long num_cascades = state.stopped_early ? state.cascades_done :
+                std::max<unsigned long>(get_cascade_depth(), state.forests.size());
+            state.forests.resize(num_cascades);
 
-            //[ANDY] create indexing for all cascade
-            randomly_sample_pixel_coordinates( index, initial_shape);
+            //[TIF] bring the held out shapes up to date with the cascades we resume after.
+            validate.start(state.initial_shape);
+            for (unsigned long cascade = 0; cascade < state.cascades_done; ++cascade)
+            {
+                validate.begin_cascade(state.index[cascade]);
+                for (unsigned long i = 0; i < state.forests[cascade].size(); ++i)
+                    validate.add_tree(state.forests[cascade][i]);
+            }
+            const bool early_stopping = validate.enabled() && get_early_stopping_patience() != 0;
+            const double min_progress = 1 - get_early_stopping_tolerance();
+            const char* run_stop_reason = state.stopped_early ? "plateau" : "cascade_limit";
 
+            thread_pool tp(get_num_threads());
 
             unsigned long trees_fit_so_far = 0;
-            console_progress_indicator pbar(get_cascade_depth()*get_num_trees_per_cascade_level());
+            for (unsigned long cascade = 0; cascade < state.cascades_done; ++cascade)
+                trees_fit_so_far += state.forests[cascade].size();
+            console_progress_indicator pbar(num_cascades*get_num_trees_per_cascade_level());
             if (_verbose)
                 std::cout << "Fitting trees..." << std::endl;
 
+            //[TIF] structured metrics, one JSON object per line.
+            std::ofstream telemetry;
+            if (_telemetry_file.size() != 0)
+            {
+                telemetry.open(_telemetry_file.c_str(), std::ios::app);
+                if (!telemetry)
+                    throw error("Unable to open shape_predictor_trainer telemetry file " + _telemetry_file);
+                telemetry << "{\"event\":\"start\",\"images\":" << objects.size()
+                          << ",\"samples\":" << state.samples.size()
+                          << ",\"cascades\":" << num_cascades
+                          << ",\"trees_per_cascade\":" << get_num_trees_per_cascade_level()
+                          << ",\"threads\":" << get_num_threads()
+                          << ",\"resumed_cascades\":" << state.cascades_done << "}" << std::endl;
+            }
+            timestamper ts;
+            const uint64 training_start_time = ts.get_timestamp();
+
 
-            std::vector<std::vector<impl::regression_tree> > forests(get_cascade_depth());
             // Now start doing the actual training by filling in the forests
-            for (unsigned long cascade = 0; cascade < get_cascade_depth(); ++cascade)
+            for (unsigned long cascade = state.cascades_done; cascade < num_cascades; ++cascade)
             {
+                const uint64 cascade_start_time = ts.get_timestamp();
+
                 // Each cascade uses a different set of pixels for its features. 
+                //[ANDY] adjustment
+                //       instead of pixel_coordinates, we generate anchor_idx(3-long vector) and ratio to denote an indexed point 
+                if (state.index.size() <= cascade)
+                {
+                    state.index.resize(cascade+1);
+                    dlib::rand rnd;
+                    seed_random_stream(rnd, get_random_seed(), feature_pool_stream, cascade);
+                    sample_pixel_coordinates(rnd, state.index[cascade], state.initial_shape, get_feature_pool_size());
+                }
 
                 //[ANDY] First compute all the feature_pixel_values for each training sample at this level of the cascade.
                 //       no encoding needed
-                //       run through each sample
-                for (unsigned long i = 0; i < samples.size(); ++i)
+                if (state.features_cascade != (long)cascade)
+                    extract_features(tp, state.objects, state.samples, state.index[cascade]);
+                state.features_cascade = -1;
+                validate.begin_cascade(state.index[cascade]);
+                const uint64 feature_time = ts.get_timestamp() - cascade_start_time;
+                uint64 split_search_time = 0;
+                unsigned long trees_fit = 0;
+
+                //[TIF] trees we already have at this level (warm start) move the samples 
+                //      just like they do at prediction time.
+                std::vector<impl::regression_tree>& forest = state.forests[cascade];
+                for (unsigned long i = 0; i < forest.size(); ++i)
                 {
-                    extract_feature_pixel_values(
-                        images[samples[i].image_idx], samples[i].rect, samples[i].current_shape, 
-                        index[cascade], samples[i].feature_pixel_values 
-                    );
+                    for (unsigned long j = 0; j < state.samples.size(); ++j)
+                        state.samples[j].current_shape += forest[i](state.samples[j].feature_pixel_values);
+                    validate.add_tree(forest[i]);
                 }
 
+                //[TIF] early stopping compares the held out error against the last error
+                //      that counted as progress.
+                const double cascade_start_error = validate.error();
+                double progress_error = cascade_start_error;
+                unsigned long trees_without_progress = 0;
+                const char* cascade_stop_reason = "tree_limit";
+
                 // Now start building the trees at this cascade level.
-                for (unsigned long i = 0; i < get_num_trees_per_cascade_level(); ++i)
+                while (forest.size() < get_num_trees_per_cascade_level())
                 {
-                    forests[cascade].push_back( 
-                        make_regression_tree( samples, initial_shape, index[cascade] )
+                    const uint64 tree_start_time = ts.get_timestamp();
+                    forest.push_back( 
+                        make_regression_tree( tp, state.objects, state.samples, state.initial_shape, state.index[cascade],
+                                              cascade, forest.size() )
                     );
+                    const uint64 tree_time = ts.get_timestamp() - tree_start_time;
+                    split_search_time += tree_time;
+                    ++trees_fit;
+                    validate.add_tree(forest.back());
+                    const double held_out_error = validate.error();
+
+                    if (telemetry.is_open())
+                    {
+                        telemetry << "{\"event\":\"tree\",\"cascade\":" << cascade
+                                  << ",\"tree\":" << forest.size()-1
+                                  << ",\"seconds\":" << tree_time/1e6
+                                  << ",\"samples_per_second\":" << state.samples.size()*1e6/std::max<uint64>(tree_time,1)
+                                  << ",\"train_residual\":" << mean_training_residual(state.objects, state.samples);
+                        if (validate.enabled())
+                            telemetry << ",\"held_out_error\":" << held_out_error;
+                        telemetry << "}" << std::endl;
+                    }
 
                     if (_verbose)
                     {
                         ++trees_fit_so_far;
                         pbar.print_status(trees_fit_so_far);
                     }
+
+                    if (!early_stopping)
+                        continue;
+                    if (held_out_error < progress_error*min_progress)
+                    {
+                        progress_error = held_out_error;
+                        trees_without_progress = 0;
+                    }
+                    else if (++trees_without_progress == get_early_stopping_patience())
+                    {
+                        // The trees since the last real progress are taken back out so
+                        // they don't cost anything at prediction time.
+                        for (; trees_without_progress != 0; --trees_without_progress)
+                        {
+                            for (unsigned long j = 0; j < state.samples.size(); ++j)
+                                state.samples[j].current_shape -= forest.back()(state.samples[j].feature_pixel_values);
+                            validate.remove_tree(forest.back());
+                            forest.pop_back();
+                            --trees_fit;
+                        }
+                        cascade_stop_reason = "plateau";
+                        break;
+                    }
+                }
+
+                //[TIF] project the leaves of the level onto a low rank basis and move the
+                //      samples to where the projected trees put them.
+                if (get_leaf_basis_size() != 0 && forest.size() != 0)
+                {
+                    const matrix<float> basis = leaf_value_basis(forest, get_leaf_basis_size());
+                    for (unsigned long i = 0; i < forest.size(); ++i)
+                    {
+                        regression_tree projected = forest[i];
+                        for (unsigned long l = 0; l < projected.leaf_values.size(); ++l)
+                            projected.leaf_values[l] = basis*(trans(basis)*projected.leaf_values[l]);
+                        for (unsigned long j = 0; j < state.samples.size(); ++j)
+                        {
+                            state.samples[j].current_shape += projected(state.samples[j].feature_pixel_values);
+                            state.samples[j].current_shape -= forest[i](state.samples[j].feature_pixel_values);
+                        }
+                        validate.remove_tree(forest[i]);
+                        validate.add_tree(projected);
+                        forest[i] = projected;
+                    }
+                }
+
+                //[TIF] once a whole level makes no progress more levels won't either.  A
+                //      level without trees would only cost feature extraction so it goes.
+                const bool plateaued = early_stopping && !(validate.error() < cascade_start_error*min_progress);
+                if (!plateaued || forest.size() != 0)
+                    state.cascades_done = cascade+1;
+                if (plateaued)
+                {
+                    state.stopped_early = true;
+                    state.forests.resize(state.cascades_done);
+                    state.index.resize(state.cascades_done);
+                }
+                save_checkpoint(state);
+
+                if (telemetry.is_open())
+                {
+                    telemetry << "{\"event\":\"cascade\",\"cascade\":" << cascade
+                              << ",\"trees\":" << trees_fit
+                              << ",\"seconds\":" << (ts.get_timestamp() - cascade_start_time)/1e6
+                              << ",\"feature_extraction_seconds\":" << feature_time/1e6
+                              << ",\"split_search_seconds\":" << split_search_time/1e6
+                              << ",\"samples_per_second\":" << trees_fit*state.samples.size()*1e6/std::max<uint64>(split_search_time,1)
+                              << ",\"train_residual\":" << mean_training_residual(state.objects, state.samples);
+                    if (validate.enabled())
+                        telemetry << ",\"held_out_error\":" << validate.error();
+                    telemetry << ",\"stop_reason\":\"" << cascade_stop_reason << "\""
+                              << ",\"peak_rss_bytes\":" << peak_resident_memory() << "}" << std::endl;
+                }
+
+                if (plateaued)
+                {
+                    run_stop_reason = "plateau";
+                    if (_verbose)
+                        std::cout << "\nHeld out error stopped improving, keeping " << state.cascades_done << " cascades" << std::endl;
+                    break;
                 }
             }
 
+            if (telemetry.is_open())
+            {
+                telemetry << "{\"event\":\"done\",\"seconds\":" << (ts.get_timestamp() - training_start_time)/1e6
+                          << ",\"cascades\":" << state.cascades_done
+                          << ",\"stop_reason\":\"" << run_stop_reason << "\""
+                          << ",\"peak_rss_bytes\":" << peak_resident_memory() << "}" << std::endl;
+            }
+
+            _stop_reason = run_stop_reason;
             if (_verbose)
                 std::cout << "Training complete                          " << std::endl;
 
-            return shape_predictor( initial_shape, forests, index );
+            const shape_predictor sp( state.initial_shape, state.forests, state.index, 
+                                      std::vector<matrix<float> >(), state.component_initial_shapes );
+            // the leaves already lie in the span of their level's basis so this only
+            // changes how they are stored.
+            if (get_leaf_basis_size() != 0)
+                return compress_shape_predictor_leaves(sp, get_leaf_basis_size());
+            return sp;
         }
 
 
@@ -753,59 +3200,176 @@ namespace dlib
             const std::vector<matrix<double, 0,2>& ratio 
 */
 
-    private:
+        typedef impl::training_sample training_sample;
+        typedef impl::training_state training_state;
 
-        static matrix<float,0,1> object_to_shape (
-            const full_object_detection& obj
-        )
+        void save_checkpoint (
+            const training_state& state
+        ) const
         {
-            matrix<float,0,1> shape(obj.num_parts()*2);
-            const point_transform_affine tform_from_img = impl::normalizing_tform(obj.get_rect());
-            for (unsigned long i = 0; i < obj.num_parts(); ++i)
+            if (_checkpoint_file.size() == 0)
+                return;
+
+            // write to a temporary file first and rename it over the old checkpoint so
+            // a crash at any point never leaves us without a usable checkpoint.
+            const std::string temp_file = _checkpoint_file + ".tmp";
             {
-                vector<float,2> p = tform_from_img(obj.part(i));
-                shape(2*i)   = p.x();
-                shape(2*i+1) = p.y();
+                std::ofstream fout(temp_file.c_str(), std::ios::binary);
+                int version = checkpoint_version;
+                serialize(version, fout);
+                serialize(get_random_seed(), fout);
+                serialize(training_settings(), fout);
+                serialize(state.initial_shape, fout);
+                serialize(state.component_initial_shapes, fout);
+                serialize(state.index, fout);
+                serialize(state.forests, fout);
+                serialize(state.samples, fout);
+                serialize(state.cascades_done, fout);
+                serialize(state.stopped_early, fout);
+                if (!fout)
+                    throw error("Unable to write shape_predictor_trainer checkpoint to " + temp_file);
             }
-            return shape;
+#ifdef WIN32
+            // std::rename() doesn't replace an existing file on Windows.
+            const bool renamed = MoveFileExA(temp_file.c_str(), _checkpoint_file.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+            const bool renamed = std::rename(temp_file.c_str(), _checkpoint_file.c_str()) == 0;
+#endif
+            if (!renamed)
+                throw error("Unable to write shape_predictor_trainer checkpoint to " + _checkpoint_file);
         }
 
-        struct training_sample 
-        {
-            /*!
-
-            CONVENTION
-                - feature_pixel_values.size() == get_feature_pool_size()
-                - feature_pixel_values[j] == the value of the j-th feature pool
-                  pixel when you look it up relative to the shape in current_shape.
+        // Checkpoints of older versions lack the trainer settings or the early stopping
+        // state, or were made with other random streams, so they can't be resumed into
+        // the model an uninterrupted run would make and are rejected.
+        static const int checkpoint_version = 7;
 
-                - target_shape == The truth shape.  Stays constant during the whole
-                  training process.
-                - rect == the position of the object in the image_idx-th image.  All shape
-                  coordinates are coded relative to this rectangle.
-            !*/
+        std::string training_settings (
+        ) const
+        /*!
+            ensures
+                - returns the settings that decide which model training makes, serialized
+                  so that checkpoints can be matched against them.  The cascade depth
+                  isn't among them since a checkpoint may be resumed with a larger one.
+                  Neither are the settings that don't change the model, such as the
+                  number of threads.  The random seed is checked on its own.
+        !*/
+        {
+            std::ostringstream sout;
+            serialize(_tree_depth, sout);
+            serialize(_num_trees_per_cascade_level, sout);
+            serialize(_nu, sout);
+            serialize(_oversampling_amount, sout);
+            serialize(_feature_pool_size, sout);
+            serialize(_lambda, sout);
+            serialize(_num_test_splits, sout);
+            serialize(_feature_pool_region_padding, sout);
+            serialize(_mirror_part_permutation, sout);
+            serialize(_parent_landmark_subset, sout);
+            serialize(_box_translation_jitter, sout);
+            serialize(_box_scale_jitter, sout);
+            serialize(_early_stopping_patience, sout);
+            serialize(_early_stopping_tolerance, sout);
+            serialize(_fern_structured_trees, sout);
+            serialize(_leaf_basis_size, sout);
+            return sout.str();
+        }
 
-            unsigned long image_idx;
-            rectangle rect;
-            matrix<float,0,1> target_shape; 
+        bool load_checkpoint (
+            const std::vector<std::vector<full_object_detection> >& objects,
+            unsigned long num_parts,
+            training_state& state
+        ) const
+        /*!
+            ensures
+                - if there is a checkpoint file then loads it into #state and returns
+                  true.
+                - returns false if there is nothing to resume from.
+        !*/
+        {
+            if (_checkpoint_file.size() == 0)
+                return false;
+            std::ifstream fin(_checkpoint_file.c_str(), std::ios::binary);
+            if (!fin)
+                return false;
 
-            matrix<float,0,1> current_shape;  
-            std::vector<float> feature_pixel_values;
+            int version = 0;
+            deserialize(version, fin);
+            if (version != checkpoint_version)
+                throw serialization_error("The checkpoint in " + _checkpoint_file + " was made by another version of "
+                                          "shape_predictor_trainer and can't be resumed, delete it to start over.");
+            std::string seed;
+            deserialize(seed, fin);
+            if (seed != get_random_seed())
+                throw error("The checkpoint in " + _checkpoint_file + " was made with a different random seed.");
+            std::string settings;
+            deserialize(settings, fin);
+            if (settings != training_settings())
+                throw error("The checkpoint in " + _checkpoint_file + " was made with different trainer settings.");
+            deserialize(state.initial_shape, fin);
+            deserialize(state.component_initial_shapes, fin);
+            deserialize(state.index, fin);
+            deserialize(state.forests, fin);
+            deserialize(state.samples, fin);
+            deserialize(state.cascades_done, fin);
+            deserialize(state.stopped_early, fin);
+
+            unsigned long num_samples = 0;
+            for (unsigned long i = 0; i < objects.size(); ++i)
+                num_samples += objects[i].size()*get_oversampling_amount();
+            bool same_objects = state.samples.size() == num_samples && state.initial_shape.size() == (long)num_parts*2;
+            for (unsigned long i = 0; i < state.samples.size() && same_objects; ++i)
+                same_objects = state.samples[i].object_idx < num_samples/get_oversampling_amount();
+            if (!same_objects)
+                throw error("The checkpoint in " + _checkpoint_file + " was made with different training data.");
+
+            return true;
+        }
 
-            void swap(training_sample& item)
+        struct accumulate_split_sums
+        {
+            // computes, for one candidate split, the sum and count of the residuals of
+            // the samples in [begin,end) that go left.  Every candidate is handled by a
+            // single thread, in sample order, so the result doesn't depend on the number
+            // of threads.
+            accumulate_split_sums (
+                const std::vector<training_sample>& samples_,
+                unsigned long begin_,
+                unsigned long end_,
+                const std::vector<impl::split_feature>& feats_,
+                std::vector<matrix<float,0,1> >& left_sums_,
+                std::vector<unsigned long>& left_cnt_
+            ) : samples(samples_), begin(begin_), end(end_), feats(feats_), left_sums(left_sums_), left_cnt(left_cnt_) {}
+
+            void operator() (long i) const
             {
-                std::swap(image_idx, item.image_idx);
-                std::swap(rect, item.rect);
-                target_shape.swap(item.target_shape);
-                current_shape.swap(item.current_shape);
-                feature_pixel_values.swap(item.feature_pixel_values);
+                const impl::split_feature& f = feats[i];
+                for (unsigned long j = begin; j < end; ++j)
+                {
+                    if (samples[j].feature_pixel_values[f.idx1] - samples[j].feature_pixel_values[f.idx2] > f.thresh)
+                    {
+                        left_sums[i] += samples[j].diff_shape;
+                        ++left_cnt[i];
+                    }
+                }
             }
+
+            const std::vector<training_sample>& samples;
+            unsigned long begin;
+            unsigned long end;
+            const std::vector<impl::split_feature>& feats;
+            std::vector<matrix<float,0,1> >& left_sums;
+            std::vector<unsigned long>& left_cnt;
         };
 
         impl::regression_tree make_regression_tree (
+            thread_pool& tp,
+            const impl::training_objects& objects,
             std::vector<training_sample>& samples,
             const matrix<float, 0,1>& shape,
-            const impl::index_feature& index
+            const impl::index_feature& index,
+            unsigned long cascade,
+            unsigned long tree_idx
 
         ) const
 
@@ -820,16 +3384,40 @@ namespace dlib
             const unsigned long num_split_nodes = static_cast<unsigned long>(std::pow(2.0, (double)get_tree_depth())-1);
             std::vector<matrix<float,0,1> > sums(num_split_nodes*2+1);
             for (unsigned long i = 0; i < samples.size(); ++i)
-                sums[0] += samples[i].target_shape - samples[i].current_shape;
+            {
+                objects.residual(samples[i], samples[i].diff_shape);
+                sums[0] += samples[i].diff_shape;
+            }
 
-            for (unsigned long i = 0; i < num_split_nodes; ++i) 
+            dlib::rand rnd;
+            if (_fern_structured_trees)
+            {
+                //[TIF] one split per depth, shared by all the nodes at that depth.
+                for (unsigned long first = 0; first < num_split_nodes; first = left_child(first))
+                {
+                    seed_random_stream(rnd, get_random_seed(), split_stream, cascade, tree_idx, first);
+                    const std::vector<std::pair<unsigned long,unsigned long> > ranges(parts.begin(), parts.end());
+                    parts.clear();
+                    const impl::split_feature split = generate_fern_split(tp, rnd, samples, ranges, shape, index, first, sums);
+                    for (unsigned long i = 0; i < ranges.size(); ++i)
+                    {
+                        tree.splits.push_back(split);
+                        const unsigned long mid = partition_samples(split, samples, ranges[i].first, ranges[i].second); 
+                        parts.push_back(std::make_pair(ranges[i].first, mid));
+                        parts.push_back(std::make_pair(mid, ranges[i].second));
+                    }
+                }
+            }
+            for (unsigned long i = tree.splits.size(); i < num_split_nodes; ++i) 
             {
                 std::pair<unsigned long,unsigned long> range = parts.front();
                 parts.pop_front();
 
                 //[ANDY] using new generate_split function
+                seed_random_stream(rnd, get_random_seed(), split_stream, cascade, tree_idx, i);
                 const impl::split_feature split = generate_split
                 (
+                    tp, rnd,
                     samples, range.first,range.second, 
                     shape, index,  
                     sums[i], sums[left_child(i)], sums[right_child(i)]
@@ -851,53 +3439,20 @@ namespace dlib
                 if (parts[i].second != parts[i].first)
                     tree.leaf_values[i] = sums[num_split_nodes+i]*get_nu()/(parts[i].second - parts[i].first);
                 else
-                    tree.leaf_values[i] = zeros_matrix(samples[0].target_shape);
-
-                // now adjust the current shape based on these predictions
-                for (unsigned long j = parts[i].first; j < parts[i].second; ++j)
-                    samples[j].current_shape += tree.leaf_values[i];
-            }
-
-            return tree;
-        }
-
-
-        impl::split_feature randomly_generate_split_feature (
-
-            //[ANDY] outpu >>
-            const impl::index_feature& index,
-        
-            //[ANDY] input >>
-            const matrix<float, 0,1>& shape
-        ) const
-
-        //[ANDY] generate split feature for one cascade, pixel_coordinates is replaced by ratio and anchor
-        {
-            impl::split_feature feat;
-
-            const double lambda = get_lambda(); 
-            double accept_prob;
-            do 
-            {
-                feat.idx1   = rnd.get_random_32bit_number()%get_feature_pool_size();
-                feat.idx2   = rnd.get_random_32bit_number()%get_feature_pool_size();
-
-                //[ANDY] dist = ||u-v||
-                const double dist = length(
-                    index.p_location(shape, feat.idx1) - index.p_location(shape, feat.idx2)
-                );
-
-                accept_prob = std::exp(-dist/lambda);
-            }
-            while( feat.idx1 == feat.idx2 || !(accept_prob > rnd.get_random_double()));
+                    tree.leaf_values[i] = zeros_matrix(samples[0].current_shape);
 
-            feat.thresh = (rnd.get_random_double()*256 - 128)/2.0;
+                // now adjust the current shape based on these predictions
+                for (unsigned long j = parts[i].first; j < parts[i].second; ++j)
+                    samples[j].current_shape += tree.leaf_values[i];
+            }
 
-            return feat;
+            return tree;
         }
 
 
         impl::split_feature generate_split (
+            thread_pool& tp,
+            dlib::rand& rnd,
             const std::vector<training_sample>& samples,
             unsigned long begin,
             unsigned long end,
@@ -917,55 +3472,128 @@ namespace dlib
             std::vector<impl::split_feature> feats;
             feats.reserve(num_test_splits);
             for ( unsigned long i = 0; i < num_test_splits; ++i )
-                feats.push_back( randomly_generate_split_feature( index, shape ) );
+                feats.push_back( impl::randomly_generate_split_feature( rnd, index, shape, get_feature_pool_size(), get_lambda() ) );
 
             std::vector<matrix<float,0,1> > left_sums(num_test_splits);
             std::vector<unsigned long> left_cnt(num_test_splits);
 
             // now compute the sums of vectors that go left for each feature
-            matrix<float,0,1> temp;
-            for (unsigned long j = begin; j < end; ++j)
+            parallel_for(tp, 0, num_test_splits,
+                accumulate_split_sums(samples, begin, end, feats, left_sums, left_cnt), 1);
+
+            return feats[impl::select_best_split(sum, end-begin, left_sums, left_cnt, left_sum, right_sum)];
+        }
+
+        struct accumulate_fern_split_sums
+        {
+            // like accumulate_split_sums but for all the nodes at one depth of a fern.
+            // left_sums[i*ranges.size()+n] is for candidate i at the n-th node.
+            accumulate_fern_split_sums (
+                const std::vector<training_sample>& samples_,
+                const std::vector<std::pair<unsigned long,unsigned long> >& ranges_,
+                const std::vector<impl::split_feature>& feats_,
+                std::vector<matrix<float,0,1> >& left_sums_,
+                std::vector<unsigned long>& left_cnt_
+            ) : samples(samples_), ranges(ranges_), feats(feats_), left_sums(left_sums_), left_cnt(left_cnt_) {}
+
+            void operator() (long i) const
             {
-                temp = samples[j].target_shape - samples[j].current_shape;
-                for (unsigned long i = 0; i < num_test_splits; ++i)
+                const impl::split_feature& f = feats[i];
+                for (unsigned long n = 0; n < ranges.size(); ++n)
                 {
-                    if (samples[j].feature_pixel_values[feats[i].idx1] - samples[j].feature_pixel_values[feats[i].idx2] > feats[i].thresh)
+                    const unsigned long k = i*ranges.size() + n;
+                    for (unsigned long j = ranges[n].first; j < ranges[n].second; ++j)
                     {
-                        left_sums[i] += temp;
-                        ++left_cnt[i];
+                        if (samples[j].feature_pixel_values[f.idx1] - samples[j].feature_pixel_values[f.idx2] > f.thresh)
+                        {
+                            left_sums[k] += samples[j].diff_shape;
+                            ++left_cnt[k];
+                        }
                     }
                 }
             }
 
-            // now figure out which feature is the best
+            const std::vector<training_sample>& samples;
+            const std::vector<std::pair<unsigned long,unsigned long> >& ranges;
+            const std::vector<impl::split_feature>& feats;
+            std::vector<matrix<float,0,1> >& left_sums;
+            std::vector<unsigned long>& left_cnt;
+        };
+
+        impl::split_feature generate_fern_split (
+            thread_pool& tp,
+            dlib::rand& rnd,
+            const std::vector<training_sample>& samples,
+            const std::vector<std::pair<unsigned long,unsigned long> >& ranges,
+            const matrix<float, 0,1>& shape,
+            const impl::index_feature& index,
+            unsigned long first,
+            std::vector<matrix<float,0,1> >& sums
+        ) const
+        /*!
+            requires
+                - ranges[n] == the samples in tree node first+n
+                - sums[first+n] == the residual sum of the samples in ranges[n]
+            ensures
+                - returns the candidate split that best splits all the nodes at once and
+                  fills in the residual sums of their children.
+        !*/
+        {
+            const unsigned long num_test_splits = get_num_test_splits();  
+            std::vector<impl::split_feature> feats;
+            feats.reserve(num_test_splits);
+            for ( unsigned long i = 0; i < num_test_splits; ++i )
+                feats.push_back( impl::randomly_generate_split_feature( rnd, index, shape, get_feature_pool_size(), get_lambda() ) );
+
+            std::vector<matrix<float,0,1> > left_sums(num_test_splits*ranges.size());
+            std::vector<unsigned long> left_cnt(num_test_splits*ranges.size());
+            parallel_for(tp, 0, num_test_splits,
+                accumulate_fern_split_sums(samples, ranges, feats, left_sums, left_cnt), 1);
+
+            // same score as select_best_split(), summed over the nodes.  A node the
+            // split leaves whole scores as if it wasn't split at all.
+            matrix<float,0,1> temp;
             double best_score = -1;
             unsigned long best_feat = 0;
             for (unsigned long i = 0; i < num_test_splits; ++i)
             {
-                // check how well the feature splits the space.
                 double score = 0;
-                unsigned long right_cnt = end-begin-left_cnt[i];
-                if (left_cnt[i] != 0 && right_cnt != 0)
+                for (unsigned long n = 0; n < ranges.size(); ++n)
                 {
-                    temp = sum - left_sums[i];
-                    score = dot(left_sums[i],left_sums[i])/left_cnt[i] + dot(temp,temp)/right_cnt;
-                    if (score > best_score)
+                    const unsigned long k = i*ranges.size() + n;
+                    const unsigned long right_cnt = ranges[n].second - ranges[n].first - left_cnt[k];
+                    if (left_cnt[k] != 0)
+                        score += dot(left_sums[k],left_sums[k])/left_cnt[k];
+                    if (right_cnt != 0)
                     {
-                        best_score = score;
-                        best_feat = i;
+                        if (left_cnt[k] != 0)
+                            temp = sums[first+n] - left_sums[k];
+                        else
+                            temp = sums[first+n];
+                        score += dot(temp,temp)/right_cnt;
                     }
                 }
+                if (score > best_score)
+                {
+                    best_score = score;
+                    best_feat = i;
+                }
             }
 
-            left_sums[best_feat].swap(left_sum);
-            if (left_sum.size() != 0)
-            {
-                right_sum = sum - left_sum;
-            }
-            else
+            for (unsigned long n = 0; n < ranges.size(); ++n)
             {
-                right_sum = sum;
-                left_sum = zeros_matrix(sum);
+                const unsigned long node = first+n;
+                const unsigned long k = best_feat*ranges.size() + n;
+                if (left_cnt[k] != 0)
+                {
+                    sums[impl::right_child(node)] = sums[node] - left_sums[k];
+                    sums[impl::left_child(node)].swap(left_sums[k]);
+                }
+                else
+                {
+                    sums[impl::right_child(node)] = sums[node];
+                    sums[impl::left_child(node)] = zeros_matrix(sums[node]);
+                }
             }
             return feats[best_feat];
         }
@@ -995,109 +3623,188 @@ namespace dlib
 
 
 
+        void check_landmark_subset (
+            const std::vector<std::vector<full_object_detection> >& objects
+        ) const
+        {
+            for (unsigned long i = 0; i < objects.size(); ++i)
+            {
+                for (unsigned long j = 0; j < objects[i].size(); ++j)
+                {
+                    DLIB_CASSERT(impl::is_valid_landmark_subset(_landmark_subset, objects[i][j].num_parts()),
+                        "\t shape_predictor_trainer::train()"
+                        << "\n\t The landmark subset lists a part the training objects don't have. "
+                        << "\n\t largest part in get_landmark_subset(): " 
+                        << *std::max_element(_landmark_subset.begin(), _landmark_subset.end())
+                        << "\n\t objects["<<i<<"]["<<j<<"].num_parts(): " << objects[i][j].num_parts()
+                    );
+                }
+            }
+        }
+
+        shape_predictor_trainer subset_trainer (
+        ) const
+        /*!
+            requires
+                - get_landmark_subset().size() != 0
+            ensures
+                - returns a copy of this trainer for objects that only have the parts in
+                  the landmark subset, with the mirror part permutation renumbered to
+                  match.
+        !*/
+        {
+            shape_predictor_trainer trainer(*this);
+            trainer._landmark_subset.clear();
+            trainer._parent_landmark_subset = _landmark_subset;
+            if (_mirror_part_permutation.size() == 0)
+                return trainer;
+
+            for (unsigned long k = 0; k < _landmark_subset.size(); ++k)
+            {
+                DLIB_CASSERT(_landmark_subset[k] < _mirror_part_permutation.size(),
+                    "\t shape_predictor shape_predictor_trainer::train()"
+                    << "\n\t The landmark subset refers to parts the mirror permutation doesn't have."
+                    << "\n\t get_landmark_subset()["<<k<<"]: " << _landmark_subset[k] 
+                );
+                const unsigned long mirrored = _mirror_part_permutation[_landmark_subset[k]];
+                const unsigned long pos = std::find(_landmark_subset.begin(), _landmark_subset.end(), mirrored) - _landmark_subset.begin();
+                DLIB_CASSERT(pos < _landmark_subset.size(),
+                    "\t shape_predictor shape_predictor_trainer::train()"
+                    << "\n\t The mirror part permutation must map the landmark subset onto itself."
+                    << "\n\t part " << _landmark_subset[k] << " mirrors to part " << mirrored 
+                );
+                trainer._mirror_part_permutation[k] = pos;
+            }
+            trainer._mirror_part_permutation.resize(_landmark_subset.size());
+            return trainer;
+        }
+
+        void fill_training_objects (
+            const std::vector<std::vector<full_object_detection> >& objects,
+            impl::training_objects& table
+        ) const
+        {
+            table.clear();
+            for (unsigned long i = 0; i < objects.size(); ++i)
+            {
+                for (unsigned long j = 0; j < objects[i].size(); ++j)
+                    table.add(objects[i][j]);
+            }
+            table.set_mirror_permutation(_mirror_part_permutation);
+        }
+
         matrix<float,0,1> populate_training_sample_shapes(
             const std::vector<std::vector<full_object_detection> >& objects,
-            std::vector<training_sample>& samples
+            impl::training_objects& table,
+            std::vector<training_sample>& samples,
+            const std::vector<std::vector<unsigned long> >* components = 0,
+            std::vector<matrix<float,0,1> >* component_shapes = 0
         ) const
+        /*!
+            ensures
+                - returns the mean shape and fills in the samples and their table.
+                - if components != 0 then #*component_shapes holds the mean shape of each
+                  component, which is where the first sample of each of its objects
+                  starts instead of the mean shape.
+        !*/
         {
+            fill_training_objects(objects, table);
+
             samples.clear();
             matrix<float,0,1> mean_shape;
             long count = 0;
-            // first fill out the target shapes
+            // first fill out the sample descriptors.  The truth shapes stay in the table.
             for (unsigned long i = 0; i < objects.size(); ++i)
             {
                 for (unsigned long j = 0; j < objects[i].size(); ++j)
                 {
                     training_sample sample;
                     sample.image_idx = i;
-                    sample.rect = objects[i][j].get_rect();
-                    sample.target_shape = object_to_shape(objects[i][j]);
+                    sample.object_idx = count;
                     for (unsigned long itr = 0; itr < get_oversampling_amount(); ++itr)
                         samples.push_back(sample);
-                    mean_shape += sample.target_shape;
+                    mean_shape += table.target_shape(count);
                     ++count;
                 }
             }
 
             mean_shape /= count;
 
+            //[TIF] mean shape per detector component
+            std::vector<unsigned long> object_component;
+            if (components)
+            {
+                std::vector<matrix<float,0,1> >& shapes = *component_shapes;
+                std::vector<long> counts;
+                shapes.clear();
+                for (unsigned long i = 0; i < components->size(); ++i)
+                {
+                    for (unsigned long j = 0; j < (*components)[i].size(); ++j)
+                    {
+                        const unsigned long k = (*components)[i][j];
+                        if (k >= shapes.size())
+                        {
+                            shapes.resize(k+1);
+                            counts.resize(k+1, 0);
+                        }
+                        shapes[k] += table.target_shape(object_component.size());
+                        ++counts[k];
+                        object_component.push_back(k);
+                    }
+                }
+                for (unsigned long k = 0; k < shapes.size(); ++k)
+                {
+                    if (counts[k] != 0)
+                        shapes[k] /= counts[k];
+                }
+            }
+
             // now go pick random initial shapes
+            const bool augment = _mirror_part_permutation.size() != 0 || 
+                                 _box_translation_jitter != 0 || _box_scale_jitter != 0;
+            dlib::rand rnd;
             for (unsigned long i = 0; i < samples.size(); ++i)
             {
                 if ((i%get_oversampling_amount()) == 0)
                 {
                     // The mean shape is what we really use as an initial shape so always
                     // include it in the training set as an example starting shape.
-                    samples[i].current_shape = mean_shape;
+                    if (components)
+                        samples[i].current_shape = (*component_shapes)[object_component[samples[i].object_idx]];
+                    else
+                        samples[i].current_shape = mean_shape;
                 }
                 else
                 {
                     // Pick a random convex combination of two of the target shapes and use
                     // that as the initial shape for this sample.
+                    impl::seed_random_stream(rnd, get_random_seed(), impl::initial_shape_stream, i);
                     const unsigned long rand_idx = rnd.get_random_32bit_number()%samples.size();
                     const unsigned long rand_idx2 = rnd.get_random_32bit_number()%samples.size();
                     const double alpha = rnd.get_random_double();
-                    samples[i].current_shape = alpha*samples[rand_idx].target_shape + (1-alpha)*samples[rand_idx2].target_shape;
-                }
-            }
-
-
-            return mean_shape;
-        }
-
-
-        void sample_pixel_coordinates (
-            //-------------------------------------------
-            impl::index_feature& index,
-            //-------------------------------------------
-            const matrix<float, 0,1>& shape
-        ) const
-
-        {
-            index.set_size( get_feature_pool_size() );
-
-            for (unsigned long i = 0; i < get_feature_pool_size(); ++i) 
-            {
-                double alpha_new = rnd.get_random_double()*(0.5);           
-                double beta_new  = rnd.get_random_double()*(0.5);
-
-                unsigned long id0;  unsigned long id1;  unsigned long id2;
+                    samples[i].current_shape = alpha*table.target_shape(samples[rand_idx].object_idx) + 
+                                               (1-alpha)*table.target_shape(samples[rand_idx2].object_idx);
 
-                do
-                {
-                    id0 = rnd.get_random_32bit_number() % ( (shape.size())/2 );
-                    id1 = rnd.get_random_32bit_number() % ( (shape.size())/2 );
-                    id2 = rnd.get_random_32bit_number() % ( (shape.size())/2 );
+                    //[TIF] the other copies of the object also get a perturbed box and
+                    //      may be mirrored.  Only the description is stored.
+                    if (augment)
+                    {
+                        impl::seed_random_stream(rnd, get_random_seed(), impl::augmentation_stream, i);
+                        impl::augmentation& aug = samples[i].aug;
+                        aug.mirrored = _mirror_part_permutation.size() != 0 && rnd.get_random_double() < 0.5;
+                        aug.dx = _box_translation_jitter*(2*rnd.get_random_double() - 1);
+                        aug.dy = _box_translation_jitter*(2*rnd.get_random_double() - 1);
+                        aug.scale = 1 + _box_scale_jitter*(2*rnd.get_random_double() - 1);
+                    }
                 }
-                while ( id0==id1 || id1==id2 || id2==id0 );
-
-                index.assign( i, id0, id1, id2, alpha_new, beta_new );
-
             }
-        }
-
-        
-
-
-
 
 
-        void randomly_sample_pixel_coordinates (
-            std::vector< impl::index_feature >& index,
-            const matrix<float,0,1>& initial_shape
-        ) const
-        {
-            index.resize(get_cascade_depth() );
-
-            //[ANDY] index a new set of point for each cascade
-            for (unsigned long i = 0; i < get_cascade_depth(); ++i)
-            {                
-                sample_pixel_coordinates( index[i], initial_shape );
-            }
+            return mean_shape;
         }
 
 
-        mutable dlib::rand rnd;
+        std::string _random_seed;
 
         unsigned long _cascade_depth;
         unsigned long _tree_depth;
@@ -1109,11 +3816,87 @@ namespace dlib
         unsigned long _num_test_splits;
         double _feature_pool_region_padding;
         bool _verbose;
+        unsigned long _num_threads;
+        unsigned long _image_cache_size;
+        std::string _checkpoint_file;
+        std::string _telemetry_file;
+        std::vector<unsigned long> _mirror_part_permutation;
+        std::vector<unsigned long> _landmark_subset;
+        // the landmark subset of the trainer that made this one with subset_trainer(),
+        // so the checkpoints of different subsets can be told apart.
+        std::vector<unsigned long> _parent_landmark_subset;
+        double _box_translation_jitter;
+        double _box_scale_jitter;
+        unsigned long _early_stopping_patience;
+        double _early_stopping_tolerance;
+        mutable std::string _stop_reason;
+        bool _fern_structured_trees;
+        unsigned long _leaf_basis_size;
     };
 
 // ----------------------------------------------------------------------------------------
 // ----------------------------------------------------------------------------------------
 // ----------------------------------------------------------------------------------------
+// ----------------------------------------------------------------------------------------
+
+    template <
+        typename detector_type,
+        typename image_array
+        >
+    std::vector<std::vector<unsigned long> > find_detector_components (
+        detector_type& detector,
+        const image_array& images,
+        const std::vector<std::vector<full_object_detection> >& objects
+    )
+    /*!
+        requires
+            - detector_type is an object_detector or anything else that has
+              num_detectors() and operator()(img, std::vector<rect_detection>&).
+            - images.size() == objects.size()
+        ensures
+            - runs the detector over the images and returns, for every object, the
+              weight_index of the detection that overlaps its box the most, i.e. the
+              detector component that finds it.  This is what
+              shape_predictor_trainer::train(images, objects, components) wants.
+            - objects no detection overlaps by at least half (intersection over union)
+              get detector.num_detectors(), so they all share one extra component.
+    !*/
+    {
+        DLIB_CASSERT(images.size() == objects.size(),
+            "\t std::vector<std::vector<unsigned long> > find_detector_components()"
+            << "\n\t Invalid inputs were given to this function. "
+            << "\n\t images.size():  " << images.size() 
+            << "\n\t objects.size(): " << objects.size() 
+        );
+
+        std::vector<std::vector<unsigned long> > components(objects.size());
+        std::vector<rect_detection> dets;
+        for (unsigned long i = 0; i < objects.size(); ++i)
+        {
+            if (objects[i].size() == 0)
+                continue;
+            detector(images[i], dets);
+            for (unsigned long j = 0; j < objects[i].size(); ++j)
+            {
+                const rectangle& box = objects[i][j].get_rect();
+                unsigned long best = detector.num_detectors();
+                double best_overlap = 0.5;
+                for (unsigned long d = 0; d < dets.size(); ++d)
+                {
+                    const double inner = box.intersect(dets[d].rect).area();
+                    const double overlap = inner/(box.area() + dets[d].rect.area() - inner);
+                    if (overlap >= best_overlap)
+                    {
+                        best_overlap = overlap;
+                        best = dets[d].weight_index;
+                    }
+                }
+                components[i].push_back(best);
+            }
+        }
+        return components;
+    }
+
 // ----------------------------------------------------------------------------------------
 
     template <
@@ -1194,6 +3977,276 @@ namespace dlib
         return test_shape_predictor(sp, images, objects, no_scales);
     }
 
+// ----------------------------------------------------------------------------------------
+
+    struct shape_predictor_evaluation_options
+    {
+        /*!
+            WHAT THIS OBJECT REPRESENTS
+                The settings of evaluate_shape_predictor().
+        !*/
+
+        enum normalization_type
+        {
+            no_normalization,       // errors in pixels
+            box_diagonal,           // errors relative to the diagonal of the face box
+            inter_ocular            // errors relative to the distance between the eyes
+        };
+
+        shape_predictor_evaluation_options (
+        ) : normalization(box_diagonal), failure_threshold(0.1), ced_max_error(0.2), ced_steps(100), num_threads(0) {}
+
+        normalization_type normalization;
+
+        // With inter_ocular normalization the eye centers are the means of these parts
+        // of the ground truth, e.g. 36..41 and 42..47 of the 68 point annotation.
+        std::vector<unsigned long> left_eye_parts;
+        std::vector<unsigned long> right_eye_parts;
+
+        // a face fails if its mean normalized error is above this
+        double failure_threshold;
+
+        // the cumulative error distribution is sampled at ced_steps+1 evenly spaced
+        // errors from 0 to ced_max_error
+        double ced_max_error;
+        unsigned long ced_steps;
+
+        // the faces are spread over this many threads.  0 runs them in the caller.
+        unsigned long num_threads;
+    };
+
+    struct shape_predictor_evaluation
+    {
+        /*!
+            WHAT THIS OBJECT REPRESENTS
+                What evaluate_shape_predictor() measured.  Errors are distances between
+                predicted and true landmarks divided by the normalization scale of the
+                face, latencies are of single prediction calls in microseconds.
+        !*/
+
+        shape_predictor_evaluation (
+        ) : num_faces(0), mean_error(0), failure_rate(0), mean_latency(0), latency_p50(0),
+            latency_p90(0), latency_p99(0), max_latency(0) {}
+
+        unsigned long num_faces;
+        double mean_error;                          // over all landmarks of all faces
+        std::vector<double> landmark_mean_error;    // [k] is over part k of all faces
+        std::vector<double> landmark_median_error;
+
+        // ced_fraction[i] is the fraction of faces whose mean error is at most ced_error[i]
+        std::vector<double> ced_error;
+        std::vector<double> ced_fraction;
+
+        // the fraction of faces whose mean error is above the failure threshold
+        double failure_rate;
+
+        double mean_latency;
+        double latency_p50;
+        double latency_p90;
+        double latency_p99;
+        double max_latency;
+    };
+
+    namespace impl
+    {
+        template <typename image_array>
+        struct evaluate_face
+        {
+            // Runs in a thread pool so it must not throw.
+            evaluate_face (
+                const shape_predictor& sp_,
+                const image_array& images_,
+                const std::vector<std::vector<full_object_detection> >& objects_,
+                const std::vector<std::pair<unsigned long,unsigned long> >& faces_,
+                const std::vector<double>& scales_,
+                std::vector<double>& errors_,
+                std::vector<double>& latencies_
+            ) : sp(sp_), images(images_), objects(objects_), faces(faces_), scales(scales_), errors(errors_), latencies(latencies_) {}
+
+            void operator() (long f) const
+            {
+                const full_object_detection& truth = objects[faces[f].first][faces[f].second];
+                timestamper ts;
+                const uint64 start = ts.get_timestamp();
+                const full_object_detection det = sp(images[faces[f].first], truth.get_rect());
+                latencies[f] = ts.get_timestamp() - start;
+
+                const unsigned long num_parts = truth.num_parts();
+                for (unsigned long k = 0; k < num_parts; ++k)
+                    errors[f*num_parts + k] = length(det.part(k) - truth.part(k))/scales[f];
+            }
+
+            const shape_predictor& sp;
+            const image_array& images;
+            const std::vector<std::vector<full_object_detection> >& objects;
+            const std::vector<std::pair<unsigned long,unsigned long> >& faces;
+            const std::vector<double>& scales;
+            std::vector<double>& errors;
+            std::vector<double>& latencies;
+        };
+
+        inline double percentile (
+            std::vector<double> vals,
+            double p
+        )
+        /*!
+            requires
+                - vals.size() > 0
+                - 0 <= p <= 1
+            ensures
+                - returns the nearest rank p-th percentile of vals.
+        !*/
+        {
+            const unsigned long k = std::min<unsigned long>((unsigned long)std::ceil(p*vals.size()), vals.size()) - (p > 0 ? 1 : 0);
+            std::nth_element(vals.begin(), vals.begin() + k, vals.end());
+            return vals[k];
+        }
+
+        inline dlib::vector<double,2> mean_of_parts (
+            const full_object_detection& obj,
+            const std::vector<unsigned long>& parts
+        )
+        {
+            dlib::vector<double,2> sum;
+            for (unsigned long i = 0; i < parts.size(); ++i)
+                sum += obj.part(parts[i]);
+            return sum/parts.size();
+        }
+    }
+
+    template <
+        typename image_array
+        >
+    shape_predictor_evaluation evaluate_shape_predictor (
+        const shape_predictor& sp,
+        const image_array& images,
+        const std::vector<std::vector<full_object_detection> >& objects,
+        const shape_predictor_evaluation_options& options = shape_predictor_evaluation_options()
+    )
+    /*!
+        requires
+            - images.size() == objects.size()
+            - all the objects have the parts sp predicts
+            - if options.normalization == inter_ocular then the eye parts aren't empty and
+              are valid part indices.
+            - the normalization gives every object a non-zero scale, e.g. the boxes
+              aren't empty and the eyes aren't in the same place.
+            - options.ced_steps > 0
+        ensures
+            - runs sp on the box of every object, spread over options.num_threads
+              threads, and compares the result to the object's parts.  Besides the mean
+              error that test_shape_predictor() gives, this measures the mean and median
+              error of each landmark, the cumulative error distribution and failure rate
+              of the faces and percentiles of the time each prediction took.
+            - with a single thread mean_error is what test_shape_predictor() reports for
+              the same scales.  With more threads the latencies include the contention
+              between the threads, as they would in a server.
+    !*/
+    {
+        DLIB_CASSERT(images.size() == objects.size() && options.ced_steps > 0,
+            "\t shape_predictor_evaluation evaluate_shape_predictor()"
+            << "\n\t Invalid inputs were given to this function. "
+            << "\n\t images.size():      " << images.size() 
+            << "\n\t objects.size():     " << objects.size() 
+            << "\n\t options.ced_steps:  " << options.ced_steps 
+        );
+        DLIB_CASSERT(options.normalization != shape_predictor_evaluation_options::inter_ocular ||
+                     (options.left_eye_parts.size() != 0 && options.right_eye_parts.size() != 0),
+            "\t shape_predictor_evaluation evaluate_shape_predictor()"
+            << "\n\t Inter ocular normalization needs the parts of the eyes."
+        );
+
+        std::vector<std::pair<unsigned long,unsigned long> > faces;
+        std::vector<double> scales;
+        for (unsigned long i = 0; i < objects.size(); ++i)
+        {
+            for (unsigned long j = 0; j < objects[i].size(); ++j)
+            {
+                const full_object_detection& obj = objects[i][j];
+                faces.push_back(std::make_pair(i, j));
+                double scale = 1;
+                if (options.normalization == shape_predictor_evaluation_options::box_diagonal)
+                    scale = std::sqrt((double)obj.get_rect().width()*obj.get_rect().width() + 
+                                      (double)obj.get_rect().height()*obj.get_rect().height());
+                else if (options.normalization == shape_predictor_evaluation_options::inter_ocular)
+                    scale = length(impl::mean_of_parts(obj, options.left_eye_parts) - impl::mean_of_parts(obj, options.right_eye_parts));
+                DLIB_CASSERT((long)obj.num_parts()*2 == sp.get_initial_shape().size(),
+                    "\t shape_predictor_evaluation evaluate_shape_predictor()"
+                    << "\n\t The objects must have the parts the model predicts."
+                    << "\n\t objects["<<i<<"]["<<j<<"].num_parts(): " << obj.num_parts() 
+                    << "\n\t model parts: " << sp.get_initial_shape().size()/2 
+                );
+                DLIB_CASSERT(scale > 0,
+                    "\t shape_predictor_evaluation evaluate_shape_predictor()"
+                    << "\n\t The errors of every object must be normalized by a non-zero scale."
+                    << "\n\t objects["<<i<<"]["<<j<<"].get_rect(): " << obj.get_rect() 
+                );
+                scales.push_back(scale);
+            }
+        }
+
+        shape_predictor_evaluation result;
+        result.num_faces = faces.size();
+        if (faces.size() == 0)
+            return result;
+        const unsigned long num_parts = sp.get_initial_shape().size()/2;
+
+        std::vector<double> errors(faces.size()*num_parts);
+        std::vector<double> latencies(faces.size());
+        thread_pool tp(options.num_threads);
+        parallel_for(tp, 0, faces.size(), 
+            impl::evaluate_face<image_array>(sp, images, objects, faces, scales, errors, latencies));
+
+        // per face and per landmark errors
+        running_stats<double> all;
+        std::vector<double> face_errors(faces.size());
+        std::vector<double> landmark_errors(faces.size());
+        for (unsigned long f = 0; f < faces.size(); ++f)
+        {
+            running_stats<double> rs;
+            for (unsigned long k = 0; k < num_parts; ++k)
+            {
+                rs.add(errors[f*num_parts + k]);
+                all.add(errors[f*num_parts + k]);
+            }
+            face_errors[f] = rs.mean();
+        }
+        result.mean_error = all.mean();
+        for (unsigned long k = 0; k < num_parts; ++k)
+        {
+            running_stats<double> rs;
+            for (unsigned long f = 0; f < faces.size(); ++f)
+            {
+                landmark_errors[f] = errors[f*num_parts + k];
+                rs.add(landmark_errors[f]);
+            }
+            result.landmark_mean_error.push_back(rs.mean());
+            result.landmark_median_error.push_back(impl::percentile(landmark_errors, 0.5));
+        }
+
+        // cumulative error distribution and failures
+        std::sort(face_errors.begin(), face_errors.end());
+        for (unsigned long i = 0; i <= options.ced_steps; ++i)
+        {
+            const double error = options.ced_max_error*i/options.ced_steps;
+            const unsigned long below = std::upper_bound(face_errors.begin(), face_errors.end(), error) - face_errors.begin();
+            result.ced_error.push_back(error);
+            result.ced_fraction.push_back((double)below/faces.size());
+        }
+        const unsigned long passed = std::upper_bound(face_errors.begin(), face_errors.end(), options.failure_threshold) - face_errors.begin();
+        result.failure_rate = (double)(faces.size() - passed)/faces.size();
+
+        running_stats<double> rs;
+        for (unsigned long f = 0; f < latencies.size(); ++f)
+            rs.add(latencies[f]);
+        result.mean_latency = rs.mean();
+        result.latency_p50 = impl::percentile(latencies, 0.5);
+        result.latency_p90 = impl::percentile(latencies, 0.9);
+        result.latency_p99 = impl::percentile(latencies, 0.99);
+        result.max_latency = rs.max();
+        return result;
+    }
+
 // ----------------------------------------------------------------------------------------
 
 }
@@ -0,0 +1,719 @@
+//[TIF] distributed training of the triplet-indexed shape_predictor
+//This code is used for the following paper:
+//Heng Yang*, Renqiao Zhang*, Peter Robinson,
+//"Human and Sheep Landmarks Localisation by Triplet-Interpolated Features", WACV2016
+//If you use this code please cite the above publication.
+// The license for dlib.net is : Boost Software License   See LICENSE.txt for the full license.
+#ifndef DLIB_SHAPE_PREDICToR_TIF_DISTRIBUTED_H_
+#define DLIB_SHAPE_PREDICToR_TIF_DISTRIBUTED_H_
+
+#include "shape_predictor_TIF.h"
+#include "../bridge.h"
+#include "../type_safe_union.h"
+#include "../sockets.h"
+#include "../string.h"
+#include <deque>
+
+namespace dlib
+{
+
+// ----------------------------------------------------------------------------------------
+
+    namespace impl
+    {
+        /*
+            The coordinator and the workers talk in lock step.  The coordinator sends one
+            command to every worker and waits for all the replies before going on.  Every
+            command is answered, even if only with an empty reply, so no connection ever
+            sees two writes in a row and TCP's delayed ACKs never stall a round trip.
+            Training starts with
+
+                get_shape_stats   -> every worker returns the target shapes of its objects.
+                init_samples      -> the coordinator sends back the mean shape and all the
+                                     target shapes so the workers can set up the same
+                                     initial shapes the single machine trainer would.
+
+            and then each tree is fit like this:
+
+                begin_tree        -> every worker returns the sum and count of the
+                                     residuals of its samples.
+                evaluate_splits   -> the workers apply the split picked for the previous
+                                     node, if any, and then return, for the next node in
+                                     breadth first order, the per candidate sums and
+                                     counts of the residuals that go left.
+                finish_tree       -> the workers apply the split of the last node and add
+                                     the leaf values to their shapes.
+        */
+        enum distributed_command_type
+        {
+            dist_get_shape_stats,
+            dist_init_samples,
+            dist_extract_features,
+            dist_begin_tree,
+            dist_evaluate_splits,
+            dist_finish_tree,
+            dist_shutdown
+        };
+
+        struct distributed_command
+        {
+            distributed_command() : type(dist_shutdown), node(0), oversampling_amount(0), sample_offset(0) {}
+
+            int type;
+            unsigned long node;
+
+            // dist_init_samples
+            matrix<float,0,1> initial_shape;
+            std::vector<matrix<float,0,1> > target_shapes;
+            unsigned long oversampling_amount;
+            unsigned long sample_offset;
+            std::string seed;
+
+            // dist_extract_features
+            index_feature index;
+
+            // dist_evaluate_splits and dist_finish_tree.  split holds the split picked for
+            // node-1, or nothing at the root.  feats holds the candidates for node.
+            std::vector<split_feature> split;
+            std::vector<split_feature> feats;
+
+            // dist_finish_tree
+            std::vector<matrix<float,0,1> > leaf_values;
+
+            friend void serialize (const distributed_command& item, std::ostream& out)
+            {
+                serialize(item.type, out);
+                serialize(item.node, out);
+                serialize(item.initial_shape, out);
+                serialize(item.target_shapes, out);
+                serialize(item.oversampling_amount, out);
+                serialize(item.sample_offset, out);
+                serialize(item.seed, out);
+                serialize(item.index, out);
+                serialize(item.split, out);
+                serialize(item.feats, out);
+                serialize(item.leaf_values, out);
+            }
+            friend void deserialize (distributed_command& item, std::istream& in)
+            {
+                deserialize(item.type, in);
+                deserialize(item.node, in);
+                deserialize(item.initial_shape, in);
+                deserialize(item.target_shapes, in);
+                deserialize(item.oversampling_amount, in);
+                deserialize(item.sample_offset, in);
+                deserialize(item.seed, in);
+                deserialize(item.index, in);
+                deserialize(item.split, in);
+                deserialize(item.feats, in);
+                deserialize(item.leaf_values, in);
+            }
+        };
+
+        struct distributed_reply
+        {
+            std::vector<matrix<float,0,1> > sums;
+            std::vector<unsigned long> counts;
+
+            friend void serialize (const distributed_reply& item, std::ostream& out)
+            {
+                serialize(item.sums, out);
+                serialize(item.counts, out);
+            }
+            friend void deserialize (distributed_reply& item, std::istream& in)
+            {
+                deserialize(item.sums, in);
+                deserialize(item.counts, in);
+            }
+        };
+
+        // Both ends of a bridge must use the same pipe type.  The bridge_status lets
+        // a worker see the coordinator hang up and the coordinator see a worker die.
+        typedef type_safe_union<distributed_command, bridge_status> distributed_message;
+        typedef type_safe_union<distributed_reply, bridge_status> distributed_response;
+
+    // ------------------------------------------------------------------------------------
+
+        template <typename image_array>
+        class shape_predictor_training_shard : noncopyable
+        {
+            /*!
+                WHAT THIS OBJECT REPRESENTS
+                    The worker side of the distributed trainer.  It holds the training
+                    samples of one shard of the data and executes the coordinator's
+                    commands on them.
+            !*/
+        public:
+            shape_predictor_training_shard (
+                const image_array& images_,
+                const std::vector<std::vector<full_object_detection> >& objects_
+            ) : images(images_), objects(objects_) {}
+
+            void execute (
+                const distributed_command& cmd,
+                distributed_reply& reply
+            )
+            /*!
+                ensures
+                    - executes cmd and puts the answer for the coordinator into #reply.
+            !*/
+            {
+                reply.sums.clear();
+                reply.counts.clear();
+                switch (cmd.type)
+                {
+                    case dist_get_shape_stats: get_shape_stats(reply); return;
+                    case dist_init_samples: init_samples(cmd); return;
+                    case dist_extract_features: extract_features(cmd.index); return;
+                    case dist_begin_tree: begin_tree(reply); return;
+                    case dist_evaluate_splits: apply_split(cmd); evaluate_splits(cmd, reply); return;
+                    case dist_finish_tree: apply_split(cmd); finish_tree(cmd); return;
+                    case dist_shutdown: return;
+                }
+                throw error("shape_predictor_training_shard: unknown command");
+            }
+
+        private:
+
+            struct sample
+            {
+                unsigned long image_idx;
+                rectangle rect;
+                matrix<float,0,1> target_shape;
+                matrix<float,0,1> current_shape;
+                matrix<float,0,1> diff_shape;
+                std::vector<float> feature_pixel_values;
+
+                void swap(sample& item)
+                {
+                    std::swap(image_idx, item.image_idx);
+                    std::swap(rect, item.rect);
+                    target_shape.swap(item.target_shape);
+                    current_shape.swap(item.current_shape);
+                    diff_shape.swap(item.diff_shape);
+                    feature_pixel_values.swap(item.feature_pixel_values);
+                }
+            };
+
+            void get_shape_stats (
+                distributed_reply& reply
+            ) const
+            {
+                for (unsigned long i = 0; i < objects.size(); ++i)
+                {
+                    for (unsigned long j = 0; j < objects[i].size(); ++j)
+                        reply.sums.push_back(object_to_shape(objects[i][j]));
+                }
+            }
+
+            void init_samples (
+                const distributed_command& cmd
+            )
+            {
+                // This mirrors shape_predictor_trainer::populate_training_sample_shapes().
+                // The random initial shapes mix target shapes from all the shards, picked
+                // with the stream of the sample's global index.
+                samples.clear();
+                for (unsigned long i = 0; i < objects.size(); ++i)
+                {
+                    for (unsigned long j = 0; j < objects[i].size(); ++j)
+                    {
+                        sample s;
+                        s.image_idx = i;
+                        s.rect = objects[i][j].get_rect();
+                        s.target_shape = object_to_shape(objects[i][j]);
+                        for (unsigned long itr = 0; itr < cmd.oversampling_amount; ++itr)
+                            samples.push_back(s);
+                    }
+                }
+
+                const std::vector<matrix<float,0,1> >& targets = cmd.target_shapes;
+                const unsigned long total_samples = targets.size()*cmd.oversampling_amount;
+                dlib::rand rnd;
+                for (unsigned long i = 0; i < samples.size(); ++i)
+                {
+                    if ((i%cmd.oversampling_amount) == 0)
+                    {
+                        samples[i].current_shape = cmd.initial_shape;
+                    }
+                    else
+                    {
+                        seed_random_stream(rnd, cmd.seed, initial_shape_stream, cmd.sample_offset + i);
+                        const unsigned long rand_idx = rnd.get_random_32bit_number()%total_samples;
+                        const unsigned long rand_idx2 = rnd.get_random_32bit_number()%total_samples;
+                        const double alpha = rnd.get_random_double();
+                        samples[i].current_shape = alpha*targets[rand_idx/cmd.oversampling_amount] + 
+                                                   (1-alpha)*targets[rand_idx2/cmd.oversampling_amount];
+                    }
+                }
+            }
+
+            void extract_features (
+                const index_feature& index
+            )
+            {
+                for (unsigned long i = 0; i < samples.size(); ++i)
+                {
+                    extract_feature_pixel_values(
+                        images[samples[i].image_idx], samples[i].rect, samples[i].current_shape,
+                        index, samples[i].feature_pixel_values
+                    );
+                }
+            }
+
+            void begin_tree (
+                distributed_reply& reply
+            )
+            {
+                matrix<float,0,1> sum;
+                for (unsigned long i = 0; i < samples.size(); ++i)
+                {
+                    samples[i].diff_shape = samples[i].target_shape - samples[i].current_shape;
+                    sum += samples[i].diff_shape;
+                }
+                parts.clear();
+                parts.push_back(std::make_pair(0, (unsigned long)samples.size()));
+                next_node = 0;
+
+                reply.sums.push_back(sum);
+                reply.counts.push_back(samples.size());
+            }
+
+            void evaluate_splits (
+                const distributed_command& cmd,
+                distributed_reply& reply
+            ) const
+            {
+                DLIB_CASSERT(cmd.node == next_node, "The coordinator and a worker disagree on the tree node.");
+                const unsigned long begin = parts.front().first;
+                const unsigned long end = parts.front().second;
+                reply.sums.resize(cmd.feats.size());
+                reply.counts.assign(cmd.feats.size(), 0);
+                for (unsigned long i = 0; i < cmd.feats.size(); ++i)
+                {
+                    const split_feature& f = cmd.feats[i];
+                    for (unsigned long j = begin; j < end; ++j)
+                    {
+                        if (samples[j].feature_pixel_values[f.idx1] - samples[j].feature_pixel_values[f.idx2] > f.thresh)
+                        {
+                            reply.sums[i] += samples[j].diff_shape;
+                            ++reply.counts[i];
+                        }
+                    }
+                }
+            }
+
+            void apply_split (
+                const distributed_command& cmd
+            )
+            {
+                if (cmd.split.size() == 0)
+                    return;
+                DLIB_CASSERT(cmd.node == next_node+1, "The coordinator and a worker disagree on the tree node.");
+                const split_feature& split = cmd.split[0];
+                const std::pair<unsigned long,unsigned long> range = parts.front();
+                parts.pop_front();
+
+                unsigned long mid = range.first;
+                for (unsigned long j = range.first; j < range.second; ++j)
+                {
+                    if (samples[j].feature_pixel_values[split.idx1] - samples[j].feature_pixel_values[split.idx2] > split.thresh)
+                    {
+                        samples[mid].swap(samples[j]);
+                        ++mid;
+                    }
+                }
+                parts.push_back(std::make_pair(range.first, mid));
+                parts.push_back(std::make_pair(mid, range.second));
+                ++next_node;
+            }
+
+            void finish_tree (
+                const distributed_command& cmd
+            )
+            {
+                DLIB_CASSERT(cmd.leaf_values.size() == parts.size(),
+                    "The coordinator and a worker disagree on the number of leaves.");
+                for (unsigned long i = 0; i < parts.size(); ++i)
+                {
+                    for (unsigned long j = parts[i].first; j < parts[i].second; ++j)
+                        samples[j].current_shape += cmd.leaf_values[i];
+                }
+            }
+
+            const image_array& images;
+            const std::vector<std::vector<full_object_detection> >& objects;
+            std::vector<sample> samples;
+            std::deque<std::pair<unsigned long, unsigned long> > parts;
+            unsigned long next_node;
+        };
+
+    // ------------------------------------------------------------------------------------
+
+        class distributed_training_coordinator : noncopyable
+        {
+            /*!
+                WHAT THIS OBJECT REPRESENTS
+                    The coordinator side of the distributed trainer.  It holds one bridge
+                    per worker and broadcasts commands and reduces replies.
+            !*/
+        public:
+            distributed_training_coordinator (
+                const std::vector<network_address>& workers,
+                unsigned long timeout_
+            ) : timeout(timeout_)
+            {
+                for (unsigned long i = 0; i < workers.size(); ++i)
+                {
+                    to_workers.push_back(new pipe<distributed_message>(4));
+                    from_workers.push_back(new pipe<distributed_response>(4));
+                    bridges.push_back(new bridge(connect_to(workers[i]),
+                            dlib::transmit(*to_workers.back()), dlib::receive(*from_workers.back())));
+                }
+            }
+
+            ~distributed_training_coordinator()
+            {
+                for (unsigned long i = 0; i < bridges.size(); ++i)
+                {
+                    delete bridges[i];
+                    delete to_workers[i];
+                    delete from_workers[i];
+                }
+            }
+
+            unsigned long num_workers (
+            ) const { return bridges.size(); }
+
+            void send (
+                unsigned long worker,
+                const distributed_command& cmd
+            )
+            {
+                distributed_message msg;
+                msg.get<distributed_command>() = cmd;
+                to_workers[worker]->enqueue(msg);
+            }
+
+            void broadcast (
+                const distributed_command& cmd
+            )
+            {
+                for (unsigned long i = 0; i < num_workers(); ++i)
+                    send(i, cmd);
+            }
+
+            void receive (
+                unsigned long worker,
+                distributed_reply& reply
+            )
+            /*!
+                ensures
+                    - waits for the next reply of the given worker and puts it into
+                      #reply.
+                    - throws dlib::error if the connection to the worker drops or if no
+                      reply comes within the timeout.  The bridge would reconnect to a
+                      restarted worker, but that worker has lost its samples.
+            !*/
+            {
+                distributed_response msg;
+                while (from_workers[worker]->dequeue_or_timeout(msg, timeout))
+                {
+                    if (msg.contains<distributed_reply>())
+                    {
+                        std::swap(reply, msg.get<distributed_reply>());
+                        return;
+                    }
+                    if (!msg.get<bridge_status>().is_connected)
+                        throw error("Lost the connection to shape_predictor training worker " + cast_to_string(worker) + ".");
+                }
+                throw error("Timed out waiting for shape_predictor training worker " + cast_to_string(worker) + ".");
+            }
+
+            void reduce (
+                distributed_reply& total
+            )
+            /*!
+                ensures
+                    - receives one reply from every worker and returns their element-wise
+                      sum in #total.  Worker replies are always added in the same order.
+            !*/
+            {
+                distributed_reply reply;
+                receive(0, total);
+                for (unsigned long i = 1; i < num_workers(); ++i)
+                {
+                    receive(i, reply);
+                    for (unsigned long j = 0; j < total.sums.size(); ++j)
+                    {
+                        // a worker with no samples going left sends an empty sum, and
+                        // adding an empty matrix would clear the total.
+                        if (reply.sums[j].size() != 0)
+                            total.sums[j] += reply.sums[j];
+                        total.counts[j] += reply.counts[j];
+                    }
+                }
+            }
+
+        private:
+            const unsigned long timeout;
+            std::vector<pipe<distributed_message>*> to_workers;
+            std::vector<pipe<distributed_response>*> from_workers;
+            std::vector<bridge*> bridges;
+        };
+
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    template <typename image_array>
+    void serve_shape_predictor_training_shard (
+        unsigned short port,
+        const image_array& images,
+        const std::vector<std::vector<full_object_detection> >& objects
+    )
+    /*!
+        requires
+            - images.size() == objects.size()
+            - port != 0
+        ensures
+            - Runs a worker for train_shape_predictor_distributed().  Listens on the
+              given port, executes the commands of the coordinator that connects to it on
+              the training samples defined by images and objects, and returns once the
+              coordinator has finished training and hung up.
+    !*/
+    {
+        using namespace impl;
+        pipe<distributed_message> in(4);
+        pipe<distributed_response> out(4);
+        bridge b(listen_on_port(port), receive(in), transmit(out));
+
+        shape_predictor_training_shard<image_array> shard(images, objects);
+        distributed_message msg;
+        distributed_response reply;
+        bool done = false;
+        while (in.dequeue(msg))
+        {
+            if (msg.contains<bridge_status>())
+            {
+                // Return once the coordinator has seen our reply to dist_shutdown and
+                // closed its end of the connection.
+                if (done && !msg.get<bridge_status>().is_connected)
+                    return;
+                continue;
+            }
+
+            const distributed_command& cmd = msg.get<distributed_command>();
+            shard.execute(cmd, reply.get<distributed_reply>());
+            out.enqueue(reply);
+            if (cmd.type == dist_shutdown)
+                done = true;
+        }
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    inline shape_predictor train_shape_predictor_distributed (
+        const shape_predictor_trainer& trainer,
+        const std::vector<network_address>& workers,
+        unsigned long timeout = 600000
+    )
+    /*!
+        requires
+            - workers.size() > 0
+            - each workers[i].host_address is an IP address with a running
+              serve_shape_predictor_training_shard() listening on workers[i].port.
+            - timeout > 0
+            - trainer.get_checkpoint_file() == "" 
+            - trainer.get_telemetry_file() == "" 
+            - trainer.get_mirror_part_permutation().size() == 0
+            - trainer.get_box_translation_jitter() == 0
+            - trainer.get_box_scale_jitter() == 0
+            - trainer.get_early_stopping_patience() == 0
+            - trainer.get_fern_structured_trees() == false
+            - trainer.get_leaf_basis_size() == 0
+            - trainer.get_landmark_subset().size() == 0
+        ensures
+            - Trains a shape_predictor with the parameters of trainer on the union of the
+              samples held by the workers.  The workers compute the per node split
+              statistics of their own samples, this function adds them up, picks the split
+              and sends it back, so only a few vectors per tree node cross the network.
+            - The workers set up the same initial shapes and the coordinator draws the same
+              feature pools and split candidates as shape_predictor_trainer::train() would
+              on the concatenation of the shards.  The only difference is the order in
+              which residuals are summed, so the result depends on the data, the trainer
+              settings and the order of the workers, and matches train() exactly when
+              there is a single worker.
+            - Warm starts and per detector component initial shapes are not supported
+              in this mode, so the returned model has no component initial shapes.
+            - throws dlib::error if a worker drops its connection or doesn't answer a
+              command within timeout milliseconds.
+    !*/
+    {
+        using namespace impl;
+        DLIB_CASSERT(workers.size() > 0,
+            "\t shape_predictor train_shape_predictor_distributed()"
+            << "\n\t You need at least one worker."
+        );
+        DLIB_CASSERT(timeout > 0,
+            "\t shape_predictor train_shape_predictor_distributed()"
+            << "\n\t The timeout must be positive."
+        );
+        DLIB_CASSERT(trainer.get_checkpoint_file().size() == 0 &&
+                     trainer.get_telemetry_file().size() == 0,
+            "\t shape_predictor train_shape_predictor_distributed()"
+            << "\n\t Checkpoints and telemetry aren't supported in distributed mode."
+            << "\n\t trainer.get_checkpoint_file(): " << trainer.get_checkpoint_file()
+            << "\n\t trainer.get_telemetry_file():  " << trainer.get_telemetry_file()
+        );
+        DLIB_CASSERT(trainer.get_mirror_part_permutation().size() == 0 &&
+                     trainer.get_box_translation_jitter() == 0 &&
+                     trainer.get_box_scale_jitter() == 0,
+            "\t shape_predictor train_shape_predictor_distributed()"
+            << "\n\t Mirrored and jittered samples can't be trained in distributed mode."
+            << "\n\t trainer.get_box_translation_jitter(): " << trainer.get_box_translation_jitter()
+            << "\n\t trainer.get_box_scale_jitter():       " << trainer.get_box_scale_jitter()
+        );
+        DLIB_CASSERT(trainer.get_early_stopping_patience() == 0,
+            "\t shape_predictor train_shape_predictor_distributed()"
+            << "\n\t Early stopping needs a validation set, which distributed mode doesn't take."
+        );
+        DLIB_CASSERT(!trainer.get_fern_structured_trees() &&
+                     trainer.get_leaf_basis_size() == 0,
+            "\t shape_predictor train_shape_predictor_distributed()"
+            << "\n\t Fern structured trees and leaf bases can't be trained in distributed mode."
+            << "\n\t trainer.get_leaf_basis_size(): " << trainer.get_leaf_basis_size()
+        );
+        DLIB_CASSERT(trainer.get_landmark_subset().size() == 0,
+            "\t shape_predictor train_shape_predictor_distributed()"
+            << "\n\t Landmark subsets can't be trained in distributed mode.  Give the workers"
+            << "\n\t the output of select_landmark_subset() instead."
+        );
+
+        distributed_training_coordinator coord(workers, timeout);
+        distributed_command cmd;
+        distributed_reply reply;
+
+        // the mean shape over all the workers is the initial shape
+        cmd.type = dist_get_shape_stats;
+        coord.broadcast(cmd);
+        std::vector<unsigned long> num_objects(coord.num_workers());
+        std::vector<matrix<float,0,1> > target_shapes;
+        matrix<float,0,1> initial_shape;
+        for (unsigned long i = 0; i < coord.num_workers(); ++i)
+        {
+            coord.receive(i, reply);
+            num_objects[i] = reply.sums.size();
+            for (unsigned long j = 0; j < reply.sums.size(); ++j)
+            {
+                initial_shape += reply.sums[j];
+                target_shapes.push_back(reply.sums[j]);
+            }
+        }
+        if (target_shapes.size() == 0)
+            throw error("The shape_predictor training workers don't hold any objects.");
+        initial_shape /= target_shapes.size();
+
+        cmd.type = dist_init_samples;
+        cmd.initial_shape = initial_shape;
+        cmd.target_shapes.swap(target_shapes);
+        cmd.oversampling_amount = trainer.get_oversampling_amount();
+        cmd.seed = trainer.get_random_seed();
+        cmd.sample_offset = 0;
+        for (unsigned long i = 0; i < coord.num_workers(); ++i)
+        {
+            coord.send(i, cmd);
+            cmd.sample_offset += num_objects[i]*trainer.get_oversampling_amount();
+        }
+        coord.reduce(reply);
+
+        const unsigned long num_split_nodes = static_cast<unsigned long>(std::pow(2.0, (double)trainer.get_tree_depth())-1);
+        std::vector<index_feature> index(trainer.get_cascade_depth());
+        std::vector<std::vector<regression_tree> > forests(trainer.get_cascade_depth());
+        dlib::rand rnd;
+        for (unsigned long cascade = 0; cascade < trainer.get_cascade_depth(); ++cascade)
+        {
+            seed_random_stream(rnd, trainer.get_random_seed(), feature_pool_stream, cascade);
+            sample_pixel_coordinates(rnd, index[cascade], initial_shape, trainer.get_feature_pool_size());
+
+            cmd = distributed_command();
+            cmd.type = dist_extract_features;
+            cmd.index = index[cascade];
+            coord.broadcast(cmd);
+            coord.reduce(reply);
+            cmd.index = index_feature();
+
+            for (unsigned long t = 0; t < trainer.get_num_trees_per_cascade_level(); ++t)
+            {
+                regression_tree tree;
+                std::vector<matrix<float,0,1> > sums(num_split_nodes*2+1);
+                std::vector<unsigned long> counts(num_split_nodes*2+1);
+
+                cmd.type = dist_begin_tree;
+                coord.broadcast(cmd);
+                coord.reduce(reply);
+                sums[0] = reply.sums[0];
+                counts[0] = reply.counts[0];
+
+                for (unsigned long i = 0; i < num_split_nodes; ++i)
+                {
+                    seed_random_stream(rnd, trainer.get_random_seed(), split_stream, cascade, t, i);
+                    std::vector<split_feature> feats;
+                    for (unsigned long k = 0; k < trainer.get_num_test_splits(); ++k)
+                    {
+                        feats.push_back(randomly_generate_split_feature(rnd, index[cascade], initial_shape,
+                                trainer.get_feature_pool_size(), trainer.get_lambda()));
+                    }
+
+                    cmd.type = dist_evaluate_splits;
+                    cmd.node = i;
+                    cmd.feats = feats;
+                    if (i != 0)
+                        cmd.split.assign(1, tree.splits.back());
+                    coord.broadcast(cmd);
+                    coord.reduce(reply);
+
+                    const unsigned long best = select_best_split(sums[i], counts[i], reply.sums, reply.counts,
+                        sums[left_child(i)], sums[right_child(i)]);
+                    counts[left_child(i)] = reply.counts[best];
+                    counts[right_child(i)] = counts[i] - counts[left_child(i)];
+                    tree.splits.push_back(feats[best]);
+                }
+
+                tree.leaf_values.resize(num_split_nodes+1);
+                for (unsigned long i = 0; i < tree.leaf_values.size(); ++i)
+                {
+                    if (counts[num_split_nodes+i] != 0)
+                        tree.leaf_values[i] = sums[num_split_nodes+i]*trainer.get_nu()/counts[num_split_nodes+i];
+                    else
+                        tree.leaf_values[i] = zeros_matrix(initial_shape);
+                }
+
+                cmd.type = dist_finish_tree;
+                cmd.node = num_split_nodes;
+                cmd.split.assign(1, tree.splits.back());
+                cmd.feats.clear();
+                cmd.leaf_values = tree.leaf_values;
+                coord.broadcast(cmd);
+                coord.reduce(reply);
+                cmd.split.clear();
+                cmd.leaf_values.clear();
+
+                forests[cascade].push_back(tree);
+            }
+        }
+
+        cmd.type = dist_shutdown;
+        coord.broadcast(cmd);
+        for (unsigned long i = 0; i < coord.num_workers(); ++i)
+            coord.receive(i, reply);
+
+        return shape_predictor(initial_shape, forests, index);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+}
+
+#endif // DLIB_SHAPE_PREDICToR_TIF_DISTRIBUTED_H_
+
@@ -102,6 +102,24 @@ namespace dlib
                 next_gaussian = 0;
             }
 
+            //[TIF] seeds the twister with value itself, for callers that already have a
+            // well mixed integer and reseed often, skipping the hashing and priming above.
+            void set_seed (
+                uint32 value
+            )
+            {
+                mt.seed(value);
+                seed.clear();
+                do
+                {
+                    seed.insert(seed.begin(), static_cast<char>('0' + value%10));
+                    value /= 10;
+                } while (value != 0);
+
+                has_gaussian = false;
+                next_gaussian = 0;
+            }
+
             unsigned char get_random_8bit_number (
             )
             {
@@ -80,6 +80,18 @@ namespace dlib
                     - #get_seed() == value
             !*/
 
+            void set_seed (
+                uint32 value
+            );
+            /*!
+                ensures
+                    - seeds the generator with value directly.  Unlike set_seed(string)
+                      this doesn't hash a string or discard the first outputs, so it is
+                      cheap enough to call for every small job, but it is only as random
+                      as value: give it the output of a good mixing function.
+                    - #get_seed() == the decimal representation of value
+            !*/
+
             unsigned char get_random_8bit_number (
             );
             /*!
@@ -6,9 +6,15 @@
 #include <dlib/image_processing.h>
 #include <vector>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
 #include <dlib/compress_stream.h>
 #include <dlib/base64.h>
 #include <dlib/image_io.h>
+#include <dlib/image_processing/shape_predictor_TIF_distributed.h>
+#include <dlib/image_processing/shape_predictor_LBF.h>
+#include <dlib/threads.h>
 
 //#include <dlib/gui_widgets.h>
 //#include <dlib/image_processing/render_face_detections.h>
@@ -48,6 +54,855 @@ namespace
             deserialize(objects[0], sin);
         }
 
+        struct copy_image_source
+        {
+            // Hands out copies of in-memory images so we can check that
+            // train_streaming() produces the same model as train().
+            typedef array2d<unsigned char> image_type;
+            copy_image_source(const dlib::array<array2d<unsigned char> >& images_) : images(images_) {}
+            unsigned long size() const { return images.size(); }
+            void operator()(unsigned long idx, image_type& img) const { assign_image(img, images[idx]); }
+            const dlib::array<array2d<unsigned char> >& images;
+        };
+
+        void test_streaming_trainer (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(2);
+            trainer.set_cascade_depth(3);
+            trainer.set_num_trees_per_cascade_level(20);
+
+            ostringstream sout1, sout2;
+            serialize(trainer.train(images, objects), sout1);
+
+            // The model must not depend on the number of threads used to train it.
+            trainer.set_num_threads(3);
+            serialize(trainer.train(images, objects), sout2);
+            DLIB_TEST(sout1.str() == sout2.str());
+
+            sout2.str("");
+            trainer.set_num_threads(2);
+            serialize(trainer.train_streaming(copy_image_source(images), objects), sout2);
+            DLIB_TEST(sout1.str() == sout2.str());
+
+            trainer.set_image_cache_size(1);
+            sout2.str("");
+            serialize(trainer.train_streaming(copy_image_source(images), objects), sout2);
+            DLIB_TEST(sout1.str() == sout2.str());
+        }
+
+        void test_checkpoints (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            const std::string checkpoint = "shape_predictor_checkpoint.dat";
+            std::remove(checkpoint.c_str());
+
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(2);
+            trainer.set_cascade_depth(3);
+            trainer.set_num_trees_per_cascade_level(20);
+            ostringstream sout1, sout2;
+            serialize(trainer.train(images, objects), sout1);
+
+            // Stop after two cascades and then resume to get the full model.
+            trainer.set_checkpoint_file(checkpoint);
+            trainer.set_cascade_depth(2);
+            shape_predictor sp = trainer.train(images, objects);
+            DLIB_TEST(sp.get_forests().size() == 2);
+            trainer.set_cascade_depth(3);
+            serialize(trainer.train(images, objects), sout2);
+            DLIB_TEST(sout1.str() == sout2.str());
+
+            // A checkpoint made with other settings isn't silently resumed.
+            trainer.set_nu(0.2);
+            bool rejected = false;
+            try { trainer.train(images, objects); }
+            catch (error&) { rejected = true; }
+            DLIB_TEST(rejected);
+            trainer.set_nu(0.1);
+
+            // Neither is a checkpoint of an older version.
+            {
+                ofstream fout(checkpoint.c_str(), ios::binary);
+                int old_version = 6;
+                serialize(old_version, fout);
+                serialize(trainer.get_random_seed(), fout);
+            }
+            rejected = false;
+            try { trainer.train(images, objects); }
+            catch (serialization_error&) { rejected = true; }
+            DLIB_TEST(rejected);
+            std::remove(checkpoint.c_str());
+
+            // Warm start with more trees in the existing cascades and a new cascade.
+            trainer.set_checkpoint_file("");
+            trainer.set_num_trees_per_cascade_level(30);
+            shape_predictor sp2 = trainer.continue_training(sp, images, objects);
+            DLIB_TEST(sp2.get_forests().size() == 3);
+            for (unsigned long i = 0; i < sp2.get_forests().size(); ++i)
+                DLIB_TEST(sp2.get_forests()[i].size() == 30);
+            DLIB_TEST(sp2.get_forests()[1][19].leaf_values[0] == sp.get_forests()[1][19].leaf_values[0]);
+            DLIB_TEST(test_shape_predictor(sp2, images, objects) < test_shape_predictor(sp, images, objects));
+        }
+
+        void test_training_start (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            shape_predictor_trainer trainer;
+            trainer.set_cascade_depth(3);
+            trainer.set_num_trees_per_cascade_level(20);
+            const shape_predictor_training_start start = trainer.prepare_training(images, objects);
+
+            // Models trained from a shared start must not depend on it.
+            for (unsigned long depth = 2; depth <= 3; ++depth)
+            {
+                trainer.set_tree_depth(depth);
+                ostringstream sout1, sout2;
+                serialize(trainer.train(images, objects), sout1);
+                serialize(trainer.train(images, objects, start), sout2);
+                DLIB_TEST(sout1.str() == sout2.str());
+            }
+        }
+
+        void test_telemetry (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            const std::string telemetry = "shape_predictor_telemetry.json";
+            std::remove(telemetry.c_str());
+
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(2);
+            trainer.set_cascade_depth(3);
+            trainer.set_num_trees_per_cascade_level(10);
+            ostringstream sout1, sout2;
+            serialize(trainer.train(images, objects), sout1);
+            trainer.set_telemetry_file(telemetry);
+            serialize(trainer.train(images, objects, images, objects), sout2);
+            DLIB_TEST(sout1.str() == sout2.str());
+
+            ifstream fin(telemetry.c_str());
+            string line;
+            unsigned long num_trees = 0, num_cascades = 0, num_lines = 0;
+            while (getline(fin, line))
+            {
+                ++num_lines;
+                DLIB_TEST(line[0] == '{' && line[line.size()-1] == '}');
+                if (line.find("\"event\":\"tree\"") != string::npos)
+                    ++num_trees;
+                if (line.find("\"event\":\"cascade\"") != string::npos)
+                {
+                    ++num_cascades;
+                    DLIB_TEST(line.find("\"held_out_error\":") != string::npos);
+                    DLIB_TEST(line.find("\"split_search_seconds\":") != string::npos);
+                }
+            }
+            DLIB_TEST(num_trees == 30);
+            DLIB_TEST(num_cascades == 3);
+            DLIB_TEST(num_lines == 35);
+            fin.close();
+            std::remove(telemetry.c_str());
+        }
+
+        void test_early_stopping (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            const std::string telemetry = "shape_predictor_early_stopping.json";
+            std::remove(telemetry.c_str());
+
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(2);
+            trainer.set_cascade_depth(10);
+            trainer.set_num_trees_per_cascade_level(50);
+            trainer.set_early_stopping_patience(5);
+            trainer.set_early_stopping_tolerance(0.01);
+            trainer.set_telemetry_file(telemetry);
+            const shape_predictor sp = trainer.train(images, objects, images, objects);
+
+            unsigned long num_trees = 0;
+            for (unsigned long i = 0; i < sp.get_forests().size(); ++i)
+            {
+                DLIB_TEST(sp.get_forests()[i].size() != 0);
+                num_trees += sp.get_forests()[i].size();
+            }
+            DLIB_TEST(sp.get_forests().size() == sp.get_index().size());
+            DLIB_TEST_MSG(num_trees < 10*50, num_trees);
+
+            // The incrementally tracked error of the last level is what the finished
+            // model really gets and the run says why it stopped.
+            ifstream fin(telemetry.c_str());
+            string line, last_cascade, done;
+            unsigned long num_plateaus = 0;
+            while (getline(fin, line))
+            {
+                if (line.find("\"event\":\"cascade\"") != string::npos && line.find("\"trees\":0,") == string::npos)
+                    last_cascade = line;
+                if (line.find("\"event\":\"done\"") != string::npos)
+                    done = line;
+                if (line.find("\"stop_reason\":\"plateau\"") != string::npos)
+                    ++num_plateaus;
+            }
+            DLIB_TEST(done.find("\"stop_reason\":\"plateau\"") != string::npos);
+            DLIB_TEST(num_plateaus >= 2);
+            const string key = "\"held_out_error\":";
+            const double held_out_error = atof(last_cascade.c_str() + last_cascade.find(key) + key.size());
+            const double error = test_shape_predictor(sp, images, objects);
+            DLIB_TEST_MSG(std::abs(held_out_error - error) <= 1e-4*error, held_out_error << " " << error);
+            fin.close();
+            std::remove(telemetry.c_str());
+            DLIB_TEST(trainer.get_stop_reason() == "plateau");
+
+            // A checkpoint remembers that the run stopped, so resuming it with more
+            // cascades doesn't grow the model any further.
+            const std::string checkpoint = "shape_predictor_early_stopping.dat";
+            std::remove(checkpoint.c_str());
+            trainer.set_telemetry_file("");
+            trainer.set_checkpoint_file(checkpoint);
+            ostringstream sout1, sout2;
+            serialize(trainer.train(images, objects, images, objects), sout1);
+            trainer.set_cascade_depth(20);
+            serialize(trainer.train(images, objects, images, objects), sout2);
+            DLIB_TEST(sout1.str() == sout2.str());
+            DLIB_TEST(trainer.get_stop_reason() == "plateau");
+            std::remove(checkpoint.c_str());
+
+            trainer.set_checkpoint_file("");
+            trainer.set_early_stopping_patience(0);
+            trainer.set_cascade_depth(2);
+            trainer.train(images, objects, images, objects);
+            DLIB_TEST(trainer.get_stop_reason() == "cascade_limit");
+        }
+
+        void test_ferns (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(3);
+            trainer.set_cascade_depth(4);
+            trainer.set_num_trees_per_cascade_level(30);
+            trainer.set_fern_structured_trees(true);
+            const shape_predictor sp = trainer.train(images, objects);
+
+            for (unsigned long i = 0; i < sp.get_forests().size(); ++i)
+            {
+                for (unsigned long j = 0; j < sp.get_forests()[i].size(); ++j)
+                {
+                    DLIB_TEST(sp.get_forests()[i][j].splits.size() == 7);
+                    DLIB_TEST(impl::is_fern(sp.get_forests()[i][j]));
+                }
+            }
+            DLIB_TEST(test_shape_predictor(sp, images, objects) < 1);
+
+            // The SIMD fern evaluator must land in exactly the leaves walking the trees
+            // does.
+            for (unsigned long i = 0; i < objects.size(); ++i)
+            {
+                const rectangle rect = objects[i][0].get_rect();
+                matrix<float,0,1> current_shape = sp.get_initial_shape();
+                std::vector<float> feature_pixel_values;
+                for (unsigned long c = 0; c < sp.get_forests().size(); ++c)
+                {
+                    impl::extract_feature_pixel_values(images[i], rect, current_shape, sp.get_index()[c], feature_pixel_values);
+                    for (unsigned long j = 0; j < sp.get_forests()[c].size(); ++j)
+                        current_shape += sp.get_forests()[c][j](feature_pixel_values);
+                }
+                const full_object_detection det = sp(images[i], rect);
+                const point_transform_affine tform_to_img = impl::unnormalizing_tform(rect);
+                for (unsigned long k = 0; k < det.num_parts(); ++k)
+                    DLIB_TEST(det.part(k) == point(tform_to_img(impl::location(current_shape, k))));
+            }
+
+            // a serialized fern model comes back with its fast evaluator
+            ostringstream sout;
+            serialize(sp, sout);
+            istringstream sin(sout.str());
+            shape_predictor sp2;
+            deserialize(sp2, sin);
+            DLIB_TEST(test_shape_predictor(sp2, images, objects) == test_shape_predictor(sp, images, objects));
+        }
+
+        void test_leaf_basis (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(2);
+            trainer.set_cascade_depth(4);
+            trainer.set_num_trees_per_cascade_level(30);
+            const shape_predictor sp = trainer.train(images, objects);
+            const long dims = sp.get_initial_shape().size();
+            const double error = test_shape_predictor(sp, images, objects);
+
+            // A full basis only reorders the arithmetic.
+            const shape_predictor full = compress_shape_predictor_leaves(sp, dims);
+            DLIB_TEST(full.get_leaf_bases().size() == sp.get_forests().size());
+            DLIB_TEST_MSG(std::abs(test_shape_predictor(full, images, objects) - error) < 0.05, error);
+
+            const shape_predictor small = compress_shape_predictor_leaves(sp, 3);
+            for (unsigned long i = 0; i < small.get_forests().size(); ++i)
+            {
+                DLIB_TEST(small.get_leaf_bases()[i].nr() == dims && small.get_leaf_bases()[i].nc() == 3);
+                DLIB_TEST(small.get_forests()[i][0].leaf_values[0].size() == 3);
+            }
+            ostringstream sout;
+            serialize(small, sout);
+            istringstream sin(sout.str());
+            shape_predictor small2;
+            deserialize(small2, sin);
+            DLIB_TEST(test_shape_predictor(small2, images, objects) == test_shape_predictor(small, images, objects));
+
+            // Compressing twice with the same size doesn't change the model any further.
+            const shape_predictor small3 = compress_shape_predictor_leaves(small, 3);
+            DLIB_TEST(std::abs(test_shape_predictor(small3, images, objects) - test_shape_predictor(small, images, objects)) < 0.05);
+
+            trainer.set_leaf_basis_size(3);
+            const shape_predictor trained = trainer.train(images, objects);
+            DLIB_TEST(trained.get_leaf_bases().size() == trained.get_forests().size());
+            DLIB_TEST(trained.get_forests()[0][0].leaf_values[0].size() == 3);
+            DLIB_TEST_MSG(test_shape_predictor(trained, images, objects) < 2*error + 1,
+                test_shape_predictor(trained, images, objects) << " " << error);
+        }
+
+        void test_lbf_trainer (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            lbf_shape_predictor_trainer trainer;
+            trainer.set_cascade_depth(3);
+            trainer.set_num_trees_per_part(5);
+            trainer.set_tree_depth(3);
+            const lbf_shape_predictor sp = trainer.train(images, objects);
+
+            const unsigned long num_parts = objects[0][0].num_parts();
+            DLIB_TEST(sp.num_parts() == num_parts);
+            DLIB_TEST(sp.get_cascade_depth() == 3);
+            DLIB_TEST(sp.get_splits()[0].size() == num_parts*5*7);
+            DLIB_TEST(sp.get_weights()[0].nr() == (long)num_parts*5*8);
+            DLIB_TEST(sp.get_weights()[0].nc() == (long)num_parts*2);
+            DLIB_TEST(sp.get_index()[0].get_num_of_anchors() == num_parts*trainer.get_features_per_part());
+            const double error = test_shape_predictor(sp, images, objects);
+            dlog << LINFO << "LBF training error: " << error;
+            DLIB_TEST_MSG(error < 1, error);
+
+            // summing the weight rows of the leaves is what a shape_predictor with those
+            // rows as leaf values does.
+            std::vector<std::vector<impl::regression_tree> > forests(sp.get_cascade_depth());
+            for (unsigned long c = 0; c < forests.size(); ++c)
+            {
+                forests[c].resize(sp.get_splits()[c].size()/7);
+                for (unsigned long t = 0; t < forests[c].size(); ++t)
+                {
+                    forests[c][t].splits.assign(sp.get_splits()[c].begin() + t*7, sp.get_splits()[c].begin() + (t+1)*7);
+                    for (unsigned long k = 0; k < 8; ++k)
+                        forests[c][t].leaf_values.push_back(trans(rowm(sp.get_weights()[c], t*8 + k)));
+                }
+            }
+            const shape_predictor same(sp.get_initial_shape(), forests, sp.get_index());
+            DLIB_TEST(std::abs(test_shape_predictor(same, images, objects) - error) < 1e-4);
+
+            ostringstream sout1, sout2;
+            serialize(sp, sout1);
+            lbf_shape_predictor sp2;
+            istringstream sin(sout1.str());
+            deserialize(sp2, sin);
+            DLIB_TEST(test_shape_predictor(sp2, images, objects) == error);
+
+            // the model doesn't depend on the number of threads
+            trainer.set_num_threads(3);
+            serialize(trainer.train(images, objects), sout2);
+            DLIB_TEST(sout1.str() == sout2.str());
+
+            // nu only changes the splits, the model is still fit
+            trainer.set_nu(1);
+            DLIB_TEST(trainer.get_nu() == 1);
+            const lbf_shape_predictor sp1 = trainer.train(images, objects);
+            DLIB_TEST_MSG(test_shape_predictor(sp1, images, objects) < 1, test_shape_predictor(sp1, images, objects));
+        }
+
+        struct scripted_detector
+        {
+            // Hands out prepared detections, one list per call, so that
+            // find_detector_components() can be checked against a known answer.
+            scripted_detector(const std::vector<std::vector<rect_detection> >& dets_) : dets(dets_), calls(0) {}
+
+            unsigned long num_detectors() const { return 3; }
+
+            void operator() (
+                const array2d<unsigned char>& ,
+                std::vector<rect_detection>& out
+            ) { out = dets[calls++]; }
+
+            std::vector<std::vector<rect_detection> > dets;
+            unsigned long calls;
+        };
+
+        void test_component_initial_shapes (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            // Two groups of faces with clearly different shapes: the faces as they are
+            // and mirrored without renumbering the parts.
+            dlib::array<array2d<unsigned char> > imgs(2);
+            assign_image(imgs[0], images[0]);
+            const point_transform_affine flip = flip_image_left_right(images[0], imgs[1]);
+            std::vector<std::vector<full_object_detection> > objs(2);
+            objs[0] = objects[0];
+            for (unsigned long j = 0; j < objects[0].size(); ++j)
+            {
+                const full_object_detection& obj = objects[0][j];
+                std::vector<point> parts;
+                for (unsigned long k = 0; k < obj.num_parts(); ++k)
+                    parts.push_back(flip(obj.part(k)));
+                const rectangle rect(flip(obj.get_rect().tr_corner()), flip(obj.get_rect().bl_corner()));
+                objs[1].push_back(full_object_detection(rect, parts));
+            }
+
+            // Detector component 0 finds the first group and component 1 the second.
+            // A looser detection by component 2 overlaps every face too but loses, and
+            // the last mirrored face isn't found at all.
+            std::vector<std::vector<rect_detection> > dets(2);
+            for (unsigned long i = 0; i < 2; ++i)
+            {
+                for (unsigned long j = 0; j < objs[i].size(); ++j)
+                {
+                    if (i == 1 && j+1 == objs[i].size())
+                        continue;
+                    rect_detection det;
+                    det.weight_index = 2;
+                    det.rect = grow_rect(objs[i][j].get_rect(), objs[i][j].get_rect().width()/10);
+                    dets[i].push_back(det);
+                    det.weight_index = i;
+                    det.rect = translate_rect(objs[i][j].get_rect(), point(1,1));
+                    dets[i].push_back(det);
+                }
+                dets[i].push_back(rect_detection());
+            }
+            scripted_detector detector(dets);
+            const std::vector<std::vector<unsigned long> > components = find_detector_components(detector, imgs, objs);
+            DLIB_TEST(components.size() == 2);
+            for (unsigned long i = 0; i < 2; ++i)
+            {
+                DLIB_TEST(components[i].size() == objs[i].size());
+                for (unsigned long j = 0; j < components[i].size(); ++j)
+                {
+                    const unsigned long expected = (i == 1 && j+1 == objs[i].size()) ? 3 : i;
+                    DLIB_TEST(components[i][j] == expected);
+                }
+            }
+
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(2);
+            trainer.set_cascade_depth(1);
+            trainer.set_num_trees_per_cascade_level(5);
+            const shape_predictor sp = trainer.train(imgs, objs, components);
+
+            // Every component starts from the mean shape of its own faces.  Component
+            // 2 found no face and the face nobody found has a component of its own.
+            std::vector<matrix<float,0,1> > means(4);
+            std::vector<long> counts(4, 0);
+            for (unsigned long i = 0; i < 2; ++i)
+            {
+                for (unsigned long j = 0; j < objs[i].size(); ++j)
+                {
+                    means[components[i][j]] += impl::object_to_shape(objs[i][j]);
+                    ++counts[components[i][j]];
+                }
+            }
+            DLIB_TEST(sp.get_component_initial_shapes().size() == 4);
+            DLIB_TEST(sp.get_component_initial_shapes()[2].size() == 0);
+            for (unsigned long k = 0; k < 4; ++k)
+            {
+                if (counts[k] != 0)
+                    DLIB_TEST(max(abs(sp.get_component_initial_shapes()[k] - means[k]/counts[k])) < 1e-5);
+            }
+            DLIB_TEST(max(abs(sp.get_component_initial_shapes()[0] - sp.get_component_initial_shapes()[1])) > 0.1);
+
+            double with = 0, without = 0;
+            for (unsigned long i = 0; i < 2; ++i)
+            {
+                for (unsigned long j = 0; j < objs[i].size(); ++j)
+                {
+                    const full_object_detection a = sp(imgs[i], objs[i][j].get_rect(), components[i][j]);
+                    const full_object_detection b = sp(imgs[i], objs[i][j].get_rect());
+                    for (unsigned long k = 0; k < a.num_parts(); ++k)
+                    {
+                        with += length(a.part(k) - objs[i][j].part(k));
+                        without += length(b.part(k) - objs[i][j].part(k));
+                    }
+                }
+            }
+            DLIB_TEST_MSG(with < without, with << " " << without);
+
+            // Unknown components fall back to the mean shape.
+            DLIB_TEST(sp(imgs[0], objs[0][0].get_rect(), 1000).part(0) == 
+                      sp(imgs[0], objs[0][0].get_rect()).part(0));
+
+            ostringstream sout;
+            serialize(sp, sout);
+            istringstream sin(sout.str());
+            shape_predictor sp2;
+            deserialize(sp2, sin);
+            DLIB_TEST(sp2.get_component_initial_shapes().size() == 4);
+            DLIB_TEST(sp2(imgs[1], objs[1][1].get_rect(), 1).part(3) == 
+                      sp(imgs[1], objs[1][1].get_rect(), 1).part(3));
+        }
+
+        void test_landmark_subset (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            std::vector<unsigned long> parts;
+            parts.push_back(36);
+            parts.push_back(45);
+            parts.push_back(30);
+            parts.push_back(48);
+            parts.push_back(54);
+            // the checks set_landmark_subset() and train() assert.  A subset of fewer
+            // than 3 parts has no triplets to sample features from.
+            const unsigned long num_parts = objects[0][0].num_parts();
+            DLIB_TEST(impl::is_valid_landmark_subset(std::vector<unsigned long>(), num_parts));
+            DLIB_TEST(impl::is_valid_landmark_subset(parts, num_parts));
+            DLIB_TEST(!impl::is_valid_landmark_subset(std::vector<unsigned long>(parts.begin(), parts.begin()+2), num_parts));
+            DLIB_TEST(impl::is_valid_landmark_subset(std::vector<unsigned long>(parts.begin(), parts.begin()+3), num_parts));
+            std::vector<unsigned long> bad = parts;
+            bad.push_back(num_parts);
+            DLIB_TEST(!impl::is_valid_landmark_subset(bad, num_parts));
+            bad.back() = num_parts-1;
+            DLIB_TEST(impl::is_valid_landmark_subset(bad, num_parts));
+            bad.back() = parts[0];
+            DLIB_TEST(!impl::is_valid_landmark_subset(bad, num_parts));
+
+            const std::vector<std::vector<full_object_detection> > subset_objects = select_landmark_subset(objects, parts);
+            DLIB_TEST(subset_objects[0][1].num_parts() == 5);
+            DLIB_TEST(subset_objects[0][1].part(2) == objects[0][1].part(30));
+
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(2);
+            trainer.set_cascade_depth(3);
+            trainer.set_num_trees_per_cascade_level(20);
+            trainer.set_landmark_subset(parts);
+            const shape_predictor sp = trainer.train(images, objects);
+            DLIB_TEST(sp.get_initial_shape().size() == 10);
+            DLIB_TEST(sp.get_forests()[0][0].leaf_values[0].size() == 10);
+            for (unsigned long i = 0; i < sp.get_index().size(); ++i)
+            {
+                impl::index_feature index = sp.get_index()[i];
+                for (unsigned long j = 0; j < index.get_num_of_anchors(); ++j)
+                {
+                    const std::vector<unsigned long> anchor = index.anchor(j);
+                    DLIB_TEST(anchor[0] < 5 && anchor[1] < 5 && anchor[2] < 5);
+                }
+            }
+            const double error = test_shape_predictor(sp, images, subset_objects);
+            DLIB_TEST_MSG(error < 2, error);
+
+            // Same model as training on the subset directly, and from a training start.
+            trainer.set_landmark_subset(std::vector<unsigned long>());
+            ostringstream sout1, sout2, sout3;
+            serialize(sp, sout1);
+            serialize(trainer.train(images, subset_objects), sout2);
+            DLIB_TEST(sout1.str() == sout2.str());
+            trainer.set_landmark_subset(parts);
+            serialize(trainer.train(images, objects, trainer.prepare_training(images, objects)), sout3);
+            DLIB_TEST(sout1.str() == sout3.str());
+
+            // The held out error is measured on the subset too.
+            trainer.set_early_stopping_patience(5);
+            const shape_predictor sp2 = trainer.train(images, objects, images, objects);
+            DLIB_TEST(sp2.get_initial_shape().size() == 10);
+        }
+
+        void test_tree_reordering (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(3);
+            trainer.set_cascade_depth(3);
+            trainer.set_num_trees_per_cascade_level(20);
+            const shape_predictor sp = trainer.train(images, objects);
+
+            const std::vector<std::vector<std::vector<unsigned long> > > visits = profile_shape_predictor_branches(sp, images, objects);
+            DLIB_TEST(visits.size() == 3 && visits[0].size() == 20 && visits[0][0].size() == 15);
+            // every face goes through the root of every tree and ends in one leaf
+            DLIB_TEST(visits[2][7][0] == objects[0].size());
+            unsigned long leaf_visits = 0;
+            for (unsigned long n = 7; n < 15; ++n)
+                leaf_visits += visits[2][7][n];
+            DLIB_TEST(leaf_visits == objects[0].size());
+
+            const shape_predictor reordered = reorder_shape_predictor_trees(sp, visits);
+            DLIB_TEST(reordered.get_forest_layouts().size() == 3);
+            const std::vector<unsigned long>& order = reordered.get_forest_layouts()[1].get_tree_order();
+            DLIB_TEST(order.size() == 20 && std::set<unsigned long>(order.begin(), order.end()).size() == 20);
+
+            // The layout must not change a single landmark, on the training boxes and
+            // on shifted ones that take other branches.
+            ostringstream sout;
+            serialize(reordered, sout);
+            istringstream sin(sout.str());
+            shape_predictor reordered2;
+            deserialize(reordered2, sin);
+            for (unsigned long j = 0; j < objects[0].size(); ++j)
+            {
+                for (long shift = 0; shift < 20; shift += 7)
+                {
+                    const rectangle rect = translate_rect(objects[0][j].get_rect(), point(shift, -shift));
+                    const full_object_detection a = sp(images[0], rect);
+                    const full_object_detection b = reordered2(images[0], rect);
+                    for (unsigned long k = 0; k < a.num_parts(); ++k)
+                        DLIB_TEST(a.part(k) == b.part(k));
+                }
+            }
+
+            // Faces of a detector component are profiled from that component's initial
+            // shape, just like the model runs them.
+            matrix<float,0,1> shifted = sp.get_initial_shape();
+            for (long k = 0; k < shifted.size(); k += 2)
+                shifted(k) += 0.05;
+            const shape_predictor with_component(sp.get_initial_shape(), sp.get_forests(), sp.get_index(),
+                sp.get_leaf_bases(), std::vector<matrix<float,0,1> >(1, shifted));
+            const shape_predictor shifted_sp(shifted, sp.get_forests(), sp.get_index(), sp.get_leaf_bases());
+            std::vector<std::vector<unsigned long> > components(1, std::vector<unsigned long>(objects[0].size(), 0));
+            const std::vector<std::vector<std::vector<unsigned long> > > component_visits =
+                profile_shape_predictor_branches(with_component, images, objects, components);
+            DLIB_TEST(component_visits == profile_shape_predictor_branches(shifted_sp, images, objects));
+            DLIB_TEST(component_visits != profile_shape_predictor_branches(with_component, images, objects));
+            DLIB_TEST(profile_shape_predictor_branches(with_component, images, objects) == visits);
+        }
+
+        void test_evaluation (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(2);
+            trainer.set_cascade_depth(2);
+            trainer.set_num_trees_per_cascade_level(10);
+            const shape_predictor sp = trainer.train(images, objects);
+
+            std::vector<std::vector<double> > diagonals(1);
+            for (unsigned long j = 0; j < objects[0].size(); ++j)
+            {
+                const rectangle& r = objects[0][j].get_rect();
+                diagonals[0].push_back(std::sqrt((double)r.width()*r.width() + (double)r.height()*r.height()));
+            }
+
+            shape_predictor_evaluation_options options;
+            const shape_predictor_evaluation eval = evaluate_shape_predictor(sp, images, objects, options);
+            DLIB_TEST(eval.num_faces == objects[0].size());
+            DLIB_TEST(std::abs(eval.mean_error - test_shape_predictor(sp, images, objects, diagonals)) < 1e-12);
+            DLIB_TEST(eval.landmark_mean_error.size() == objects[0][0].num_parts());
+            DLIB_TEST(eval.landmark_median_error.size() == objects[0][0].num_parts());
+            DLIB_TEST(eval.ced_error.size() == options.ced_steps+1 && eval.ced_fraction.size() == options.ced_steps+1);
+            for (unsigned long i = 1; i < eval.ced_fraction.size(); ++i)
+                DLIB_TEST(eval.ced_fraction[i-1] <= eval.ced_fraction[i]);
+            // the failure threshold is a point of the default curve
+            DLIB_TEST(std::abs(eval.failure_rate - (1 - eval.ced_fraction[50])) < 1e-12);
+            DLIB_TEST(eval.latency_p50 <= eval.latency_p90 && eval.latency_p90 <= eval.latency_p99 &&
+                      eval.latency_p99 <= eval.max_latency);
+
+            // The errors don't depend on the number of threads.
+            options.num_threads = 3;
+            options.normalization = shape_predictor_evaluation_options::inter_ocular;
+            options.left_eye_parts.push_back(36);
+            options.left_eye_parts.push_back(39);
+            options.right_eye_parts.push_back(42);
+            options.right_eye_parts.push_back(45);
+            const shape_predictor_evaluation eval3 = evaluate_shape_predictor(sp, images, objects, options);
+            options.num_threads = 0;
+            const shape_predictor_evaluation eval1 = evaluate_shape_predictor(sp, images, objects, options);
+            DLIB_TEST(eval3.landmark_median_error == eval1.landmark_median_error);
+            DLIB_TEST(eval3.mean_error == eval1.mean_error);
+            DLIB_TEST(eval1.mean_error > eval.mean_error);
+        }
+
+        void test_augmentation (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            const full_object_detection& obj = objects[0][0];
+            std::vector<unsigned long> perm;
+            for (unsigned long k = 0; k < obj.num_parts(); ++k)
+                perm.push_back(obj.num_parts()-1-k);
+
+            // The truth shape of an augmented sample must land on the right image
+            // points when mapped through the sample's transform.
+            impl::training_objects table;
+            table.add(obj);
+            table.set_mirror_permutation(perm);
+            impl::training_sample sample;
+            sample.object_idx = 0;
+            sample.aug.mirrored = true;
+            sample.aug.dx = 0.1;
+            sample.aug.dy = -0.05;
+            sample.aug.scale = 1.2;
+            sample.current_shape = zeros_matrix<float>(obj.num_parts()*2, 1);
+            matrix<float,0,1> target;
+            table.residual(sample, target);
+            const point_transform_affine tform = table.tform_to_img(sample);
+            for (unsigned long k = 0; k < obj.num_parts(); ++k)
+            {
+                const dlib::vector<double,2> p = tform(dlib::vector<double,2>(target(2*k), target(2*k+1)));
+                DLIB_TEST_MSG(length(p - obj.part(perm[k])) < 1e-3, length(p - obj.part(perm[k])));
+            }
+
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(2);
+            trainer.set_cascade_depth(3);
+            trainer.set_num_trees_per_cascade_level(20);
+            trainer.set_mirror_part_permutation(perm);
+            trainer.set_box_translation_jitter(0.05);
+            trainer.set_box_scale_jitter(0.1);
+            ostringstream sout1, sout2;
+            const shape_predictor sp = trainer.train(images, objects);
+            serialize(sp, sout1);
+            trainer.set_num_threads(3);
+            serialize(trainer.train(images, objects), sout2);
+            DLIB_TEST(sout1.str() == sout2.str());
+            const double err = test_shape_predictor(sp, images, objects);
+            dlog << LINFO << "augmented training error: " << err;
+            DLIB_TEST(err < 5);
+        }
+
+        struct training_worker
+        {
+            // runs one shard of the distributed trainer in its own thread
+            training_worker (
+                unsigned short port_,
+                const dlib::array<array2d<unsigned char> >& images_,
+                const std::vector<std::vector<full_object_detection> >& objects_
+            ) : port(port_), images(images_), objects(objects_) {}
+
+            void operator()() const { serve_shape_predictor_training_shard(port, images, objects); }
+
+            unsigned short port;
+            const dlib::array<array2d<unsigned char> >& images;
+            std::vector<std::vector<full_object_detection> > objects;
+        };
+
+        struct crashing_worker
+        {
+            // accepts the coordinator and then drops the connection, as if the
+            // worker process had died.
+            crashing_worker(listener& list_) : list(list_) {}
+
+            void operator()() const
+            {
+                connection* con = 0;
+                if (list.accept(con, 10000) == 0)
+                    delete con;
+            }
+
+            listener& list;
+        };
+
+        unsigned short get_free_port (
+        )
+        {
+            // Let the OS pick an unused port.  The listener is closed right away so a
+            // worker can bind the port.
+            scoped_ptr<listener> list;
+            DLIB_TEST(create_listener(list, 0, "127.0.0.1") == 0);
+            return list->get_listening_port();
+        }
+
+        void test_distributed_trainer (
+            const dlib::array<array2d<unsigned char> >& images,
+            const std::vector<std::vector<full_object_detection> >& objects
+        )
+        {
+            // give each of two workers every other face
+            std::vector<std::vector<full_object_detection> > shard1(1), shard2(1);
+            for (unsigned long i = 0; i < objects[0].size(); ++i)
+            {
+                if (i%2 == 0)
+                    shard1[0].push_back(objects[0][i]);
+                else
+                    shard2[0].push_back(objects[0][i]);
+            }
+
+            shape_predictor_trainer trainer;
+            trainer.set_tree_depth(2);
+            trainer.set_cascade_depth(3);
+            trainer.set_num_trees_per_cascade_level(30);
+            const shape_predictor local_sp = trainer.train(images, objects);
+
+            // A single worker holding all the data reproduces train() exactly.
+            {
+                const unsigned short port = get_free_port();
+                std::vector<network_address> workers;
+                workers.push_back(network_address("127.0.0.1", port));
+                training_worker w(port, images, objects);
+                thread_function t(w);
+                ostringstream sout1, sout2;
+                serialize(local_sp, sout1);
+                serialize(train_shape_predictor_distributed(trainer, workers), sout2);
+                DLIB_TEST(sout1.str() == sout2.str());
+            }
+
+            shape_predictor sp;
+            {
+                const unsigned short port1 = get_free_port();
+                const unsigned short port2 = get_free_port();
+                std::vector<network_address> workers;
+                workers.push_back(network_address("127.0.0.1", port1));
+                workers.push_back(network_address("127.0.0.1", port2));
+                training_worker w1(port1, images, shard1), w2(port2, images, shard2);
+                thread_function t1(w1), t2(w2);
+                sp = train_shape_predictor_distributed(trainer, workers);
+            }
+
+            const double local_err = test_shape_predictor(local_sp, images, objects);
+            const double dist_err = test_shape_predictor(sp, images, objects);
+            dlog << LINFO << "local error: " << local_err << "  distributed error: " << dist_err;
+            DLIB_TEST(sp.get_forests().size() == 3);
+            DLIB_TEST(dist_err < local_err + 0.5);
+
+            // A worker that is gone makes training fail instead of hanging.
+            {
+                std::vector<network_address> workers;
+                workers.push_back(network_address("127.0.0.1", get_free_port()));
+                bool timed_out = false;
+                try { train_shape_predictor_distributed(trainer, workers, 500); }
+                catch (error&) { timed_out = true; }
+                DLIB_TEST(timed_out);
+            }
+
+            // So does a worker that hangs up in the middle of training.
+            {
+                scoped_ptr<listener> list;
+                DLIB_TEST(create_listener(list, 0, "127.0.0.1") == 0);
+                std::vector<network_address> workers;
+                workers.push_back(network_address("127.0.0.1", list->get_listening_port()));
+                crashing_worker w(*list);
+                thread_function t(w);
+                bool lost = false;
+                try { train_shape_predictor_distributed(trainer, workers); }
+                catch (error&) { lost = true; }
+                DLIB_TEST(lost);
+            }
+        }
+
         void perform_test()
         {
             print_spinner();
@@ -70,6 +925,35 @@ namespace
             // It should have been able to perfectly fit the data
             DLIB_TEST(test_shape_predictor(sp, images, objects) == 0);
 
+            print_spinner();
+            test_streaming_trainer(images, objects);
+            print_spinner();
+            test_checkpoints(images, objects);
+            print_spinner();
+            test_training_start(images, objects);
+            print_spinner();
+            test_telemetry(images, objects);
+            print_spinner();
+            test_early_stopping(images, objects);
+            print_spinner();
+            test_ferns(images, objects);
+            print_spinner();
+            test_leaf_basis(images, objects);
+            print_spinner();
+            test_lbf_trainer(images, objects);
+            print_spinner();
+            test_component_initial_shapes(images, objects);
+            print_spinner();
+            test_landmark_subset(images, objects);
+            print_spinner();
+            test_tree_reordering(images, objects);
+            print_spinner();
+            test_evaluation(images, objects);
+            print_spinner();
+            test_augmentation(images, objects);
+            print_spinner();
+            test_distributed_trainer(images, objects);
+
             print_spinner();
 
             // While we are here, make sure the default face detector works
@@ -58,6 +58,13 @@ namespace
 
             detector(images[i], dets2);
 
+            // the const interface gives the same detections, with the scratch memory kept
+            // in a workspace.
+            const detector_type& const_detector = detector;
+            typename detector_type::workspace_type workspace;
+            DLIB_TEST(const_detector(images[i], workspace) == dets);
+            DLIB_TEST(const_detector(images[i], workspace) == dets);
+
             matrix<double,0,1> psi(detector.get_w().size());
             matrix<double,0,1> psi2(detector.get_w().size());
             const double thresh = detector.get_w()(detector.get_w().size()-1);
@@ -432,6 +439,336 @@ namespace
         }
     }
 
+// ----------------------------------------------------------------------------------------
+
+    template <typename pyramid_type, typename image_type>
+    void check_parallel_fhog_pyramid (
+        thread_pool& tp,
+        const image_type& img
+    )
+    {
+        default_fhog_feature_extractor fe;
+        dlib::array<dlib::array<array2d<float> > > feats, pfeats;
+        impl::create_fhog_pyramid<pyramid_type>(img, fe, feats, 8, 40, 40, 20, 20, 1000);
+        impl::create_fhog_pyramid<pyramid_type>(tp, img, fe, pfeats, 8, 40, 40, 20, 20, 1000);
+        DLIB_TEST(feats.size() > 2);
+        DLIB_TEST(feats.size() == pfeats.size());
+        for (unsigned long i = 0; i < feats.size(); ++i)
+        {
+            DLIB_TEST(feats[i].size() == pfeats[i].size());
+            for (unsigned long j = 0; j < feats[i].size(); ++j)
+            {
+                DLIB_TEST(feats[i][j].nr() == pfeats[i][j].nr() && feats[i][j].nc() == pfeats[i][j].nc());
+                DLIB_TEST(mat(feats[i][j]) == mat(pfeats[i][j]));
+            }
+        }
+    }
+
+    void test_parallel_fhog_pyramid (
+    )
+    {
+        print_spinner();
+        dlog << LINFO << "test_parallel_fhog_pyramid()";
+
+        dlib::rand rnd;
+        array2d<unsigned char> img(301, 427);
+        array2d<rgb_pixel> color_img(250, 333);
+        for (long r = 0; r < img.nr(); ++r)
+            for (long c = 0; c < img.nc(); ++c)
+                img[r][c] = rnd.get_random_8bit_number();
+        for (long r = 0; r < color_img.nr(); ++r)
+            for (long c = 0; c < color_img.nc(); ++c)
+                color_img[r][c] = rgb_pixel(rnd.get_random_8bit_number(), rnd.get_random_8bit_number(), rnd.get_random_8bit_number());
+
+        thread_pool tp(3);
+        check_parallel_fhog_pyramid<pyramid_down<6> >(tp, img);
+        check_parallel_fhog_pyramid<pyramid_down<2> >(tp, img);
+        check_parallel_fhog_pyramid<pyramid_down<6> >(tp, color_img);
+        thread_pool tp0(0);
+        check_parallel_fhog_pyramid<pyramid_down<3> >(tp0, img);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    struct throwing_pyramid : pyramid_down<2>
+    {
+        // throws from its third downsampling, after three levels were queued.
+        throwing_pyramid() : calls(0) {}
+
+        template <typename in_image_type, typename out_image_type>
+        void operator() (
+            const in_image_type& in,
+            out_image_type& out
+        )
+        {
+            if (++calls == 3)
+                throw dlib::error("throwing_pyramid");
+            pyramid_down<2>::operator()(in, out);
+        }
+
+        int calls;
+    };
+
+    struct slow_fhog_extractor
+    {
+        // counts the levels it has finished extracting.
+        slow_fhog_extractor (
+            mutex& m_,
+            int& finished_
+        ) : m(m_), finished(finished_) {}
+
+        template <typename image_type>
+        void operator() (
+            const image_type& img,
+            dlib::array<array2d<float> >& hog,
+            int cell_size,
+            int filter_rows_padding,
+            int filter_cols_padding
+        ) const
+        {
+            dlib::sleep(100);
+            fe(img, hog, cell_size, filter_rows_padding, filter_cols_padding);
+            auto_mutex lock(m);
+            ++finished;
+        }
+
+        unsigned long get_num_planes() const { return fe.get_num_planes(); }
+
+        default_fhog_feature_extractor fe;
+        mutex& m;
+        int& finished;
+    };
+
+    void test_parallel_fhog_pyramid_exception (
+    )
+    {
+        print_spinner();
+        dlog << LINFO << "test_parallel_fhog_pyramid_exception()";
+
+        array2d<unsigned char> img(400, 400);
+        assign_all_pixels(img, 100);
+        mutex m;
+        int finished = 0;
+        slow_fhog_extractor fe(m, finished);
+        dlib::array<dlib::array<array2d<float> > > feats;
+        thread_pool tp(2);
+        bool thrown = false;
+        try
+        {
+            impl::create_fhog_pyramid<throwing_pyramid>(tp, img, fe, feats, 8, 40, 40, 20, 20, 1000);
+        }
+        catch (dlib::error&)
+        {
+            thrown = true;
+        }
+        DLIB_TEST(thrown);
+        // the levels queued before the pyramid threw are done before the exception
+        // leaves create_fhog_pyramid(), while their images are still alive.
+        auto_mutex lock(m);
+        DLIB_TEST_MSG(finished == 3, finished);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    bool same_detections (
+        const std::vector<rect_detection>& a,
+        const std::vector<rect_detection>& b
+    )
+    {
+        if (a.size() != b.size())
+            return false;
+        for (unsigned long i = 0; i < a.size(); ++i)
+        {
+            if (a[i].rect != b[i].rect || a[i].weight_index != b[i].weight_index ||
+                a[i].detection_confidence != b[i].detection_confidence)
+                return false;
+        }
+        return true;
+    }
+
+    void test_fused_fhog_detection (
+    )
+    {
+        print_spinner();
+        dlog << LINFO << "test_fused_fhog_detection()";
+
+        typedef scan_fhog_pyramid<pyramid_down<3> > image_scanner_type;
+        image_scanner_type scanner;
+        scanner.set_detection_window_size(40,40);
+
+        dlib::rand rnd;
+        array2d<unsigned char> img(200, 260);
+        for (long r = 0; r < img.nr(); ++r)
+            for (long c = 0; c < img.nc(); ++c)
+                img[r][c] = rnd.get_random_8bit_number();
+        fill_rect(img, centered_rect(point(80,90), 50,50), 255);
+
+        // a few random filters, with thresholds that let some but not all windows through.
+        std::vector<image_scanner_type::feature_vector_type> ws(3);
+        for (unsigned long i = 0; i < ws.size(); ++i)
+        {
+            ws[i].set_size(scanner.get_num_dimensions()+1);
+            for (long j = 0; j < ws[i].size(); ++j)
+                ws[i](j) = rnd.get_random_gaussian()*0.01;
+            ws[i](scanner.get_num_dimensions()) = 0.1*i;
+        }
+        object_detector<image_scanner_type> detector(scanner, test_box_overlap(), ws);
+        DLIB_TEST(detector.num_detectors() == 3);
+
+        std::vector<const image_scanner_type::fhog_filterbank*> filterbanks;
+        std::vector<double> thresh;
+        for (unsigned long i = 0; i < detector.num_detectors(); ++i)
+        {
+            filterbanks.push_back(&detector.get_processed_w(i).get_detect_argument());
+            thresh.push_back(detector.get_processed_w(i).w(scanner.get_num_dimensions()));
+        }
+
+        // the fused scan finds exactly what scanning with each filter in turn finds.
+        scanner.load(img);
+        std::vector<std::vector<std::pair<double, rectangle> > > dets;
+        scanner.detect(filterbanks, thresh, dets);
+        DLIB_TEST(dets.size() == filterbanks.size());
+        unsigned long total = 0;
+        for (unsigned long i = 0; i < filterbanks.size(); ++i)
+        {
+            std::vector<std::pair<double, rectangle> > single;
+            scanner.detect(*filterbanks[i], single, thresh[i]);
+            DLIB_TEST(single == dets[i]);
+            total += single.size();
+        }
+        DLIB_TEST(total > 0);
+
+        // the levels can also be scanned in parallel.
+        dlib::array<dlib::array<array2d<float> > > feats;
+        impl::create_fhog_pyramid<pyramid_down<3> >(img, scanner.get_feature_extractor(), feats, 8, 40, 40, 40, 40, 1000);
+        std::vector<std::vector<std::pair<double, rectangle> > > dets1, dets2;
+        impl::detect_from_fhog_pyramid<pyramid_down<3> >(feats, scanner.get_feature_extractor(), filterbanks,
+            thresh, 5, 5, 8, 40, 40, dets1);
+        thread_pool tp(3);
+        impl::detect_from_fhog_pyramid<pyramid_down<3> >(tp, feats, scanner.get_feature_extractor(), filterbanks,
+            thresh, 5, 5, 8, 40, 40, dets2);
+        DLIB_TEST(dets1.size() == 3);
+        DLIB_TEST(dets1 == dets2);
+
+        // object_detector uses the fused scan and gets what the generic one-filter-at-a-time
+        // loop gets.
+        std::vector<processed_weight_vector<image_scanner_type> > pw(ws.size());
+        for (unsigned long i = 0; i < ws.size(); ++i)
+        {
+            pw[i].w = ws[i];
+            pw[i].init(scanner);
+        }
+        for (int k = 0; k < 2; ++k)
+        {
+            const double adjust_threshold = k == 0 ? 0 : -0.2;
+            std::vector<rect_detection> fused, generic;
+            detect_with_weight_vectors(scanner, pw, adjust_threshold, fused);
+            dlib::detect_with_weight_vectors<image_scanner_type>(scanner, pw, adjust_threshold, generic);
+            DLIB_TEST(fused.size() > 0);
+            DLIB_TEST(same_detections(fused, generic));
+        }
+
+        std::vector<rect_detection> final_dets;
+        detector(img, final_dets);
+        DLIB_TEST(final_dets.size() > 0);
+    }
+
+// ----------------------------------------------------------------------------------------
+
+    template <typename detector_type, typename image_array_type>
+    struct shared_detector_task
+    {
+        shared_detector_task (
+            const detector_type& detector_,
+            const image_array_type& images_,
+            std::vector<std::vector<rect_detection> >& dets_
+        ) : detector(detector_), images(images_), dets(dets_) {}
+
+        void operator() (
+        ) const
+        {
+            // one workspace per thread, reused for all the images.
+            typename detector_type::workspace_type workspace;
+            for (int iter = 0; iter < 3; ++iter)
+            {
+                for (unsigned long i = 0; i < images.size(); ++i)
+                    detector(images[i], workspace, dets[i]);
+            }
+        }
+
+        const detector_type& detector;
+        const image_array_type& images;
+        std::vector<std::vector<rect_detection> >& dets;
+    };
+
+    void test_shared_const_detector (
+    )
+    {
+        print_spinner();
+        dlog << LINFO << "test_shared_const_detector()";
+
+        typedef dlib::array<array2d<unsigned char> >  grayscale_image_array_type;
+        grayscale_image_array_type images;
+        std::vector<std::vector<rectangle> > object_locations;
+        make_simple_test_data(images, object_locations);
+        // images of different sizes, so the workspace has to change shape.
+        images.resize(images.size()+1);
+        images[images.size()-1].set_size(90, 300);
+        assign_all_pixels(images[images.size()-1], 0);
+        fill_rect(images[images.size()-1], centered_rect(point(150,45), 40,40), 255);
+
+        typedef scan_fhog_pyramid<pyramid_down<2> > image_scanner_type;
+        image_scanner_type scanner;
+        scanner.set_detection_window_size(35,35);
+        dlib::rand rnd;
+        std::vector<image_scanner_type::feature_vector_type> ws(2);
+        for (unsigned long i = 0; i < ws.size(); ++i)
+        {
+            ws[i].set_size(scanner.get_num_dimensions()+1);
+            for (long j = 0; j < ws[i].size(); ++j)
+                ws[i](j) = rnd.get_random_gaussian()*0.01;
+            ws[i](scanner.get_num_dimensions()) = 0.05;
+        }
+        object_detector<image_scanner_type> detector(scanner, test_box_overlap(), ws);
+
+        std::vector<std::vector<rect_detection> > expected(images.size());
+        unsigned long total = 0;
+        for (unsigned long i = 0; i < images.size(); ++i)
+        {
+            detector(images[i], expected[i]);
+            total += expected[i].size();
+        }
+        DLIB_TEST(total > 0);
+
+        typedef shared_detector_task<object_detector<image_scanner_type>, grayscale_image_array_type> task_type;
+        const object_detector<image_scanner_type>& shared = detector;
+        std::vector<std::vector<std::vector<rect_detection> > > dets(4, std::vector<std::vector<rect_detection> >(images.size()));
+        thread_pool tp(4);
+        std::vector<uint64> ids;
+        for (unsigned long t = 0; t < dets.size(); ++t)
+            ids.push_back(tp.add_task_by_value(task_type(shared, images, dets[t])));
+        for (unsigned long t = 0; t < ids.size(); ++t)
+            tp.wait_for_task(ids[t]);
+
+        for (unsigned long t = 0; t < dets.size(); ++t)
+            for (unsigned long i = 0; i < images.size(); ++i)
+                DLIB_TEST(same_detections(dets[t][i], expected[i]));
+
+        // loading the workspace apart from detecting, with and without a thread_pool,
+        // gives the same detections.
+        object_detector<image_scanner_type>::workspace_type workspace;
+        for (unsigned long i = 0; i < images.size(); ++i)
+        {
+            std::vector<rect_detection> loaded_dets;
+            workspace.load(shared.get_scanner(), images[i]);
+            shared(workspace, loaded_dets);
+            DLIB_TEST(same_detections(loaded_dets, expected[i]));
+            workspace.load(tp, shared.get_scanner(), images[i]);
+            shared(workspace, loaded_dets);
+            DLIB_TEST(same_detections(loaded_dets, expected[i]));
+        }
+    }
+
 // ----------------------------------------------------------------------------------------
 
     void test_1 (
@@ -1008,6 +1345,10 @@ namespace
         )
         {
             test_fhog_pyramid();
+            test_parallel_fhog_pyramid();
+            test_parallel_fhog_pyramid_exception();
+            test_fused_fhog_detection();
+            test_shared_const_detector();
             test_1_boxes();
             test_1_poly_nn_boxes();
             test_3_boxes();
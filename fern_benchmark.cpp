@@ -0,0 +1,75 @@
+//[TIF] Compares fern structured trees against standard regression trees.
+//
+//  Trains one model with standard trees and one with ferns (see
+//  shape_predictor_trainer::set_fern_structured_trees()) on the same training images
+//  and with the same settings, then prints the validation error and the prediction
+//  time of each.  Cascade levels made of ferns are evaluated with SIMD instructions.
+
+#include <dlib/image_processing.h>
+#include <dlib/misc_api.h>
+#include <iostream>
+#include <iomanip>
+#include "imagelist.h"
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        if (argc < 3)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_fern_benchmark train_imagelist.txt validation_imagelist.txt [tree_depth] [cascade_depth] [trees_per_cascade] [num_threads]" << endl;
+            cout << "The depths and tree count default to the shape_predictor_trainer defaults." << endl;
+            return 0;
+        }
+
+        std::vector<std::string> train_names, val_names;
+        std::vector<std::vector<full_object_detection> > train_objects, val_objects;
+        dlib::array<array2d<unsigned char> > train_images, val_images;
+        load_imagelist(argv[1], train_names, train_objects);
+        load_imagelist(argv[2], val_names, val_objects);
+        load_imagelist_images(train_names, train_images);
+        load_imagelist_images(val_names, val_images);
+
+        shape_predictor_trainer trainer;
+        if (argc > 3) trainer.set_tree_depth(string_cast<unsigned long>(argv[3]));
+        if (argc > 4) trainer.set_cascade_depth(string_cast<unsigned long>(argv[4]));
+        if (argc > 5) trainer.set_num_trees_per_cascade_level(string_cast<unsigned long>(argv[5]));
+        if (argc > 6) trainer.set_num_threads(string_cast<unsigned long>(argv[6]));
+
+        const std::vector<std::vector<double> > val_scales = box_width_scales(val_objects);
+
+        cout << "tree_depth " << trainer.get_tree_depth()
+             << ", cascade_depth " << trainer.get_cascade_depth()
+             << ", trees_per_cascade " << trainer.get_num_trees_per_cascade_level()
+             << ", " << train_names.size() << " training and " << val_names.size() << " validation images" << endl;
+        cout << "#  model val_error us_per_face train_seconds" << endl;
+        for (int fern = 0; fern < 2; ++fern)
+        {
+            trainer.set_fern_structured_trees(fern == 1);
+            timestamper ts;
+            const uint64 start = ts.get_timestamp();
+            const shape_predictor sp = trainer.train(train_images, train_objects);
+            const double train_seconds = (ts.get_timestamp() - start)/1e6;
+
+            cout << setw(8) << (fern ? "ferns" : "trees") << " "
+                 << test_shape_predictor(sp, val_images, val_objects, val_scales) << " "
+                 << time_shape_predictor(sp, val_images, val_objects, 0.5) << " "
+                 << train_seconds << endl;
+        }
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
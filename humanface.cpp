@@ -58,14 +58,18 @@ int main(int argc, char** argv)
                 cv::cvtColor(frame, gray, CV_BGR2GRAY);
                 dlib::cv_image<unsigned char> dlibimg(gray);
                 assign_image(img, dlibimg);
-                std::vector<dlib::rectangle> dets = detector(img);
+                //[TIF] keep the detector component of each face so models trained with
+                //      per-component initial shapes start from the right pose.
+                std::vector<rect_detection> dets;
+                detector(img, dets);
                 cout << "Number of faces detected: " << dets.size() << endl;
                 std::vector<full_object_detection> shapes;
                 cv::Rect facebb;
                 for (unsigned long j = 0; j < dets.size(); ++j)
                 {
-                    full_object_detection shape = sp(img, dets[j]);
-                    cv::rectangle(frame,cv::Rect(dets[j].left(),dets[j].top(),dets[j].width(),dets[j].height()) ,cv::Scalar(128, 128, 0, 0),2);
+                    const dlib::rectangle& rect = dets[j].rect;
+                    full_object_detection shape = sp(img, rect, dets[j].weight_index);
+                    cv::rectangle(frame,cv::Rect(rect.left(),rect.top(),rect.width(),rect.height()) ,cv::Scalar(128, 128, 0, 0),2);
                     for (unsigned int k = 0; k < shape.num_parts(); k++) {
                         cv::circle(frame, cv::Point_<int>(shape.part(k).x(), shape.part(k).y()), 2, cv::Scalar(0, 170, 255, 0), 2);
                     }
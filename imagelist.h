@@ -0,0 +1,172 @@
+//[TIF] Reading of the imagelist.txt format used by the TIF tools, and the scoring and
+//      timing of shape predictors on the faces of one.
+//
+//  Each line describes one face:
+//      image_file  x y width height  [x0 y0 x1 y1 ... ]
+//  i.e. the file name, the face box and, optionally, the ground truth landmarks.
+//  All the lines of a file must give the same number of landmarks.
+
+#ifndef TIF_IMAGELIST_H_
+#define TIF_IMAGELIST_H_
+
+#include <dlib/image_processing.h>
+#include <dlib/image_io.h>
+#include <dlib/array.h>
+#include <dlib/array2d.h>
+#include <dlib/string.h>
+#include <dlib/misc_api.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ----------------------------------------------------------------------------------------
+
+inline void load_imagelist (
+    const std::string& filename,
+    std::vector<std::string>& names,
+    std::vector<std::vector<dlib::full_object_detection> >& objects
+)
+/*!
+    ensures
+        - #names[i] == the image file of the i-th line of filename.
+        - #objects[i] == the one face of the i-th line.  It has no parts if the line
+          doesn't give landmarks.
+        - throws dlib::error if the file can't be read or a line is malformed.
+!*/
+{
+    std::ifstream fin(filename.c_str());
+    if (!fin)
+        throw dlib::error("Unable to open image list " + filename);
+
+    names.clear();
+    objects.clear();
+    unsigned long num_parts = 0;
+    std::string line;
+    for (unsigned long line_num = 1; std::getline(fin, line); ++line_num)
+    {
+        std::istringstream sin(line);
+        std::string name;
+        long x, y, w, h;
+        if (!(sin >> name))
+            continue;
+        if (!(sin >> x >> y >> w >> h))
+            throw dlib::error("Bad face box on line " + dlib::cast_to_string(line_num) + " of " + filename);
+
+        std::vector<dlib::point> parts;
+        double px, py;
+        while (sin >> px >> py)
+            parts.push_back(dlib::point((long)px, (long)py));
+        if (names.size() == 0)
+            num_parts = parts.size();
+        else if (parts.size() != num_parts)
+            throw dlib::error("Wrong number of landmarks on line " + dlib::cast_to_string(line_num) + " of " + filename);
+
+        // same box convention as sheepface.cpp
+        const dlib::rectangle rect(x, y, x + w, y + h);
+        names.push_back(name);
+        objects.push_back(std::vector<dlib::full_object_detection>(1, dlib::full_object_detection(rect, parts)));
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
+template <typename image_array>
+void load_imagelist_images (
+    const std::vector<std::string>& names,
+    image_array& images
+)
+/*!
+    ensures
+        - #images[i] == the decoded, grayscale, contents of names[i].
+!*/
+{
+    images.resize(names.size());
+    for (unsigned long i = 0; i < names.size(); ++i)
+        dlib::load_image(images[i], names[i]);
+}
+
+// ----------------------------------------------------------------------------------------
+
+inline std::vector<std::vector<double> > box_width_scales (
+    const std::vector<std::vector<dlib::full_object_detection> >& objects
+)
+/*!
+    ensures
+        - returns the scales to give test_shape_predictor() so that it reports landmark
+          errors relative to the width of the face box, as the TIF tools do.  I.e.
+          #scales[i][j] == objects[i][j].get_rect().width().
+!*/
+{
+    std::vector<std::vector<double> > scales(objects.size());
+    for (unsigned long i = 0; i < objects.size(); ++i)
+    {
+        for (unsigned long j = 0; j < objects[i].size(); ++j)
+            scales[i].push_back(objects[i][j].get_rect().width());
+    }
+    return scales;
+}
+
+// ----------------------------------------------------------------------------------------
+
+template <typename image_array>
+double time_shape_predictor (
+    const dlib::shape_predictor& sp,
+    const image_array& images,
+    const std::vector<std::vector<dlib::full_object_detection> >& objects,
+    double min_seconds
+)
+/*!
+    ensures
+        - runs sp over the faces in objects, again and again until at least
+          min_seconds have passed, and returns the mean time per face in µs.
+!*/
+{
+    dlib::timestamper ts;
+    const dlib::uint64 start = ts.get_timestamp();
+    dlib::uint64 now = start;
+    unsigned long faces = 0;
+    while (now - start < min_seconds*1e6 || faces == 0)
+    {
+        for (unsigned long i = 0; i < objects.size(); ++i)
+        {
+            for (unsigned long j = 0; j < objects[i].size(); ++j)
+            {
+                dlib::full_object_detection det = sp(images[i], objects[i][j].get_rect());
+                ++faces;
+            }
+        }
+        now = ts.get_timestamp();
+    }
+    return (double)(now - start)/faces;
+}
+
+template <typename image_array>
+void print_shape_predictor_report (
+    const std::string& name,
+    const dlib::shape_predictor& sp,
+    double error,
+    const image_array& images,
+    const std::vector<std::vector<dlib::full_object_detection> >& objects
+)
+/*!
+    ensures
+        - prints a line with name, error, the time sp takes per face of objects in µs
+          and the size of sp serialized in bytes.  The tools that compare models print
+          one such line per model.
+!*/
+{
+    std::ostringstream sout;
+    serialize(sp, sout);
+    std::cout << std::setw(6) << name << " "
+              << error << " "
+              << time_shape_predictor(sp, images, objects, 0.5) << " "
+              << sout.str().size() << std::endl;
+}
+
+// ----------------------------------------------------------------------------------------
+
+#endif // TIF_IMAGELIST_H_
+
@@ -0,0 +1,121 @@
+//[TIF] Trains a shape_predictor for a subset of the landmarks of a full model.
+//
+//  Uses the same training settings as the full model (cascade depth, trees per
+//  cascade level, tree depth and feature pool size are read from it) and the same
+//  annotations, but only fits the chosen parts (see
+//  shape_predictor_trainer::set_landmark_subset()).  It prints the validation error of
+//  the chosen parts, the prediction time and the size of both models and saves the
+//  subset model.
+
+#include <dlib/image_processing.h>
+#include <dlib/misc_api.h>
+#include <iostream>
+#include "imagelist.h"
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+double subset_error (
+    const shape_predictor& sp,
+    const dlib::array<array2d<unsigned char> >& images,
+    const std::vector<std::vector<full_object_detection> >& objects,
+    const std::vector<unsigned long>& parts,
+    const std::vector<unsigned long>& predicted_parts
+)
+/*!
+    ensures
+        - returns the mean distance between part predicted_parts[k] of sp's prediction
+          and part parts[k] of the truth, relative to the width of the face box.
+!*/
+{
+    running_stats<double> rs;
+    for (unsigned long i = 0; i < objects.size(); ++i)
+    {
+        for (unsigned long j = 0; j < objects[i].size(); ++j)
+        {
+            const full_object_detection det = sp(images[i], objects[i][j].get_rect());
+            for (unsigned long k = 0; k < parts.size(); ++k)
+                rs.add(length(det.part(predicted_parts[k]) - objects[i][j].part(parts[k]))/objects[i][j].get_rect().width());
+        }
+    }
+    return rs.mean();
+}
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        if (argc < 6)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_landmark_subset model.dat train_imagelist.txt validation_imagelist.txt p1,p2,... subset_model.dat [num_threads]" << endl;
+            cout << "The parts are 0 based indices into the landmarks of model.dat, e.g. 36,45,30,48,54" << endl;
+            cout << "for the eye corners, nose tip and mouth corners of the 68 point annotation." << endl;
+            return 0;
+        }
+
+        shape_predictor sp;
+        deserialize(argv[1]) >> sp;
+
+        std::vector<unsigned long> parts;
+        const std::vector<std::string> tokens = split(argv[4], ",");
+        for (unsigned long i = 0; i < tokens.size(); ++i)
+            parts.push_back(string_cast<unsigned long>(tokens[i]));
+        if (parts.size() == 0)
+            throw error("No parts given.");
+
+        std::vector<std::string> train_names, val_names;
+        std::vector<std::vector<full_object_detection> > train_objects, val_objects;
+        dlib::array<array2d<unsigned char> > train_images, val_images;
+        load_imagelist(argv[2], train_names, train_objects);
+        load_imagelist(argv[3], val_names, val_objects);
+        load_imagelist_images(train_names, train_images);
+        load_imagelist_images(val_names, val_images);
+
+        if (sp.get_forests().size() == 0 || sp.get_forests()[0].size() == 0)
+            throw error("The model has no trees to copy the training settings from.");
+        shape_predictor_trainer trainer;
+        trainer.set_cascade_depth(sp.get_forests().size());
+        trainer.set_num_trees_per_cascade_level(sp.get_forests()[0].size());
+        unsigned long depth = 0;
+        while ((1UL<<depth) < sp.get_forests()[0][0].leaf_values.size())
+            ++depth;
+        trainer.set_tree_depth(depth);
+        impl::index_feature index = sp.get_index()[0];
+        trainer.set_feature_pool_size(index.get_num_of_anchors());
+        trainer.set_num_threads(argc > 6 ? string_cast<unsigned long>(argv[6]) : 4);
+        trainer.set_landmark_subset(parts);
+
+        timestamper ts;
+        const uint64 start = ts.get_timestamp();
+        const shape_predictor subset_sp = trainer.train(train_images, train_objects);
+        cout << "Trained the " << parts.size() << " part model in " 
+             << (ts.get_timestamp() - start)/1e6 << " seconds" << endl;
+
+        std::vector<unsigned long> subset_parts(parts.size());
+        for (unsigned long k = 0; k < parts.size(); ++k)
+            subset_parts[k] = k;
+
+        // Both models are scored on the chosen parts only.
+        cout << "# model val_error us_per_face model_bytes" << endl;
+        print_shape_predictor_report("full", sp, subset_error(sp, val_images, val_objects, parts, parts),
+                                     val_images, val_objects);
+        print_shape_predictor_report("subset", subset_sp, subset_error(subset_sp, val_images, val_objects, parts, subset_parts),
+                                     val_images, val_objects);
+
+        serialize(argv[5]) << subset_sp;
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
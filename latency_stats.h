@@ -0,0 +1,98 @@
+//[TIF] Latency summaries shared by the TIF benchmark tools.
+//
+//  A latency_summary condenses a set of timings, in µs, into the numbers the tools
+//  report and writes them as a JSON object.  write_json_string() writes the strings,
+//  e.g. file names, that the tools put next to them.
+
+#ifndef TIF_LATENCY_STATS_H_
+#define TIF_LATENCY_STATS_H_
+
+#include <dlib/image_processing/shape_predictor_TIF.h>
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// ----------------------------------------------------------------------------------------
+
+struct latency_summary
+{
+    latency_summary (
+    ) : count(0), mean(0), p50(0), p95(0), p99(0), max(0) {}
+
+    explicit latency_summary (
+        const std::vector<double>& us
+    ) : count(us.size()), mean(0), p50(0), p95(0), p99(0), max(0)
+    {
+        if (us.size() == 0)
+            return;
+        for (unsigned long i = 0; i < us.size(); ++i)
+            mean += us[i];
+        mean /= us.size();
+        p50 = dlib::impl::percentile(us, 0.50);
+        p95 = dlib::impl::percentile(us, 0.95);
+        p99 = dlib::impl::percentile(us, 0.99);
+        max = *std::max_element(us.begin(), us.end());
+    }
+
+    unsigned long count;
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+
+    void write_json (
+        std::ostream& out
+    ) const
+    /*!
+        ensures
+            - writes this object as a JSON object.  per_second is how many calls one
+              thread gets through per second at the mean latency.
+    !*/
+    {
+        out << "{\"count\":" << count << ",\"mean_us\":" << mean << ",\"p50_us\":" << p50
+            << ",\"p95_us\":" << p95 << ",\"p99_us\":" << p99 << ",\"max_us\":" << max
+            << ",\"per_second\":" << (mean > 0 ? 1e6/mean : 0) << "}";
+    }
+};
+
+// ----------------------------------------------------------------------------------------
+
+inline void write_json_string (
+    std::ostream& out,
+    const std::string& str
+)
+/*!
+    ensures
+        - writes str to out as a quoted JSON string, with quotes, backslashes and
+          control characters escaped.
+!*/
+{
+    out << '"';
+    for (std::string::size_type i = 0; i < str.size(); ++i)
+    {
+        const unsigned char c = str[i];
+        if (c == '"' || c == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if (c < 0x20)
+        {
+            char buf[8];
+            std::sprintf(buf, "\\u%04x", c);
+            out << buf;
+        }
+        else
+        {
+            out << str[i];
+        }
+    }
+    out << '"';
+}
+
+// ----------------------------------------------------------------------------------------
+
+#endif // TIF_LATENCY_STATS_H_
+
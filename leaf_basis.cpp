@@ -0,0 +1,69 @@
+//[TIF] Converts a trained shape_predictor to low rank leaf bases.
+//
+//  For every basis size k given, compresses the model with
+//  compress_shape_predictor_leaves() and prints the validation error, the prediction
+//  time and the size of the compressed model next to those of the original.  If an
+//  output file is given the model compressed with the last k is saved to it.
+
+#include <dlib/image_processing.h>
+#include <dlib/misc_api.h>
+#include <iostream>
+#include "imagelist.h"
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        if (argc < 4)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_leaf_basis model.dat validation_imagelist.txt k1,k2,... [compressed_model.dat]" << endl;
+            return 0;
+        }
+
+        shape_predictor sp;
+        deserialize(argv[1]) >> sp;
+
+        std::vector<std::string> names;
+        std::vector<std::vector<full_object_detection> > objects;
+        dlib::array<array2d<unsigned char> > images;
+        load_imagelist(argv[2], names, objects);
+        load_imagelist_images(names, images);
+
+        std::vector<unsigned long> sizes;
+        const std::vector<std::string> tokens = split(argv[3], ",");
+        for (unsigned long i = 0; i < tokens.size(); ++i)
+            sizes.push_back(string_cast<unsigned long>(tokens[i]));
+        if (sizes.size() == 0)
+            throw error("No basis sizes given.");
+
+        const std::vector<std::vector<double> > scales = box_width_scales(objects);
+
+        cout << "#    k val_error us_per_face model_bytes" << endl;
+        print_shape_predictor_report("full", sp, test_shape_predictor(sp, images, objects, scales), images, objects);
+        shape_predictor compressed;
+        for (unsigned long i = 0; i < sizes.size(); ++i)
+        {
+            compressed = compress_shape_predictor_leaves(sp, sizes[i]);
+            print_shape_predictor_report(cast_to_string(sizes[i]), compressed,
+                                         test_shape_predictor(compressed, images, objects, scales), images, objects);
+        }
+
+        if (argc > 4)
+            serialize(argv[4]) << compressed;
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
@@ -0,0 +1,321 @@
+//[TIF] Load generator for the tail latency of the face alignment pipeline.
+//
+//  Replays images, or the frames of a video, to the detect -> align pipeline (see
+//  pipeline.h) at a fixed arrival rate, e.g. 30 fps times the number of cameras.
+//  Arrivals are scheduled ahead of time, either evenly spaced (constant) or with
+//  exponential gaps (poisson), and don't wait for earlier frames to finish, so a
+//  pipeline that falls behind builds up a queue just like a live feed would.  A pool of
+//  --concurrency workers takes the frames off the queue.
+//
+//  The latency of a frame runs from its scheduled arrival to the end of its alignment,
+//  so it includes the time spent queued.  A frame misses its deadline if its latency
+//  is over --deadline-ms.  Each rate of --rates, in increasing order, is run for
+//  --duration seconds and the sustained rate is the highest one at which at most
+//  --max-miss of the frames missed their deadline.  The sweep stops at the first rate
+//  that isn't sustained.
+//
+//  The images are decoded once, before the runs, as frames from a camera would arrive
+//  decoded.
+
+#include <dlib/image_processing.h>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/cmd_line_parser.h>
+#include <dlib/threads.h>
+#include <dlib/pipe.h>
+#include <dlib/misc_api.h>
+#include <dlib/rand.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include "latency_stats.h"
+#include "pipeline.h"
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+std::vector<double> make_arrivals (
+    const std::string& arrivals,
+    double rate,
+    double duration,
+    unsigned long seed
+)
+/*!
+    requires
+        - rate > 0
+    ensures
+        - returns the arrival times, in µs from the start of the run, of the frames
+          that arrive during duration seconds at rate frames per second.  They are
+          evenly spaced if arrivals == "constant" and a poisson process seeded with
+          seed if arrivals == "poisson".
+!*/
+{
+    if (arrivals != "constant" && arrivals != "poisson")
+        throw dlib::error("--arrivals must be constant or poisson, not " + arrivals);
+
+    dlib::rand rnd;
+    rnd.set_seed(cast_to_string(seed));
+    std::vector<double> times;
+    double t = 0;
+    while (t < duration*1e6)
+    {
+        times.push_back(t);
+        if (arrivals == "constant")
+            t += 1e6/rate;
+        else
+            t += -std::log(1 - rnd.get_random_double())*1e6/rate;
+    }
+    return times;
+}
+
+struct frame_result
+{
+    frame_result() : queue_us(0), service_us(0), latency_us(0), finish_us(0) {}
+
+    double queue_us;        // scheduled arrival to the start of processing
+    double service_us;      // the pipeline itself
+    double latency_us;      // scheduled arrival to the end of processing
+    double finish_us;       // end of processing, from the start of the run
+    std::string failure;
+};
+
+class load_test : public multithreaded_object
+{
+    /*!
+        WHAT THIS OBJECT REPRESENTS
+            One run at a fixed schedule of arrivals.  The calling thread of run() puts
+            the frames on a queue at their arrival times and num_workers threads
+            process them.
+    !*/
+public:
+    load_test (
+        const pipeline& pipe_,
+        const dlib::array<array2d<rgb_pixel> >& frames_,
+        const std::vector<std::vector<full_object_detection> >& objects_,
+        unsigned long num_workers
+    ) : pipe(pipe_), frames(frames_), objects(objects_), queue(1000000), start_time(0), arrivals(0)
+    {
+        for (unsigned long i = 0; i < num_workers; ++i)
+            register_thread(*this, &load_test::worker);
+    }
+
+    ~load_test (
+    )
+    {
+        queue.disable();
+        wait();
+    }
+
+    void run (
+        const std::vector<double>& arrivals_,
+        std::vector<frame_result>& results_
+    )
+    /*!
+        ensures
+            - replays frames[k%frames.size()] at time arrivals_[k], in µs from now, for
+              all k, and returns once all of them are done.  #results_[k] is how frame k went.
+    !*/
+    {
+        arrivals = &arrivals_;
+        results.assign(arrivals_.size(), frame_result());
+        start_time = ts.get_timestamp();
+        start();
+        for (unsigned long k = 0; k < arrivals_.size(); ++k)
+        {
+            // sleep most of the way and spin the last couple of ms, since sleep() is only
+            // good to about a ms.
+            for (double now = elapsed(); now < arrivals_[k]; now = elapsed())
+            {
+                if (arrivals_[k] - now > 2000)
+                    dlib::sleep((unsigned long)(arrivals_[k] - now)/1000 - 1);
+            }
+            unsigned long item = k;
+            queue.enqueue(item);
+        }
+        queue.wait_until_empty();
+        queue.disable();
+        wait();
+        results_.swap(results);
+    }
+
+private:
+    double elapsed (
+    ) const { return ts.get_timestamp() - start_time; }
+
+    void worker (
+    )
+    {
+        pipeline::workspace_type workspace;
+        std::vector<double> stage_us, align_us;
+        std::vector<rectangle> boxes;
+        unsigned long k = 0;
+        while (queue.dequeue(k))
+        {
+            frame_result& result = results[k];
+            const double begin = elapsed();
+            try
+            {
+                const unsigned long i = k%frames.size();
+                boxes.clear();
+                for (unsigned long j = 0; objects.size() != 0 && j < objects[i].size(); ++j)
+                    boxes.push_back(objects[i][j].get_rect());
+                unsigned long faces;
+                pipe.run(workspace, frames[i], objects.size() != 0 ? &boxes : 0, stage_us, align_us, faces);
+            }
+            catch (std::exception& e)
+            {
+                result.failure = e.what();
+            }
+            result.finish_us = elapsed();
+            result.queue_us = begin - (*arrivals)[k];
+            result.service_us = result.finish_us - begin;
+            result.latency_us = result.finish_us - (*arrivals)[k];
+        }
+    }
+
+    const pipeline& pipe;
+    const dlib::array<array2d<rgb_pixel> >& frames;
+    const std::vector<std::vector<full_object_detection> >& objects;
+    dlib::pipe<unsigned long> queue;
+    timestamper ts;
+    uint64 start_time;
+    const std::vector<double>* arrivals;
+    std::vector<frame_result> results;
+};
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        command_line_parser parser;
+        parser.add_option("model", "Align the faces with this shape_predictor.", 1);
+        parser.add_option("rates", "Comma separated arrival rates to try, in frames per second (default 30).", 1);
+        parser.add_option("arrivals", "constant or poisson (default poisson).", 1);
+        parser.add_option("concurrency", "Number of worker threads (default 1).", 1);
+        parser.add_option("duration", "Seconds of arrivals at each rate (default 10).", 1);
+        parser.add_option("deadline-ms", "Latency a frame must be done within (default 33.3).", 1);
+        parser.add_option("max-miss", "Fraction of frames that may miss the deadline at a sustained rate (default 0.01).", 1);
+        parser.add_option("seed", "Seed of the poisson arrivals (default 0).", 1);
+        parser.add_option("max-frames", "Frames to read from a video (default 300).", 1);
+        parser.add_option("json", "Also write the results to this file.", 1);
+        parser.add_option("h", "Display this help message.");
+        parser.parse(argc, argv);
+
+        if (parser.option("h") || parser.number_of_arguments() != 1)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_load_generator images/|imagelist.txt|video [options]" << endl;
+            parser.print_options();
+            return 0;
+        }
+
+        const std::string input = parser[0];
+        const std::string arrivals = get_option(parser, "arrivals", "poisson");
+        const unsigned long concurrency = get_option(parser, "concurrency", 1);
+        const double duration = get_option(parser, "duration", 10.0);
+        const double deadline_us = 1000*get_option(parser, "deadline-ms", 1000/30.0);
+        const double max_miss = get_option(parser, "max-miss", 0.01);
+        const unsigned long seed = get_option(parser, "seed", 0);
+
+        std::vector<double> rates;
+        std::istringstream sin(get_option(parser, "rates", "30"));
+        for (std::string rate; std::getline(sin, rate, ',');)
+            rates.push_back(string_cast<double>(trim(rate)));
+        std::sort(rates.begin(), rates.end());
+        if (rates.size() == 0 || rates[0] <= 0)
+            throw dlib::error("--rates must be positive numbers");
+
+        shape_predictor sp;
+        if (parser.option("model"))
+            deserialize(parser.option("model").argument()) >> sp;
+
+        std::vector<std::string> names;
+        std::vector<std::vector<full_object_detection> > objects;
+        dlib::array<array2d<rgb_pixel> > frames;
+        std::vector<double> video_decode_us;
+        load_pipeline_input(input, get_option(parser, "max-frames", 300), names, objects, frames, video_decode_us);
+        if (frames.size() == 0)
+            load_imagelist_images(names, frames);
+
+        const frontal_face_detector detector = get_frontal_face_detector();
+        const pipeline pipe(detector, parser.option("model") ? &sp : 0);
+
+        ostringstream sout;
+        sout << "{\"input\":";
+        write_json_string(sout, input);
+        sout << ",\"arrivals\":";
+        write_json_string(sout, arrivals);
+        sout << ",\"concurrency\":" << concurrency
+             << ",\"duration\":" << duration << ",\"deadline_ms\":" << deadline_us/1000 << ",\"max_miss\":" << max_miss
+             << ",\"runs\":[";
+        cout << setw(10) << "rate" << setw(12) << "throughput" << setw(10) << "missed" << setw(12) << "p50_ms"
+             << setw(12) << "p99_ms" << setw(12) << "max_ms" << setw(14) << "queue_p99_ms" << setw(16) << "service_p99_ms" << endl;
+        double sustained_rate = 0;
+        for (unsigned long r = 0; r < rates.size(); ++r)
+        {
+            std::vector<frame_result> results;
+            load_test test(pipe, frames, objects, concurrency);
+            test.run(make_arrivals(arrivals, rates[r], duration, seed), results);
+
+            std::vector<double> latency_us, queue_us, service_us;
+            unsigned long missed = 0;
+            double last_finish = 0;
+            for (unsigned long k = 0; k < results.size(); ++k)
+            {
+                if (results[k].failure.size() != 0)
+                    throw dlib::error(results[k].failure);
+                latency_us.push_back(results[k].latency_us);
+                queue_us.push_back(results[k].queue_us);
+                service_us.push_back(results[k].service_us);
+                if (results[k].latency_us > deadline_us)
+                    ++missed;
+                last_finish = std::max(last_finish, results[k].finish_us);
+            }
+            const double miss_fraction = (double)missed/results.size();
+            const double throughput = results.size()/(last_finish/1e6);
+            const latency_summary latency(latency_us), queue(queue_us), service(service_us);
+            const bool sustained = miss_fraction <= max_miss;
+            if (sustained)
+                sustained_rate = rates[r];
+
+            cout << setw(10) << rates[r] << setw(12) << setprecision(4) << throughput << setw(10) << missed
+                 << setw(12) << latency.p50/1000 << setw(12) << latency.p99/1000 << setw(12) << latency.max/1000
+                 << setw(14) << queue.p99/1000 << setw(16) << service.p99/1000 << (sustained ? "" : "  not sustained") << endl;
+
+            sout << (r == 0 ? "" : ",") << "{\"rate\":" << rates[r] << ",\"frames\":" << results.size()
+                 << ",\"throughput\":" << throughput << ",\"missed\":" << missed << ",\"miss_fraction\":" << miss_fraction
+                 << ",\"sustained\":" << (sustained ? "true" : "false") << ",\"latency\":";
+            latency.write_json(sout);
+            sout << ",\"queue\":";
+            queue.write_json(sout);
+            sout << ",\"service\":";
+            service.write_json(sout);
+            sout << "}";
+
+            if (!sustained)
+                break;
+        }
+        sout << "],\"sustained_rate\":" << sustained_rate << "}" << endl;
+        cout << "sustained rate: " << sustained_rate << " frames per second" << endl;
+
+        if (parser.option("json"))
+        {
+            ofstream fout(parser.option("json").argument().c_str());
+            fout << sout.str();
+        }
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
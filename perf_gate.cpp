@@ -0,0 +1,398 @@
+//[TIF] Performance regression gate for the face detector and shape_predictor.
+//
+//  Times frontal_face_detector and shape_predictor::operator() on fixed inputs, the
+//  images and boxes of imagelist.txt and a synthetic model made from a fixed seed, and
+//  counts the heap allocations each call makes.  The median latencies and allocation
+//  counts are compared against a baseline JSON file and the program exits with 1,
+//  printing what changed, if a latency or the allocations grew by more than their
+//  tolerance.  Run it with --update to write a new baseline.
+//
+//  Latencies only mean something on the machine they were measured on, so --update
+//  records the host name and the latencies are only checked against a baseline of the
+//  same host.  A CI job should write the baseline with the reference build and then
+//  check the new build, both on the same runner (the baseline and check targets of
+//  Makefile_perf_gate).  The allocation counts don't depend on the machine, only a
+//  little on the standard library, and are always checked.
+
+#include <dlib/image_processing.h>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/cmd_line_parser.h>
+#include <dlib/sockets.h>
+#include <dlib/misc_api.h>
+#include <dlib/rand.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <cctype>
+#include "imagelist.h"
+#include "latency_stats.h"
+#include "alloc_counter.h"
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+shape_predictor make_synthetic_shape_predictor (
+    unsigned long seed,
+    unsigned long num_parts,
+    unsigned long cascade_depth,
+    unsigned long trees_per_cascade,
+    unsigned long tree_depth,
+    unsigned long feature_pool_size
+)
+/*!
+    ensures
+        - returns a shape_predictor of the given size whose initial shape, features,
+          thresholds and leaves are drawn from a dlib::rand seeded with seed.  It
+          predicts nothing useful but costs as much to run as a trained model.
+!*/
+{
+    dlib::rand rnd;
+    rnd.set_seed(cast_to_string(seed));
+
+    matrix<float,0,1> initial_shape(num_parts*2);
+    for (long i = 0; i < initial_shape.size(); ++i)
+        initial_shape(i) = 0.2 + 0.6*rnd.get_random_double();
+
+    const unsigned long num_leaves = 1UL<<tree_depth;
+    std::vector<impl::index_feature> index(cascade_depth);
+    std::vector<std::vector<impl::regression_tree> > forests(cascade_depth);
+    for (unsigned long i = 0; i < cascade_depth; ++i)
+    {
+        impl::sample_pixel_coordinates(rnd, index[i], initial_shape, feature_pool_size);
+        forests[i].resize(trees_per_cascade);
+        for (unsigned long j = 0; j < trees_per_cascade; ++j)
+        {
+            impl::regression_tree& tree = forests[i][j];
+            tree.splits.resize(num_leaves-1);
+            for (unsigned long k = 0; k < tree.splits.size(); ++k)
+            {
+                tree.splits[k].idx1 = rnd.get_random_32bit_number()%feature_pool_size;
+                tree.splits[k].idx2 = rnd.get_random_32bit_number()%feature_pool_size;
+                tree.splits[k].thresh = 64*(rnd.get_random_float()-0.5);
+            }
+            tree.leaf_values.resize(num_leaves);
+            for (unsigned long k = 0; k < num_leaves; ++k)
+            {
+                tree.leaf_values[k].set_size(initial_shape.size());
+                for (long m = 0; m < initial_shape.size(); ++m)
+                    tree.leaf_values[k](m) = 0.002*(rnd.get_random_float()-0.5);
+            }
+        }
+    }
+    return shape_predictor(initial_shape, forests, index);
+}
+
+// ----------------------------------------------------------------------------------------
+
+struct measurement
+{
+    measurement() : median_us(0), allocations_per_call(0), bytes_per_call(0) {}
+
+    double median_us;
+    double allocations_per_call;
+    double bytes_per_call;
+};
+
+template <typename function_type>
+measurement measure (
+    function_type& f,
+    unsigned long num_calls,
+    unsigned long iterations
+)
+/*!
+    ensures
+        - calls f(i) for i in [0, num_calls) once as a warm up and then iterations more
+          times.  Returns the median time of a call and the mean number of allocations,
+          and bytes, of a call in the last pass.
+!*/
+{
+    for (unsigned long i = 0; i < num_calls; ++i)
+        f(i);
+
+    timestamper ts;
+    std::vector<double> us;
+    us.reserve(num_calls*iterations);
+    measurement m;
+    for (unsigned long iter = 0; iter < iterations; ++iter)
+    {
+        const alloc_counts before = global_alloc_counts();
+        for (unsigned long i = 0; i < num_calls; ++i)
+        {
+            const uint64 start = ts.get_timestamp();
+            f(i);
+            us.push_back(ts.get_timestamp() - start);
+        }
+        const alloc_counts used = global_alloc_counts() - before;
+        m.allocations_per_call = (double)used.allocations/num_calls;
+        m.bytes_per_call = (double)used.bytes/num_calls;
+    }
+    m.median_us = impl::percentile(us, 0.5);
+    return m;
+}
+
+struct run_detector
+{
+    run_detector (
+        frontal_face_detector& detector_,
+        const dlib::array<array2d<unsigned char> >& images_
+    ) : detector(detector_), images(images_) {}
+
+    void operator() (unsigned long i)
+    {
+        detector(images[i], dets);
+    }
+
+    frontal_face_detector& detector;
+    const dlib::array<array2d<unsigned char> >& images;
+    std::vector<rect_detection> dets;
+};
+
+struct run_shape_predictor
+{
+    run_shape_predictor (
+        const shape_predictor& sp_,
+        const dlib::array<array2d<unsigned char> >& images_,
+        const std::vector<std::vector<full_object_detection> >& objects_
+    ) : sp(sp_), images(images_), objects(objects_) {}
+
+    void operator() (unsigned long i)
+    {
+        for (unsigned long j = 0; j < objects[i].size(); ++j)
+            shape = sp(images[i], objects[i][j].get_rect());
+    }
+
+    const shape_predictor& sp;
+    const dlib::array<array2d<unsigned char> >& images;
+    const std::vector<std::vector<full_object_detection> >& objects;
+    full_object_detection shape;
+};
+
+// ----------------------------------------------------------------------------------------
+
+// The baseline file is a JSON object of strings and objects of numbers, e.g.
+//  {"host": "ci-runner-3", "frontal_face_detector": {"median_us": 5200, ...}, ...}
+// It is read into maps from "benchmark.metric" to the number and from the key to the
+// string.
+
+void skip_space (
+    std::istream& in
+)
+{
+    while (in && std::isspace(in.peek()))
+        in.get();
+}
+
+void expect (
+    std::istream& in,
+    char c
+)
+{
+    skip_space(in);
+    if (in.get() != c)
+        throw dlib::error(std::string("Malformed baseline file, expected '") + c + "'");
+}
+
+std::string read_json_string (
+    std::istream& in
+)
+{
+    expect(in, '"');
+    std::string str;
+    char c;
+    while (in.get(c) && c != '"')
+        str += c;
+    if (!in)
+        throw dlib::error("Malformed baseline file, unterminated string");
+    return str;
+}
+
+void read_json_object (
+    std::istream& in,
+    const std::string& prefix,
+    std::map<std::string,double>& values,
+    std::map<std::string,std::string>& strings
+)
+{
+    expect(in, '{');
+    skip_space(in);
+    if (in.peek() == '}')
+    {
+        in.get();
+        return;
+    }
+    while (true)
+    {
+        const std::string key = prefix + read_json_string(in);
+        expect(in, ':');
+        skip_space(in);
+        if (in.peek() == '{')
+        {
+            read_json_object(in, key + ".", values, strings);
+        }
+        else if (in.peek() == '"')
+        {
+            strings[key] = read_json_string(in);
+        }
+        else
+        {
+            double val;
+            if (!(in >> val))
+                throw dlib::error("Malformed baseline file, expected a number for " + key);
+            values[key] = val;
+        }
+        skip_space(in);
+        const int c = in.get();
+        if (c == '}')
+            return;
+        if (c != ',')
+            throw dlib::error("Malformed baseline file, expected ',' or '}' after " + key);
+    }
+}
+
+void load_baseline (
+    const std::string& filename,
+    std::map<std::string,double>& values,
+    std::map<std::string,std::string>& strings
+)
+{
+    ifstream fin(filename.c_str());
+    if (!fin)
+        throw dlib::error("Unable to open baseline file " + filename + ", make one with --update");
+    values.clear();
+    strings.clear();
+    read_json_object(fin, "", values, strings);
+}
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        command_line_parser parser;
+        parser.add_option("imagelist", "The fixed inputs (default imagelist.txt).", 1);
+        parser.add_option("tolerance", "Allowed relative growth of a median latency (default 0.2).", 1);
+        parser.add_option("alloc-tolerance", "Allowed relative growth of the allocations and bytes of a call (default 0.02).", 1);
+        parser.add_option("iterations", "Measured passes over the inputs (default 3).", 1);
+        parser.add_option("update", "Write the measurements to the baseline file instead of checking them.");
+        parser.add_option("h", "Display this help message.");
+        parser.parse(argc, argv);
+
+        if (parser.option("h") || parser.number_of_arguments() != 1)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_perf_gate perf_baseline.json [options]" << endl;
+            parser.print_options();
+            return 0;
+        }
+
+        const std::string baseline_file = parser[0];
+        const double tolerance = get_option(parser, "tolerance", 0.2);
+        const double alloc_tolerance = get_option(parser, "alloc-tolerance", 0.02);
+        const unsigned long iterations = get_option(parser, "iterations", 3);
+
+        std::vector<std::string> names;
+        std::vector<std::vector<full_object_detection> > objects;
+        dlib::array<array2d<unsigned char> > images;
+        load_imagelist(get_option(parser, "imagelist", "imagelist.txt"), names, objects);
+        load_imagelist_images(names, images);
+
+        // the size of a model made by the default shape_predictor_trainer settings.
+        const shape_predictor sp = make_synthetic_shape_predictor(0, 8, 10, 500, 4, 400);
+        frontal_face_detector detector = get_frontal_face_detector();
+        std::string host;
+        if (get_local_hostname(host) != 0)
+            host = "unknown";
+
+        std::map<std::string, measurement> results;
+        run_detector detect(detector, images);
+        results["frontal_face_detector"] = measure(detect, images.size(), iterations);
+        run_shape_predictor align(sp, images, objects);
+        results["shape_predictor"] = measure(align, images.size(), iterations);
+
+        if (parser.option("update"))
+        {
+            ofstream fout(baseline_file.c_str());
+            fout << setprecision(12) << "{\n  \"host\": ";
+            write_json_string(fout, host);
+            for (std::map<std::string, measurement>::iterator i = results.begin(); i != results.end(); ++i)
+            {
+                fout << ",\n  \"" << i->first << "\": {\"median_us\": " << i->second.median_us
+                     << ", \"allocations_per_call\": " << i->second.allocations_per_call
+                     << ", \"bytes_per_call\": " << i->second.bytes_per_call << "}";
+            }
+            fout << "\n}\n";
+            if (!fout)
+                throw dlib::error("Unable to write " + baseline_file);
+            cout << "Wrote " << baseline_file << endl;
+            return 0;
+        }
+
+        std::map<std::string,double> baseline;
+        std::map<std::string,std::string> baseline_strings;
+        load_baseline(baseline_file, baseline, baseline_strings);
+        const bool same_host = baseline_strings["host"] == host;
+        if (!same_host)
+        {
+            cout << baseline_file << " was written on host \"" << baseline_strings["host"] << "\", not \"" << host
+                 << "\", so the latencies are not checked.  Write a baseline on this host with --update." << endl;
+        }
+        bool failed = false;
+        cout << fixed << setprecision(2);
+        cout << left << setw(24) << "benchmark" << setw(22) << "metric" << right
+             << setw(14) << "baseline" << setw(14) << "current" << setw(10) << "change" << "  result" << endl;
+        for (std::map<std::string, measurement>::iterator i = results.begin(); i != results.end(); ++i)
+        {
+            const char* metrics[] = {"median_us", "allocations_per_call", "bytes_per_call"};
+            const double current[] = {i->second.median_us, i->second.allocations_per_call, i->second.bytes_per_call};
+            // latencies are noisy.  The allocations of a call are repeatable but depend a
+            // little on the standard library, so they get a small tolerance and, for
+            // baselines near 0, a few allocations or bytes of slack.
+            const double allowed[] = {tolerance, alloc_tolerance, alloc_tolerance};
+            const double slack[] = {0, 2, 256};
+            for (int k = 0; k < 3; ++k)
+            {
+                cout << left << setw(24) << i->first << setw(22) << metrics[k] << right;
+                std::map<std::string,double>::const_iterator b = baseline.find(i->first + "." + metrics[k]);
+                if (b == baseline.end())
+                {
+                    cout << setw(14) << "-" << setw(14) << current[k] << setw(10) << "-" << "  FAIL (not in the baseline)" << endl;
+                    failed = true;
+                    continue;
+                }
+                const double change = b->second > 0 ? current[k]/b->second - 1 : (current[k] > 0 ? 1 : 0);
+                const double limit = b->second*(1 + allowed[k]) + slack[k];
+                const bool checked = k != 0 || same_host;
+                const bool regressed = checked && current[k] > limit + 1e-9;
+                ostringstream sout;
+                sout << showpos << fixed << setprecision(1) << 100*change << "%";
+                cout << setw(14) << b->second << setw(14) << current[k] << setw(10) << sout.str()
+                     << (!checked ? "  skipped (other host)" : regressed ? "  FAIL" : "  ok");
+                if (regressed)
+                    cout << " (limit " << limit << ")";
+                cout << endl;
+                failed = failed || regressed;
+            }
+        }
+
+        if (failed)
+        {
+            cout << "Performance regression against " << baseline_file << endl;
+            return 1;
+        }
+        return 0;
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
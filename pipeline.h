@@ -0,0 +1,207 @@
+//[TIF] The detect and align pipeline of humanface.cpp and sheepface.cpp, split into
+//      stages, and the reading of its inputs.  Shared by the pipeline benchmark tools.
+
+#ifndef TIF_PIPELINE_H_
+#define TIF_PIPELINE_H_
+
+#include <dlib/image_processing.h>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/image_io.h>
+#include <dlib/dir_nav.h>
+#include <dlib/misc_api.h>
+#include <dlib/threads.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "imagelist.h"
+#ifdef TIF_WITH_OPENCV
+#include <opencv2/opencv.hpp>
+#include <dlib/opencv.h>
+#endif
+
+// ----------------------------------------------------------------------------------------
+
+enum stage
+{
+    decode_stage,
+    grayscale_stage,
+    pyramid_stage,
+    detect_stage,
+    align_stage,
+    num_stages
+};
+const char* const stage_names[num_stages] = { "decode", "grayscale", "fhog_pyramid", "detect", "align" };
+
+class pipeline
+{
+    /*!
+        WHAT THIS OBJECT REPRESENTS
+            The detect and align path: frontal_face_detector::operator() split into
+            the HOG pyramid, made by detection_workspace::load(), and the detection on
+            it, so the two can be timed one by one, followed by the shape_predictor.
+            Only const members are used so one pipeline serves all the worker threads,
+            each of which passes run() a workspace of its own.  If pyramid_tp != 0 the
+            HOG features of the pyramid levels are extracted, and filtered, in parallel
+            by its threads.
+    !*/
+public:
+    pipeline (
+        const dlib::frontal_face_detector& detector_,
+        const dlib::shape_predictor* sp_,
+        dlib::thread_pool* pyramid_tp_ = 0
+    ) : detector(detector_), sp(sp_), pyramid_tp(pyramid_tp_) {}
+
+    typedef dlib::frontal_face_detector::workspace_type workspace_type;
+
+    void run (
+        workspace_type& workspace,
+        const dlib::array2d<dlib::rgb_pixel>& color,
+        const std::vector<dlib::rectangle>* boxes,
+        std::vector<double>& stage_us,
+        std::vector<double>& align_us,
+        unsigned long& num_faces
+    ) const
+    /*!
+        requires
+            - workspace is not used by another thread at the same time.  Keeping one
+              per worker lets its buffers be reused from frame to frame.
+        ensures
+            - runs every stage after decoding on color and adds their times, in µs, to
+              stage_us.  The align time of every face is put in align_us.
+            - aligns the faces in *boxes if boxes != 0 and the detections otherwise.
+              A detection is aligned from the initial shape of the detector component
+              that found it.
+    !*/
+    {
+        dlib::timestamper ts;
+        dlib::uint64 t = ts.get_timestamp();
+        stage_us.assign(num_stages, 0);
+        align_us.clear();
+
+        dlib::array2d<unsigned char> img;
+        dlib::assign_image(img, color);
+        stage_us[grayscale_stage] = elapsed(ts, t);
+
+        if (pyramid_tp)
+            workspace.load(*pyramid_tp, detector.get_scanner(), img);
+        else
+            workspace.load(detector.get_scanner(), img);
+        stage_us[pyramid_stage] = elapsed(ts, t);
+
+        std::vector<dlib::rect_detection> dets;
+        detector(workspace, dets);
+        stage_us[detect_stage] = elapsed(ts, t);
+
+        num_faces = boxes ? boxes->size() : dets.size();
+        if (sp)
+        {
+            for (unsigned long i = 0; i < num_faces; ++i)
+            {
+                const dlib::full_object_detection shape = boxes ? (*sp)(img, (*boxes)[i]) :
+                                                                  (*sp)(img, dets[i].rect, dets[i].weight_index);
+                align_us.push_back(elapsed(ts, t));
+                stage_us[align_stage] += align_us.back();
+            }
+        }
+    }
+
+private:
+    static double elapsed (
+        dlib::timestamper& ts,
+        dlib::uint64& t
+    )
+    {
+        const dlib::uint64 now = ts.get_timestamp();
+        const double us = now - t;
+        t = now;
+        return us;
+    }
+
+    const dlib::frontal_face_detector& detector;
+    const dlib::shape_predictor* sp;
+    dlib::thread_pool* pyramid_tp;
+};
+
+// ----------------------------------------------------------------------------------------
+
+inline bool is_image_file (
+    const std::string& name
+)
+{
+    const std::string ext = dlib::tolower(dlib::right_substr(name, "."));
+    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp" || ext == "dng";
+}
+
+inline void load_video (
+    const std::string& filename,
+    unsigned long max_frames,
+    dlib::array<dlib::array2d<dlib::rgb_pixel> >& frames,
+    std::vector<double>& decode_us
+)
+{
+#ifdef TIF_WITH_OPENCV
+    cv::VideoCapture cap(filename);
+    if (!cap.isOpened())
+        throw dlib::error("Unable to open video " + filename);
+    dlib::timestamper ts;
+    cv::Mat frame;
+    while (frames.size() < max_frames)
+    {
+        const dlib::uint64 start = ts.get_timestamp();
+        if (!cap.read(frame))
+            break;
+        dlib::array2d<dlib::rgb_pixel> img;
+        dlib::assign_image(img, dlib::cv_image<dlib::bgr_pixel>(frame));
+        decode_us.push_back(ts.get_timestamp() - start);
+        frames.push_back(img);
+    }
+#else
+    (void)max_frames; (void)frames; (void)decode_us;
+    throw dlib::error("Reading videos needs a build with -DTIF_WITH_OPENCV: " + filename);
+#endif
+}
+
+
+inline void load_pipeline_input (
+    const std::string& input,
+    unsigned long max_frames,
+    std::vector<std::string>& names,
+    std::vector<std::vector<dlib::full_object_detection> >& objects,
+    dlib::array<dlib::array2d<dlib::rgb_pixel> >& frames,
+    std::vector<double>& video_decode_us
+)
+/*!
+    ensures
+        - if input is an imagelist.txt, #names and #objects are its images and faces.
+        - if input is another file it is read as a video: #frames holds up to max_frames
+          of its frames and #video_decode_us the time, in µs, it took to decode each.
+        - otherwise input is a directory and #names are the images in it, sorted.
+        - throws dlib::error if no images are found.
+!*/
+{
+    if (dlib::file_exists(input) && dlib::tolower(dlib::right_substr(input, ".")) == "txt")
+    {
+        load_imagelist(input, names, objects);
+    }
+    else if (dlib::file_exists(input))
+    {
+        load_video(input, max_frames, frames, video_decode_us);
+    }
+    else
+    {
+        const std::vector<dlib::file> files = dlib::get_files_in_directory_tree(dlib::directory(input), dlib::match_all(), 0);
+        for (unsigned long i = 0; i < files.size(); ++i)
+        {
+            if (is_image_file(files[i].name()))
+                names.push_back(files[i].full_name());
+        }
+        std::sort(names.begin(), names.end());
+    }
+    if (frames.size() == 0 && names.size() == 0)
+        throw dlib::error("No images found in " + input);
+}
+
+// ----------------------------------------------------------------------------------------
+
+#endif // TIF_PIPELINE_H_
+
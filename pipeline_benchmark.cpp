@@ -0,0 +1,203 @@
+//[TIF] End to end benchmark of the face alignment pipeline.
+//
+//  Runs the decode -> grayscale -> detect -> align path of humanface.cpp and
+//  sheepface.cpp over a set of images for a number of iterations and reports, for each
+//  stage, the p50/p95/p99 latency and throughput as JSON:
+//
+//      decode        load_image() of the file (or reading the frame of a video)
+//      grayscale     assign_image() of the color image to an unsigned char image
+//      fhog_pyramid  the frontal face detector's HOG pyramid, detection_workspace::load()
+//      detect        the detector's filters, thresholds and non-max suppression on it
+//      align         shape_predictor on one face
+//
+//  The input is a directory of images (e.g. images/), an imagelist.txt, whose boxes are
+//  then aligned instead of the detections, or, when built with TIF_WITH_OPENCV, a video
+//  file.  The frames of a video are decoded once, in order, and the decode stage reports
+//  that pass.  Images are spread over --threads workers and the first --warmup
+//  iterations are not measured.
+
+#include <dlib/image_processing.h>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/image_io.h>
+#include <dlib/cmd_line_parser.h>
+#include <dlib/threads.h>
+#include <dlib/misc_api.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include "latency_stats.h"
+#include "pipeline.h"
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+struct job_result
+{
+    job_result() : faces(0) {}
+
+    std::vector<double> stage_us;
+    std::vector<double> align_us;
+    unsigned long faces;
+    std::string failure;
+};
+
+struct run_job
+{
+    // runs the pipeline on image job%num_images.  Runs in a thread_pool so it must not
+    // throw.  Each thread of the pool keeps its own workspace in workspaces.
+    run_job (
+        const pipeline& pipe_,
+        thread_specific_data<pipeline::workspace_type>& workspaces_,
+        const std::vector<std::string>& names_,
+        const dlib::array<array2d<rgb_pixel> >& frames_,
+        const std::vector<std::vector<full_object_detection> >& objects_,
+        std::vector<job_result>& results_
+    ) : pipe(pipe_), workspaces(workspaces_), names(names_), frames(frames_), objects(objects_), results(results_) {}
+
+    void operator() (long job) const
+    {
+        job_result& result = results[job];
+        try
+        {
+            const unsigned long i = job%num_images();
+            timestamper ts;
+            const uint64 start = ts.get_timestamp();
+            array2d<rgb_pixel> decoded;
+            if (frames.size() == 0)
+                load_image(decoded, names[i]);
+            const double decode_us = ts.get_timestamp() - start;
+
+            std::vector<rectangle> boxes;
+            for (unsigned long j = 0; objects.size() != 0 && j < objects[i].size(); ++j)
+                boxes.push_back(objects[i][j].get_rect());
+            pipe.run(workspaces.data(), frames.size() == 0 ? decoded : frames[i], objects.size() != 0 ? &boxes : 0,
+                     result.stage_us, result.align_us, result.faces);
+            result.stage_us[decode_stage] = decode_us;
+        }
+        catch (std::exception& e)
+        {
+            result.failure = e.what();
+        }
+    }
+
+    unsigned long num_images (
+    ) const { return frames.size() != 0 ? frames.size() : names.size(); }
+
+    const pipeline& pipe;
+    thread_specific_data<pipeline::workspace_type>& workspaces;
+    const std::vector<std::string>& names;
+    const dlib::array<array2d<rgb_pixel> >& frames;
+    const std::vector<std::vector<full_object_detection> >& objects;
+    std::vector<job_result>& results;
+};
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        command_line_parser parser;
+        parser.add_option("model", "Align the faces with this shape_predictor.", 1);
+        parser.add_option("iterations", "Measured passes over the images (default 5).", 1);
+        parser.add_option("warmup", "Passes over the images that aren't measured (default 1).", 1);
+        parser.add_option("threads", "Number of worker threads (default 1).", 1);
+        parser.add_option("pyramid-threads", "Threads that extract and filter the HOG pyramid levels in parallel (default 0, serial).", 1);
+        parser.add_option("max-frames", "Frames to read from a video (default 300).", 1);
+        parser.add_option("json", "Write the results to this file instead of stdout.", 1);
+        parser.add_option("h", "Display this help message.");
+        parser.parse(argc, argv);
+
+        if (parser.option("h") || parser.number_of_arguments() != 1)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_pipeline_benchmark images/|imagelist.txt|video [options]" << endl;
+            parser.print_options();
+            return 0;
+        }
+
+        const unsigned long iterations = get_option(parser, "iterations", 5);
+        const unsigned long warmup = get_option(parser, "warmup", 1);
+        const unsigned long num_threads = get_option(parser, "threads", 1);
+        const std::string input = parser[0];
+
+        shape_predictor sp;
+        if (parser.option("model"))
+            deserialize(parser.option("model").argument()) >> sp;
+
+        std::vector<std::string> names;
+        std::vector<std::vector<full_object_detection> > objects;
+        dlib::array<array2d<rgb_pixel> > frames;
+        std::vector<double> video_decode_us;
+        load_pipeline_input(input, get_option(parser, "max-frames", 300), names, objects, frames, video_decode_us);
+        const unsigned long num_images = frames.size() != 0 ? frames.size() : names.size();
+
+        const frontal_face_detector detector = get_frontal_face_detector();
+        const unsigned long pyramid_threads = get_option(parser, "pyramid-threads", 0);
+        thread_pool pyramid_tp(pyramid_threads);
+        const pipeline pipe(detector, parser.option("model") ? &sp : 0, pyramid_threads != 0 ? &pyramid_tp : 0);
+        thread_pool tp(num_threads);
+        thread_specific_data<pipeline::workspace_type> workspaces;
+
+        std::vector<job_result> results(warmup*num_images);
+        parallel_for(tp, 0, results.size(), run_job(pipe, workspaces, names, frames, objects, results), 1);
+
+        results.assign(iterations*num_images, job_result());
+        timestamper ts;
+        const uint64 start = ts.get_timestamp();
+        parallel_for(tp, 0, results.size(), run_job(pipe, workspaces, names, frames, objects, results), 1);
+        const double wall_seconds = (ts.get_timestamp() - start)/1e6;
+
+        std::vector<std::vector<double> > stage_us(num_stages);
+        unsigned long total_faces = 0;
+        for (unsigned long j = 0; j < results.size(); ++j)
+        {
+            if (results[j].failure.size() != 0)
+                throw error(results[j].failure);
+            for (unsigned long s = 0; s < num_stages; ++s)
+            {
+                if (s != align_stage)
+                    stage_us[s].push_back(results[j].stage_us[s]);
+            }
+            stage_us[align_stage].insert(stage_us[align_stage].end(), results[j].align_us.begin(), results[j].align_us.end());
+            total_faces += results[j].faces;
+        }
+        if (frames.size() != 0)
+            stage_us[decode_stage] = video_decode_us;
+
+        ostringstream sout;
+        sout << "{\"input\":";
+        write_json_string(sout, input);
+        sout << ",\"images\":" << num_images << ",\"iterations\":" << iterations
+             << ",\"warmup\":" << warmup << ",\"threads\":" << num_threads << ",\"pyramid_threads\":" << pyramid_threads << ",\"faces\":" << total_faces
+             << ",\"wall_seconds\":" << wall_seconds << ",\"images_per_second\":" << results.size()/wall_seconds
+             << ",\"stages\":{";
+        for (unsigned long s = 0; s < num_stages; ++s)
+        {
+            sout << (s == 0 ? "" : ",") << "\"" << stage_names[s] << "\":";
+            latency_summary(stage_us[s]).write_json(sout);
+        }
+        sout << "}}" << endl;
+
+        if (parser.option("json"))
+        {
+            ofstream fout(parser.option("json").argument().c_str());
+            fout << sout.str();
+        }
+        else
+        {
+            cout << sout.str();
+        }
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
@@ -0,0 +1,85 @@
+//[TIF] Profile guided reordering of the trees of a shape_predictor.
+//
+//  Runs the model over the faces of a calibration image list, counts how often each
+//  branch of each tree is taken and rewrites the model so that every tree's usual
+//  path is contiguous in memory and trees testing the same features are evaluated
+//  next to each other (see reorder_shape_predictor_trees()).  The rewritten model
+//  predicts exactly the same landmarks, which is checked on the calibration faces
+//  before it is saved.  The calibration list doesn't need ground truth landmarks.
+//  Models with per detector component initial shapes are profiled from the initial
+//  shape of the frontal face detector component that finds each face.
+
+#include <dlib/image_processing.h>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/misc_api.h>
+#include <iostream>
+#include "imagelist.h"
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        if (argc < 4)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_reorder model.dat calibration_imagelist.txt reordered_model.dat" << endl;
+            return 0;
+        }
+
+        shape_predictor sp;
+        deserialize(argv[1]) >> sp;
+
+        std::vector<std::string> names;
+        std::vector<std::vector<full_object_detection> > objects;
+        dlib::array<array2d<unsigned char> > images;
+        load_imagelist(argv[2], names, objects);
+        load_imagelist_images(names, images);
+
+        // Without component initial shapes every face starts from the mean shape.
+        std::vector<std::vector<unsigned long> > components(objects.size());
+        for (unsigned long i = 0; i < objects.size(); ++i)
+            components[i].assign(objects[i].size(), sp.get_component_initial_shapes().size());
+        if (sp.get_component_initial_shapes().size() != 0)
+        {
+            frontal_face_detector detector = get_frontal_face_detector();
+            components = find_detector_components(detector, images, objects);
+        }
+
+        const shape_predictor reordered = reorder_shape_predictor_trees(sp, 
+            profile_shape_predictor_branches(sp, images, objects, components));
+
+        for (unsigned long i = 0; i < objects.size(); ++i)
+        {
+            for (unsigned long j = 0; j < objects[i].size(); ++j)
+            {
+                const full_object_detection a = sp(images[i], objects[i][j].get_rect(), components[i][j]);
+                const full_object_detection b = reordered(images[i], objects[i][j].get_rect(), components[i][j]);
+                for (unsigned long k = 0; k < a.num_parts(); ++k)
+                {
+                    if (a.part(k) != b.part(k))
+                        throw error("The reordered model disagrees with the original on " + names[i]);
+                }
+            }
+        }
+
+        cout << "# model us_per_face" << endl;
+        cout << "original  " << time_shape_predictor(sp, images, objects, 0.5) << endl;
+        cout << "reordered " << time_shape_predictor(reordered, images, objects, 0.5) << endl;
+
+        serialize(argv[3]) << reordered;
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+
@@ -0,0 +1,154 @@
+//[TIF] On disk cache of landmark results, keyed on the content of the image.
+//
+//  A result is stored under the md5 of the image file's bytes, the md5 of the model
+//  file, the way the image is decoded to grayscale and the face box, so a byte
+//  identical copy of an image, under any name, is a hit while a retrained model, a
+//  different decoder (whose pixels, and so landmarks, may differ slightly) or a moved
+//  box is a miss.  Every result is its own file
+//  in the cache directory, written to a temporary file first and then renamed, so
+//  several threads or processes can share one cache.
+
+#ifndef TIF_RESULT_CACHE_H_
+#define TIF_RESULT_CACHE_H_
+
+#include <dlib/image_processing.h>
+#include <dlib/md5.h>
+#include <dlib/misc_api.h>
+#include <dlib/serialize.h>
+#include <dlib/string.h>
+#include <dlib/threads.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// ----------------------------------------------------------------------------------------
+
+inline std::string file_md5 (
+    const std::string& filename
+)
+/*!
+    ensures
+        - returns the md5 of the bytes of filename, as a hex string.
+        - throws dlib::error if the file can't be read.
+!*/
+{
+    std::ifstream fin(filename.c_str(), std::ios::binary);
+    if (!fin)
+        throw dlib::error("Unable to open " + filename);
+    return dlib::md5(fin);
+}
+
+class result_cache
+{
+    /*!
+        WHAT THIS OBJECT REPRESENTS
+            The landmarks found by one model on images decoded one way, stored in a
+            directory and looked up by the content hash of an image and a face box.
+    !*/
+public:
+    result_cache (
+        const std::string& directory_,
+        const std::string& model_filename,
+        const std::string& decoder_
+    ) : directory(directory_), model_id(file_md5(model_filename)), decoder(decoder_)
+    /*!
+        ensures
+            - the cache lives in directory_, which is created if it doesn't exist, and
+              holds results of the model saved in model_filename on images decoded to
+              grayscale by the decoder named decoder_.  Results of another decoder are
+              kept apart even in the same directory.
+    !*/
+    {
+        dlib::create_directory(directory);
+    }
+
+    std::string key (
+        const std::string& image_id,
+        const dlib::rectangle& rect
+    ) const
+    /*!
+        requires
+            - image_id == file_md5() of the image.
+        ensures
+            - returns the key of the result of this cache's model and decoder on rect of
+              the image.
+    !*/
+    {
+        std::ostringstream sout;
+        sout << image_id << " " << model_id << " " << decoder << " " << rect.left() << " " << rect.top()
+             << " " << rect.right() << " " << rect.bottom();
+        return dlib::md5(sout.str());
+    }
+
+    bool get (
+        const std::string& key,
+        dlib::full_object_detection& shape
+    ) const
+    /*!
+        ensures
+            - if there is a result stored under key then #shape == that result and
+              returns true.
+            - otherwise returns false.
+    !*/
+    {
+        std::ifstream fin(path(key).c_str(), std::ios::binary);
+        if (!fin)
+            return false;
+        try
+        {
+            int version = 0;
+            dlib::deserialize(version, fin);
+            if (version != 1)
+                return false;
+            deserialize(shape, fin);
+            return true;
+        }
+        catch (dlib::serialization_error&)
+        {
+            return false;
+        }
+    }
+
+    void put (
+        const std::string& key,
+        const dlib::full_object_detection& shape
+    ) const
+    /*!
+        ensures
+            - stores shape under key.
+            - throws dlib::error if the result can't be written.
+    !*/
+    {
+        dlib::timestamper ts;
+        std::ostringstream tmp;
+        tmp << path(key) << "." << dlib::get_thread_id() << "." << ts.get_timestamp() << ".tmp";
+        {
+            std::ofstream fout(tmp.str().c_str(), std::ios::binary);
+            int version = 1;
+            dlib::serialize(version, fout);
+            serialize(shape, fout);
+            if (!fout)
+                throw dlib::error("Unable to write " + tmp.str());
+        }
+        if (std::rename(tmp.str().c_str(), path(key).c_str()) != 0)
+        {
+            std::remove(tmp.str().c_str());
+            throw dlib::error("Unable to write " + path(key));
+        }
+    }
+
+private:
+    std::string path (
+        const std::string& key
+    ) const { return directory + "/" + key + ".dat"; }
+
+    std::string directory;
+    std::string model_id;
+    std::string decoder;
+};
+
+// ----------------------------------------------------------------------------------------
+
+#endif // TIF_RESULT_CACHE_H_
+
@@ -8,27 +8,254 @@ Heng Yang*, Renqiao Zhang*, Peter Robinson, "Human and Sheep Landmarks Localisat
 */
 
 
+//[TIF] Built with -DTIF_HEADLESS (see Makefile_sheep_batch) only the batch mode is
+//      compiled in and neither OpenCV, boost nor a window system is needed.
+#ifndef TIF_HEADLESS
 #include <opencv2/opencv.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/iostreams/device/file.hpp>
 #include <boost/iostreams/stream.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#endif
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <time.h>
 #include <dlib/image_processing.h>
 #include <dlib/image_processing/frontal_face_detector.h>
+#ifndef TIF_HEADLESS
 #include <dlib/gui_widgets.h>
-#include <dlib/image_io.h>
 #include <dlib/opencv.h>
+#endif
+#include <dlib/image_io.h>
 #include <dlib/matrix.h>
+#include <dlib/threads.h>
+#include <dlib/misc_api.h>
 #include <ctime>
+#include "imagelist.h"
+#include "latency_stats.h"
+#include "result_cache.h"
 using namespace dlib;
+#ifndef TIF_HEADLESS
 using namespace cv;
+#endif
 using namespace std;
 
 // ----------------------------------------------------------------------------------------
+
+//[TIF] headless batch mode
+
+// the name of load_gray_image()'s decoding, which the result_cache keys include.
+#ifdef TIF_HEADLESS
+const char* const gray_image_decoder = "dlib_load_image";
+#else
+const char* const gray_image_decoder = "opencv_imread_bgr2gray";
+#endif
+
+void load_gray_image (
+    array2d<unsigned char>& img,
+    const std::string& filename
+)
+{
+#ifdef TIF_HEADLESS
+    load_image(img, filename);
+#else
+    // same decoding and color conversion as the interactive mode
+    cv::Mat frame = cv::imread(filename);
+    if (frame.empty())
+        throw dlib::error("Unable to read image " + filename);
+    cv::Mat gray;
+    cv::cvtColor(frame, gray, CV_BGR2GRAY);
+    assign_image(img, dlib::cv_image<unsigned char>(gray));
+#endif
+}
+
+struct batch_result
+{
+    batch_result() : cached(false), lookup_us(0), decode_us(0), predict_us(0), error(0), normalized_error(0) {}
+
+    std::vector<full_object_detection> shapes;
+    bool cached;                // the shapes came from the result_cache
+    double lookup_us;           // hashing the file and looking in the cache
+    double decode_us;
+    double predict_us;
+    double error;               // mean landmark error in pixels, if there is ground truth
+    double normalized_error;    // the same relative to the width of the box
+    std::string failure;
+};
+
+struct batch_job
+{
+    // processes the i-th line of the image list, skipping the decoding and alignment if
+    // cache != 0 and holds all its faces.  Runs in a thread_pool so it must not throw.
+    batch_job (
+        const shape_predictor& sp_,
+        const result_cache* cache_,
+        const std::vector<std::string>& names_,
+        const std::vector<std::vector<full_object_detection> >& objects_,
+        std::vector<batch_result>& results_
+    ) : sp(sp_), cache(cache_), names(names_), objects(objects_), results(results_) {}
+
+    void operator() (long i) const
+    {
+        batch_result& result = results[i];
+        try
+        {
+            timestamper ts;
+            const uint64 start = ts.get_timestamp();
+            std::vector<std::string> keys;
+            if (cache)
+            {
+                const std::string image_id = file_md5(names[i]);
+                full_object_detection shape;
+                for (unsigned long j = 0; j < objects[i].size(); ++j)
+                {
+                    keys.push_back(cache->key(image_id, objects[i][j].get_rect()));
+                    if (cache->get(keys[j], shape))
+                        result.shapes.push_back(shape);
+                }
+                result.cached = result.shapes.size() == objects[i].size();
+                if (!result.cached)
+                    result.shapes.clear();
+            }
+            const uint64 looked_up = ts.get_timestamp();
+            result.lookup_us = looked_up - start;
+
+            if (!result.cached)
+            {
+                array2d<unsigned char> img;
+                load_gray_image(img, names[i]);
+                const uint64 decoded = ts.get_timestamp();
+                for (unsigned long j = 0; j < objects[i].size(); ++j)
+                    result.shapes.push_back(sp(img, objects[i][j].get_rect()));
+                result.decode_us = decoded - looked_up;
+                result.predict_us = ts.get_timestamp() - decoded;
+                for (unsigned long j = 0; j < keys.size(); ++j)
+                    cache->put(keys[j], result.shapes[j]);
+            }
+
+            running_stats<double> rs, rs_normalized;
+            for (unsigned long j = 0; j < objects[i].size(); ++j)
+            {
+                const full_object_detection& truth = objects[i][j];
+                for (unsigned long k = 0; k < truth.num_parts() && k < result.shapes[j].num_parts(); ++k)
+                {
+                    const double err = length(result.shapes[j].part(k) - truth.part(k));
+                    rs.add(err);
+                    rs_normalized.add(err/truth.get_rect().width());
+                }
+            }
+            if (rs.current_n() != 0)
+            {
+                result.error = rs.mean();
+                result.normalized_error = rs_normalized.mean();
+            }
+        }
+        catch (std::exception& e)
+        {
+            result.failure = e.what();
+        }
+    }
+
+    const shape_predictor& sp;
+    const result_cache* cache;
+    const std::vector<std::string>& names;
+    const std::vector<std::vector<full_object_detection> >& objects;
+    std::vector<batch_result>& results;
+};
+
+void run_batch (
+    const shape_predictor& sp,
+    const std::string& imgsfilename,
+    const std::string& outfilename,
+    unsigned long num_threads,
+    const result_cache* cache
+)
+/*!
+    ensures
+        - aligns the faces of the image list on num_threads workers, without any
+          window, and writes the landmarks to outfilename in the same format as the
+          interactive mode.  Prints the wall clock latency and throughput and, for
+          lines with ground truth landmarks, the landmark error.
+        - if cache != 0, images whose results are in it aren't decoded or aligned
+          again, and new results are added to it.
+!*/
+{
+    std::vector<std::string> names;
+    std::vector<std::vector<full_object_detection> > objects;
+    load_imagelist(imgsfilename, names, objects);
+
+    std::vector<batch_result> results(names.size());
+    thread_pool tp(num_threads);
+    timestamper ts;
+    const uint64 start = ts.get_timestamp();
+    parallel_for(tp, 0, names.size(), batch_job(sp, cache, names, objects, results), 1);
+    const double wall_seconds = (ts.get_timestamp() - start)/1e6;
+
+    ofstream out(outfilename.c_str());
+    std::vector<double> lookup_us, decode_us, predict_us, total_us;
+    running_stats<double> error, normalized_error;
+    unsigned long failures = 0, cache_hits = 0;
+    for (unsigned long i = 0; i < results.size(); ++i)
+    {
+        if (results[i].failure.size() != 0)
+        {
+            cout << "failed on " << names[i] << ": " << results[i].failure << endl;
+            ++failures;
+            out << endl;
+            continue;
+        }
+        for (unsigned long j = 0; j < results[i].shapes.size(); ++j)
+        {
+            for (unsigned long k = 0; k < results[i].shapes[j].num_parts(); ++k)
+                out << results[i].shapes[j].part(k).x() << " " << results[i].shapes[j].part(k).y() << " ";
+        }
+        out << endl;
+        lookup_us.push_back(results[i].lookup_us);
+        if (results[i].cached)
+        {
+            ++cache_hits;
+        }
+        else
+        {
+            decode_us.push_back(results[i].decode_us);
+            predict_us.push_back(results[i].predict_us);
+        }
+        total_us.push_back(results[i].lookup_us + results[i].decode_us + results[i].predict_us);
+        if (objects[i][0].num_parts() != 0)
+        {
+            error.add(results[i].error);
+            normalized_error.add(results[i].normalized_error);
+        }
+    }
+
+    ostringstream sout;
+    sout << "{\"images\":" << names.size() << ",\"failures\":" << failures << ",\"threads\":" << num_threads
+         << ",\"wall_seconds\":" << wall_seconds << ",\"images_per_second\":" << names.size()/wall_seconds;
+    if (cache)
+    {
+        sout << ",\"cache_hits\":" << cache_hits << ",\"lookup\":";
+        latency_summary(lookup_us).write_json(sout);
+    }
+    sout << ",\"decode\":";
+    latency_summary(decode_us).write_json(sout);
+    sout << ",\"predict\":";
+    latency_summary(predict_us).write_json(sout);
+    sout << ",\"total\":";
+    latency_summary(total_us).write_json(sout);
+    if (error.current_n() != 0)
+        sout << ",\"mean_error_px\":" << error.mean() << ",\"mean_error_box_width\":" << normalized_error.mean();
+    sout << "}" << endl;
+    cout << sout.str();
+
+    std::string summaryfilename = outfilename;
+    summaryfilename.replace(summaryfilename.end()-4, summaryfilename.end(), ".json");
+    ofstream(summaryfilename.c_str()) << sout.str();
+}
+
+// ----------------------------------------------------------------------------------------
+#ifndef TIF_HEADLESS
 bool load_annotations(std::vector<std::string>& names, std::vector<cv::Rect>& rects, std::string url) {
   if (boost::filesystem::exists(url.c_str())) {
     std::string filename(url.c_str());
@@ -52,24 +279,57 @@ bool load_annotations(std::vector<std::string>& names, std::vector<cv::Rect>& re
   }
   return false;
 }
+#endif
 int main(int argc, char** argv)
 {  
     try
     {
 
-        if (argc == 1)
+        if (argc < 3)
         {
             cout << "Call this program like this:" << endl;
-            cout << "./TIF Model/sheep_8p.dat images.txt" << endl;
+            cout << "./TIF Model/sheep_8p.dat images.txt [--batch [num_threads] [--cache dir]]" << endl;
+            cout << "--batch aligns all the images without showing them (the only mode of" << endl;
+            cout << "a -DTIF_HEADLESS build) and reports speed and landmark error." << endl;
+            cout << "--cache keeps the results in dir and reuses them for identical image files." << endl;
             return 0;
         }
 
         shape_predictor sp;
         deserialize(argv[1]) >> sp;
-        cout << "This program detects " << sp.num_parts() << " landmarks" << endl;
         std::string imgsfilename = argv[2];
         std::string outfilename = imgsfilename;
         outfilename.replace(outfilename.end()-4, outfilename.end(),"_TIF_result.txt");
+
+        bool batch = argc > 3 && std::string(argv[3]) == "--batch";
+#ifdef TIF_HEADLESS
+        batch = true;
+#endif
+        if (batch)
+        {
+            unsigned long num_threads = 4;
+            std::string cache_dir;
+            for (int a = argc > 3 && std::string(argv[3]) == "--batch" ? 4 : 3; a < argc; ++a)
+            {
+                if (std::string(argv[a]) == "--cache" && a+1 < argc)
+                    cache_dir = argv[++a];
+                else
+                    num_threads = string_cast<unsigned long>(argv[a]);
+            }
+            if (cache_dir.size() != 0)
+            {
+                const result_cache cache(cache_dir, argv[1], gray_image_decoder);
+                run_batch(sp, imgsfilename, outfilename, num_threads, &cache);
+            }
+            else
+            {
+                run_batch(sp, imgsfilename, outfilename, num_threads, 0);
+            }
+            return 0;
+        }
+
+#ifndef TIF_HEADLESS
+        cout << "This program detects " << sp.num_parts() << " landmarks" << endl;
         ofstream out(outfilename.c_str());
         std::cout << "start processing..." << std::endl;
         std::vector<std::string> names;
@@ -107,11 +367,13 @@ int main(int argc, char** argv)
             cv::waitKey(1000);//To decrease this number for speed up. 
         }
         out.close();
+#endif
     }
     catch (exception& e)
     {
         cout << "\nexception thrown!" << endl;
         cout << e.what() << endl;
+        return 1;
     }
 }
 
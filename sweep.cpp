@@ -0,0 +1,316 @@
+//[TIF] Hyperparameter sweep for the TIF shape_predictor_trainer.
+//
+//  Trains one model per configuration of a grid (or a random sample of it), all in
+//  one process, and prints the validation error and the measured prediction time of
+//  each.  The decoded images are shared by all the runs and so are the initial shapes
+//  and first cascade features of runs that only differ in the tree parameters.
+//
+//  The sweep file holds one trainer setting per line followed by the values to try:
+//
+//      cascade_depth 6 10
+//      tree_depth 3 4 5
+//      num_trees_per_cascade_level 300
+//      nu 0.05 0.1
+//      lambda 0.1
+//      feature_pool_size 400
+//      num_test_splits 20
+//      oversampling_amount 20
+//      random 8        (optional: train 8 random grid points instead of the full grid)
+//      seed 0          (optional: seed of the trainers and of the random search)
+//
+//  Settings that are left out keep the shape_predictor_trainer defaults.
+
+#include <dlib/image_processing.h>
+#include <dlib/threads.h>
+#include <dlib/misc_api.h>
+#include <dlib/statistics.h>
+#include <dlib/rand.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include "imagelist.h"
+
+using namespace dlib;
+using namespace std;
+
+// ----------------------------------------------------------------------------------------
+
+const char* setting_names[] = {
+    "cascade_depth", "tree_depth", "num_trees_per_cascade_level", "nu", "lambda",
+    "feature_pool_size", "num_test_splits", "oversampling_amount"
+};
+const unsigned long num_settings = sizeof(setting_names)/sizeof(setting_names[0]);
+
+struct sweep_spec
+{
+    sweep_spec() : random_runs(0), seed("0") {}
+
+    std::vector<std::vector<double> > values; // values[i] are the values of setting_names[i]
+    unsigned long random_runs;
+    std::string seed;
+};
+
+sweep_spec load_sweep_spec (
+    const std::string& filename
+)
+{
+    ifstream fin(filename.c_str());
+    if (!fin)
+        throw error("Unable to open sweep file " + filename);
+
+    shape_predictor_trainer defaults;
+    sweep_spec spec;
+    spec.values.resize(num_settings);
+    spec.values[0].push_back(defaults.get_cascade_depth());
+    spec.values[1].push_back(defaults.get_tree_depth());
+    spec.values[2].push_back(defaults.get_num_trees_per_cascade_level());
+    spec.values[3].push_back(defaults.get_nu());
+    spec.values[4].push_back(defaults.get_lambda());
+    spec.values[5].push_back(defaults.get_feature_pool_size());
+    spec.values[6].push_back(defaults.get_num_test_splits());
+    spec.values[7].push_back(defaults.get_oversampling_amount());
+
+    string line;
+    while (getline(fin, line))
+    {
+        line = line.substr(0, line.find('#'));
+        istringstream sin(line);
+        string name;
+        if (!(sin >> name))
+            continue;
+
+        if (name == "random")
+        {
+            sin >> spec.random_runs;
+            continue;
+        }
+        if (name == "seed")
+        {
+            sin >> spec.seed;
+            continue;
+        }
+
+        unsigned long i = 0;
+        while (i < num_settings && name != setting_names[i])
+            ++i;
+        if (i == num_settings)
+            throw error("Unknown setting in sweep file: " + name);
+
+        spec.values[i].clear();
+        double val;
+        while (sin >> val)
+            spec.values[i].push_back(val);
+        if (spec.values[i].size() == 0)
+            throw error("No values given for " + name);
+    }
+    return spec;
+}
+
+// ----------------------------------------------------------------------------------------
+
+typedef std::vector<double> config;
+
+std::vector<config> make_configs (
+    const sweep_spec& spec
+)
+{
+    // enumerate the whole grid
+    std::vector<config> grid(1);
+    for (unsigned long i = 0; i < num_settings; ++i)
+    {
+        std::vector<config> next;
+        for (unsigned long j = 0; j < grid.size(); ++j)
+        {
+            for (unsigned long k = 0; k < spec.values[i].size(); ++k)
+            {
+                next.push_back(grid[j]);
+                next.back().push_back(spec.values[i][k]);
+            }
+        }
+        grid.swap(next);
+    }
+
+    if (spec.random_runs == 0 || spec.random_runs >= grid.size())
+        return grid;
+
+    // random search: a random subset of the grid, without repeats
+    dlib::rand rnd(spec.seed);
+    for (unsigned long i = 0; i < spec.random_runs; ++i)
+        std::swap(grid[i], grid[i + rnd.get_random_32bit_number()%(grid.size()-i)]);
+    grid.resize(spec.random_runs);
+    return grid;
+}
+
+shape_predictor_trainer make_trainer (
+    const config& c,
+    const std::string& seed
+)
+{
+    shape_predictor_trainer trainer;
+    trainer.set_cascade_depth((unsigned long)c[0]);
+    trainer.set_tree_depth((unsigned long)c[1]);
+    trainer.set_num_trees_per_cascade_level((unsigned long)c[2]);
+    trainer.set_nu(c[3]);
+    trainer.set_lambda(c[4]);
+    trainer.set_feature_pool_size((unsigned long)c[5]);
+    trainer.set_num_test_splits((unsigned long)c[6]);
+    trainer.set_oversampling_amount((unsigned long)c[7]);
+    trainer.set_random_seed(seed);
+    return trainer;
+}
+
+// ----------------------------------------------------------------------------------------
+
+struct sweep_result
+{
+    sweep_result() : error(0), us_per_face(0), train_seconds(0) {}
+
+    shape_predictor sp;
+    double error;
+    double us_per_face;
+    double train_seconds;
+    std::string failure;
+};
+
+struct train_config
+{
+    // trains the i-th configuration.  Runs in a thread_pool so it must not throw.
+    train_config (
+        const std::vector<config>& configs_,
+        const std::string& seed_,
+        const std::vector<const shape_predictor_training_start*>& starts_,
+        const dlib::array<array2d<unsigned char> >& images_,
+        const std::vector<std::vector<full_object_detection> >& objects_,
+        std::vector<sweep_result>& results_
+    ) : configs(configs_), seed(seed_), starts(starts_), images(images_), objects(objects_), results(results_) {}
+
+    void operator() (long i) const
+    {
+        try
+        {
+            timestamper ts;
+            const uint64 start_time = ts.get_timestamp();
+            results[i].sp = make_trainer(configs[i], seed).train(images, objects, *starts[i]);
+            results[i].train_seconds = (ts.get_timestamp() - start_time)/1e6;
+        }
+        catch (std::exception& e)
+        {
+            results[i].failure = e.what();
+        }
+    }
+
+    const std::vector<config>& configs;
+    const std::string& seed;
+    const std::vector<const shape_predictor_training_start*>& starts;
+    const dlib::array<array2d<unsigned char> >& images;
+    const std::vector<std::vector<full_object_detection> >& objects;
+    std::vector<sweep_result>& results;
+};
+
+// ----------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        if (argc < 4)
+        {
+            cout << "Call this program like this:" << endl;
+            cout << "./TIF_sweep sweep.txt train_imagelist.txt validation_imagelist.txt [num_threads] [result.txt]" << endl;
+            cout << "num_threads defaults to 4." << endl;
+            return 0;
+        }
+
+        const sweep_spec spec = load_sweep_spec(argv[1]);
+        const unsigned long num_threads = argc > 4 ? string_cast<unsigned long>(argv[4]) : 4;
+
+        std::vector<std::string> train_names, val_names;
+        std::vector<std::vector<full_object_detection> > train_objects, val_objects;
+        dlib::array<array2d<unsigned char> > train_images, val_images;
+        load_imagelist(argv[2], train_names, train_objects);
+        load_imagelist(argv[3], val_names, val_objects);
+        load_imagelist_images(train_names, train_images);
+        load_imagelist_images(val_names, val_images);
+
+        const std::vector<std::vector<double> > val_scales = box_width_scales(val_objects);
+
+        const std::vector<config> configs = make_configs(spec);
+        cout << "Training " << configs.size() << " models on " << train_names.size()
+             << " images with " << num_threads << " threads" << endl;
+
+        // Runs with the same oversampling amount and feature pool size share their
+        // initial shapes and first cascade features.
+        std::map<std::pair<unsigned long,unsigned long>, shape_predictor_training_start> starts;
+        std::vector<const shape_predictor_training_start*> start_of_config(configs.size());
+        for (unsigned long i = 0; i < configs.size(); ++i)
+        {
+            const std::pair<unsigned long,unsigned long> key((unsigned long)configs[i][7], (unsigned long)configs[i][5]);
+            if (starts.count(key) == 0)
+            {
+                shape_predictor_trainer trainer = make_trainer(configs[i], spec.seed);
+                trainer.set_num_threads(num_threads);
+                starts[key] = trainer.prepare_training(train_images, train_objects);
+            }
+            start_of_config[i] = &starts[key];
+        }
+
+        // Each run is single threaded and the runs are spread over the cores.
+        std::vector<sweep_result> results(configs.size());
+        thread_pool tp(num_threads);
+        parallel_for(tp, 0, configs.size(),
+            train_config(configs, spec.seed, start_of_config, train_images, train_objects, results), 1);
+
+        // Time the models one at a time so they don't compete for the cores.
+        for (unsigned long i = 0; i < results.size(); ++i)
+        {
+            if (results[i].failure.size() != 0)
+                continue;
+            results[i].error = test_shape_predictor(results[i].sp, val_images, val_objects, val_scales);
+            results[i].us_per_face = time_shape_predictor(results[i].sp, val_images, val_objects, 0.2);
+        }
+
+        // A run is on the Pareto front if no other run is both more accurate and faster.
+        ostringstream sout;
+        sout << "#  run";
+        for (unsigned long k = 0; k < num_settings; ++k)
+            sout << " " << setting_names[k];
+        sout << " val_error us_per_face train_seconds pareto" << endl;
+        for (unsigned long i = 0; i < results.size(); ++i)
+        {
+            sout << setw(6) << i;
+            for (unsigned long k = 0; k < num_settings; ++k)
+                sout << " " << configs[i][k];
+            if (results[i].failure.size() != 0)
+            {
+                sout << " failed: " << results[i].failure << endl;
+                continue;
+            }
+            bool pareto = true;
+            for (unsigned long j = 0; j < results.size(); ++j)
+            {
+                if (results[j].failure.size() == 0 && results[j].error < results[i].error &&
+                    results[j].us_per_face < results[i].us_per_face)
+                    pareto = false;
+            }
+            sout << " " << results[i].error << " " << results[i].us_per_face << " "
+                 << results[i].train_seconds << " " << (pareto ? "*" : "-") << endl;
+        }
+        cout << sout.str();
+        if (argc > 5)
+        {
+            ofstream fout(argv[5]);
+            fout << sout.str();
+        }
+    }
+    catch (exception& e)
+    {
+        cout << "\nexception thrown!" << endl;
+        cout << e.what() << endl;
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------
+